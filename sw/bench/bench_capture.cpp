@@ -0,0 +1,78 @@
+#include "common.h"
+#include <vector>
+
+#include <opencv2/imgproc.hpp>
+#include <opencv2/highgui.hpp>
+
+#include "overlay.h"
+#include "picture.h"
+
+// stamped text, same size as the timestamp + temperature line
+#define BENCH_TEXT "01.01.2000 00:00:00 25.0C"
+
+// usage: bench-capture [fps] [frames] [replay file]
+int main(int argc, char *argv[]) {
+    double fps = (argc > 1) ? atof(argv[1]) : 0;
+    int frames = (argc > 2) ? atoi(argv[2]) : 100;
+
+    // select frame source
+    CFrameSource *pSource;
+    if (argc > 3) pSource = new CReplaySource(argv[3], fps);
+    else pSource = new CSyntheticSource(fps);
+
+    CCamera camera;
+    if (!camera.Init(pSource) || !camera.Connect()) {
+        fprintf(stderr, "Error: can not open frame source!\n");
+        return 1;
+    }
+
+    COverlay overlay;
+    overlay.Init(cv::FONT_HERSHEY_COMPLEX_SMALL, 1.0);
+
+    cv::Mat image;
+    std::vector<unsigned char> jpeg;
+    double tCapture = 0, tPutText = 0, tOverlay = 0, tEncode = 0;
+    size_t bytes = 0;
+
+    double start = GetTimeSec();
+    for (int i = 0; i < frames; i++) {
+        double t0 = GetTimeSec();
+
+        // capture incl. colour fix-up
+        if (!camera.Capture(image, 1)) {
+            fprintf(stderr, "Error: capture failed at frame %d!\n", i);
+            return 1;
+        }
+        double t1 = GetTimeSec();
+
+        // overlay drawn by Hershey font renderer
+        cv::putText(image, BENCH_TEXT, cv::Point(image.cols - 235, image.rows - 40),
+                cv::FONT_HERSHEY_COMPLEX_SMALL, 1.0, cv::Scalar(255, 255, 255));
+        double t2 = GetTimeSec();
+
+        // overlay from glyph cache
+        overlay.Stamp(image, BENCH_TEXT, cv::Point(image.cols - 235, image.rows - 20), cv::Scalar(255, 255, 255));
+        double t3 = GetTimeSec();
+
+        // encode
+        cv::imencode(".jpg", image, jpeg);
+        double t4 = GetTimeSec();
+
+        tCapture += t1 - t0;
+        tPutText += t2 - t1;
+        tOverlay += t3 - t2;
+        tEncode += t4 - t3;
+        bytes += jpeg.size();
+    }
+    double total = GetTimeSec() - start;
+
+    printf("source %s %dx%d, %d frames, target %.1f fps\n", camera.GetID().c_str(),
+            pSource->GetWidth(), pSource->GetHeight(), frames, fps);
+    printf("capture %8.3f ms/frame\n", tCapture * 1000 / frames);
+    printf("puttext %8.3f ms/frame\n", tPutText * 1000 / frames);
+    printf("overlay %8.3f ms/frame\n", tOverlay * 1000 / frames);
+    printf("encode  %8.3f ms/frame (%zu bytes avg)\n", tEncode * 1000 / frames, bytes / frames);
+    printf("total   %8.1f fps\n", frames / total);
+
+    return 0;
+}
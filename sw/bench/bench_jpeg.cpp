@@ -0,0 +1,96 @@
+#include "common.h"
+#include <vector>
+
+#include <opencv2/highgui.hpp>
+
+#include "jpegenc.h"
+#include "picture.h"
+
+// number of measured iterations
+#define BENCH_LOOPS 50
+
+static void WriteFile(const char *path, const std::vector<unsigned char> &data) {
+    FILE *pFile = fopen(path, "wb");
+    if (pFile == NULL) return;
+    fwrite(&data[0], data.size(), 1, pFile);
+    fclose(pFile);
+}
+
+static void MeasureEncoder(const char *name, CJpegEncoder &encoder, const cv::Mat &image, PixelFormat format,
+        const char *path) {
+    std::vector<unsigned char> out;
+    bool planar = (format == PF_I420);
+
+    // first call allocates the buffer
+    if (planar) encoder.EncodeI420(image, out);
+    else encoder.Encode(image, out);
+
+    double start = GetTimeSec();
+    for (int i = 0; i < BENCH_LOOPS; i++) {
+        if (planar) encoder.EncodeI420(image, out);
+        else encoder.Encode(image, out);
+        WriteFile(path, out);
+    }
+    double ms = (GetTimeSec() - start) * 1000.0 / BENCH_LOOPS;
+
+    printf("%-14s %8.3f ms/frame %8zu bytes\n", name, ms, out.size());
+}
+
+// usage: bench-jpeg [output file]
+int main(int argc, char *argv[]) {
+    const char *path = (argc > 1) ? argv[1] : "/tmp/bench-jpeg.jpg";
+
+    // realistic frame from synthetic source
+    CSyntheticSource source;
+    cv::Mat image;
+    source.SetFormat(FRAME_WIDTH, FRAME_HEIGHT, PF_BGR);
+    source.Open();
+    source.Grab();
+    source.Retrieve(image);
+
+    printf("frame %dx%d, quality %d\n", image.cols, image.rows, JPEG_DEF_QUALITY);
+
+    // OpenCV encoder incl. file write
+    std::vector<int> params;
+    params.push_back(cv::IMWRITE_JPEG_QUALITY);
+    params.push_back(JPEG_DEF_QUALITY);
+    cv::imwrite(path, image, params);
+
+    double start = GetTimeSec();
+    for (int i = 0; i < BENCH_LOOPS; i++) cv::imwrite(path, image, params);
+    printf("%-14s %8.3f ms/frame\n", "imwrite", (GetTimeSec() - start) * 1000.0 / BENCH_LOOPS);
+
+    CJpegEncoder encoder;
+    SJpegParams jp;
+    jp.quality = JPEG_DEF_QUALITY;
+
+    jp.subsampling = JSS_420;
+    jp.optimize = false;
+    encoder.SetParams(jp);
+    MeasureEncoder("420 fast", encoder, image, PF_BGR, path);
+
+    jp.optimize = true;
+    encoder.SetParams(jp);
+    MeasureEncoder("420 optimized", encoder, image, PF_BGR, path);
+
+    jp.subsampling = JSS_422;
+    jp.optimize = false;
+    encoder.SetParams(jp);
+    MeasureEncoder("422 fast", encoder, image, PF_BGR, path);
+
+    jp.subsampling = JSS_444;
+    encoder.SetParams(jp);
+    MeasureEncoder("444 fast", encoder, image, PF_BGR, path);
+
+    // native YUV420 frame without colour conversion
+    cv::Mat planes;
+    source.SetFormat(FRAME_WIDTH, FRAME_HEIGHT, PF_I420);
+    source.Grab();
+    source.Retrieve(planes);
+
+    jp.subsampling = JSS_420;
+    encoder.SetParams(jp);
+    MeasureEncoder("I420 raw", encoder, planes, PF_I420, path);
+
+    return 0;
+}
@@ -0,0 +1,76 @@
+#include "common.h"
+#include "logger.h"
+#include <sys/stat.h>
+
+// number of measured calls
+#define BENCH_CALLS 10000000
+#define BENCH_SINK_CALLS 1000000
+// sink files
+#define BENCH_TEXT_LOG "/tmp/bench_log.txt"
+#define BENCH_BIN_LOG "/tmp/bench_log.bin"
+#define BENCH_DUMP "/tmp/bench_log.dump"
+
+// disabled debug call with string temporary, as in per-byte paths of serial and GSM modules
+static double DirectCall(const std::string &text) {
+    double start = GetTimeSec();
+    for (int i = 0; i < BENCH_CALLS; i++)
+        CLogger::GetLogger()->LogPrintf(LL_DEBUG, "byte %i: %s", i, (text + ":").c_str());
+    return (GetTimeSec() - start) * 1e9 / BENCH_CALLS;
+}
+
+static double RuntimeCheck(const std::string &text) {
+    double start = GetTimeSec();
+    for (int i = 0; i < BENCH_CALLS; i++) LOG_DEBUG("byte %i: %s", i, (text + ":").c_str());
+    return (GetTimeSec() - start) * 1e9 / BENCH_CALLS;
+}
+
+// enabled debug call formatted by text file sink or recorded raw by binary sink or flight recorder
+static double EnabledCall(const std::string &text) {
+    double start = GetTimeSec();
+    for (int i = 0; i < BENCH_SINK_CALLS; i++) LOG_DEBUG("byte %i: %s", i, text.c_str());
+    return (GetTimeSec() - start) * 1e9 / BENCH_SINK_CALLS;
+}
+
+static long FileSize(const char *pPath) {
+    struct stat st;
+    return stat(pPath, &st) ? -1 : (long)st.st_size;
+}
+
+// as built with -DLOG_COMPILE_LEVEL=LL_INFO
+#undef LOG_COMPILE_LEVEL
+#define LOG_COMPILE_LEVEL LL_INFO
+
+static double CompiledOut(const std::string &text) {
+    double start = GetTimeSec();
+    for (int i = 0; i < BENCH_CALLS; i++) LOG_DEBUG("byte %i: %s", i, (text + ":").c_str());
+    return (GetTimeSec() - start) * 1e9 / BENCH_CALLS;
+}
+
+int main() {
+    std::string text("AT+CIPSEND");
+
+    // debug messages are not logged by any sink
+    CLogger::GetLogger()->SetSystemLogLevel(LL_INFO);
+
+    printf("disabled debug call, %d calls\n", BENCH_CALLS);
+    printf("LogPrintf()       %8.2f ns/call\n", DirectCall(text));
+    printf("LOG_DEBUG runtime %8.2f ns/call\n", RuntimeCheck(text));
+    printf("LOG_DEBUG removed %8.2f ns/call\n", CompiledOut(text));
+
+    printf("enabled debug call, %d calls\n", BENCH_SINK_CALLS);
+    CLogger::GetLogger()->OpenLogFile(LL_DEBUG, BENCH_TEXT_LOG);
+    printf("text file sink    %8.2f ns/call", EnabledCall(text));
+    CLogger::GetLogger()->CloseLogFile();
+    printf(", %ld B\n", FileSize(BENCH_TEXT_LOG));
+    CLogger::GetLogger()->OpenBinaryLog(LL_DEBUG, BENCH_BIN_LOG);
+    printf("binary sink       %8.2f ns/call", EnabledCall(text));
+    CLogger::GetLogger()->CloseBinaryLog();
+    printf(", %ld B\n", FileSize(BENCH_BIN_LOG));
+
+    // only in memory, nothing is written
+    CLogger::GetLogger()->StartFlightRecorder(BENCH_DUMP);
+    printf("flight recorder   %8.2f ns/call\n", EnabledCall(text));
+    CLogger::GetLogger()->StopFlightRecorder();
+
+    return 0;
+}
@@ -0,0 +1,49 @@
+#include "common.h"
+#include <vector>
+
+#include "jpegenc.h"
+#include "motion.h"
+#include "picture.h"
+
+// number of measured frames
+#define BENCH_FRAMES 100
+
+int main() {
+    CSyntheticSource source;
+    source.SetFormat(FRAME_WIDTH, FRAME_HEIGHT, PF_BGR);
+    source.Open();
+
+    // moving synthetic frames
+    cv::Mat frames[2];
+    for (int i = 0; i < 2; i++) {
+        source.Grab();
+        source.Retrieve(frames[i]);
+    }
+
+    CMotionDetector detector;
+    CJpegEncoder encoder;
+    std::vector<unsigned char> jpeg;
+    unsigned motion = 0;
+
+    // first frame only sets the reference
+    detector.Process(frames[0], PF_BGR);
+    encoder.Encode(frames[0], jpeg);
+
+    double start = GetTimeSec();
+    for (int i = 0; i < BENCH_FRAMES; i++) {
+        if (detector.Process(frames[i & 1], PF_BGR)) motion++;
+    }
+    double tDetect = (GetTimeSec() - start) * 1000.0 / BENCH_FRAMES;
+
+    start = GetTimeSec();
+    for (int i = 0; i < BENCH_FRAMES; i++) encoder.Encode(frames[i & 1], jpeg);
+    double tEncode = (GetTimeSec() - start) * 1000.0 / BENCH_FRAMES;
+
+    printf("frame %dx%d, analysed %dx%d, %u blocks\n", FRAME_WIDTH, FRAME_HEIGHT,
+            FRAME_WIDTH / MOTION_SCALE, FRAME_HEIGHT / MOTION_SCALE, detector.GetBlockCount());
+    printf("detector %8.3f ms/frame (%u/%d frames with motion)\n", tDetect, motion, BENCH_FRAMES);
+    printf("encode   %8.3f ms/frame\n", tEncode);
+    printf("detector/encode %.1f%%\n", tDetect * 100.0 / tEncode);
+
+    return 0;
+}
@@ -0,0 +1,48 @@
+#include "common.h"
+#include <vector>
+
+#include "jpegenc.h"
+#include "quality.h"
+#include "picture.h"
+
+// number of measured frames
+#define BENCH_FRAMES 100
+
+int main() {
+    CSyntheticSource source;
+    source.SetFormat(FRAME_WIDTH, FRAME_HEIGHT, PF_BGR);
+    source.Open();
+
+    cv::Mat frame;
+    source.Grab();
+    source.Retrieve(frame);
+
+    CQualityGate gate;
+    CJpegEncoder encoder;
+    std::vector<unsigned char> jpeg;
+    unsigned passed = 0;
+
+    // warm up buffers
+    gate.Process(frame, PF_BGR);
+    encoder.Encode(frame, jpeg);
+
+    double start = GetTimeSec();
+    for (int i = 0; i < BENCH_FRAMES; i++) {
+        if (gate.Process(frame, PF_BGR)) passed++;
+    }
+    double tScore = (GetTimeSec() - start) * 1000.0 / BENCH_FRAMES;
+
+    start = GetTimeSec();
+    for (int i = 0; i < BENCH_FRAMES; i++) encoder.Encode(frame, jpeg);
+    double tEncode = (GetTimeSec() - start) * 1000.0 / BENCH_FRAMES;
+
+    printf("frame %dx%d, analysed %dx%d\n", FRAME_WIDTH, FRAME_HEIGHT,
+            FRAME_WIDTH / QUALITY_STEP, FRAME_HEIGHT / QUALITY_STEP);
+    printf("sharpness %.1f, luma %.1f, spread %u, clipped %.3f (%u/%d frames passed)\n", gate.GetSharpness(),
+            gate.GetLuma(), gate.GetSpread(), gate.GetClipped(), passed, BENCH_FRAMES);
+    printf("score    %8.3f ms/frame\n", tScore);
+    printf("encode   %8.3f ms/frame\n", tEncode);
+    printf("score/encode %.1f%%\n", tScore * 100.0 / tEncode);
+
+    return 0;
+}
@@ -0,0 +1,92 @@
+#include "common.h"
+#include <sys/stat.h>
+#include <vector>
+
+#include "segment.h"
+#include "sink.h"
+
+// number of written pictures per case
+#define BENCH_FILES 400
+// size of one picture [B]
+#define BENCH_FILE_SIZE (150 * 1024)
+// small segments, so that rotation is measured too
+#define BENCH_SEGMENT_SIZE (16 * 1024 * 1024)
+
+static const char* c_modeNames[DM_COUNT] = { "none", "per-file", "group" };
+
+static void Measure(CPictureSink &sink, const char *pName, const char *pMode, const std::string &path,
+        const std::vector<unsigned char> &data) {
+    sink.Init(path);
+
+    double start = GetTimeSec();
+    for (int i = 0; i < BENCH_FILES; i++) sink.Write(0, "bench-" + ToString(i) + ".jpg", data, GetWallTimeMSec());
+    // Close() commits pending pictures
+    sink.Close();
+    double t = GetTimeSec() - start;
+
+    printf("%-8s %-8s %8.1f files/s %8.2f MB/s %6u fsyncs\n", pName, pMode, BENCH_FILES / t,
+            BENCH_FILES * (double)BENCH_FILE_SIZE / (t * 1024 * 1024), sink.GetSyncCount());
+}
+
+static void Clean(const std::string &path) {
+    system(("rm -f " + path + "bench-*.jpg " + path + SEGMENT_PREFIX "*" SEGMENT_EXT).c_str());
+}
+
+// usage: bench-segment [directory on measured card]
+int main(int argc, char *argv[]) {
+    std::string path = std::string((argc > 1) ? argv[1] : "bench-segment") + "/";
+    std::vector<unsigned char> data(BENCH_FILE_SIZE);
+
+    mkdir(path.c_str(), S_IRWXU);
+    Clean(path);
+
+    for (size_t i = 0; i < data.size(); i++) data[i] = rand();
+    data[0] = 0xff;
+    data[1] = 0xd8;
+    data[data.size() - 2] = 0xff;
+    data[data.size() - 1] = 0xd9;
+
+    printf("%d pictures of %d kB in %s\n", BENCH_FILES, BENCH_FILE_SIZE / 1024, path.c_str());
+
+    for (int mode = 0; mode < DM_COUNT; mode++) {
+        CFileSink files;
+        files.SetDurability((Durability)mode);
+        Measure(files, "files", c_modeNames[mode], path, data);
+        Clean(path);
+
+        CSegmentSink segments;
+        segments.SetSegmentSize(BENCH_SEGMENT_SIZE);
+        segments.SetDurability((Durability)mode);
+        Measure(segments, "segments", c_modeNames[mode], path, data);
+
+        // zero-copy scan of the written segments
+        if (mode == DM_COUNT - 1) {
+            unsigned records = 0;
+            uint64_t bytes = 0;
+            double start = GetTimeSec();
+
+            for (unsigned seq = 0; ; seq++) {
+                char name[64];
+                snprintf(name, sizeof(name), SEGMENT_PREFIX "%08u" SEGMENT_EXT, seq);
+                if (access((path + name).c_str(), F_OK) < 0) break;
+
+                CSegmentReader reader;
+                if (!reader.Open(path + name)) break;
+
+                SSegmentView view;
+                uint64_t offset = reader.GetStart();
+                while (reader.Next(offset, view)) {
+                    records++;
+                    bytes += view.pHeader->size;
+                }
+            }
+            double t = GetTimeSec() - start;
+
+            printf("read     mmap     %8.1f files/s %8.2f MB/s (%u records, checksums verified)\n", records / t,
+                    bytes / (t * 1024 * 1024), records);
+        }
+        Clean(path);
+    }
+
+    return 0;
+}
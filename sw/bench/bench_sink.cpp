@@ -0,0 +1,49 @@
+#include "common.h"
+#include <sys/stat.h>
+#include <vector>
+
+#include "sink.h"
+
+// number of written pictures per mode
+#define BENCH_FILES 200
+// size of one picture [B]
+#define BENCH_FILE_SIZE (150 * 1024)
+
+static const char* c_modeNames[DM_COUNT] = { "none", "per-file", "group" };
+
+// usage: bench-sink [directory on measured card]
+int main(int argc, char *argv[]) {
+    std::string path = std::string((argc > 1) ? argv[1] : "bench-sink") + "/";
+    std::vector<unsigned char> data(BENCH_FILE_SIZE);
+
+    mkdir(path.c_str(), S_IRWXU);
+
+    // JPEG markers, so that interrupted files would be recognised
+    for (size_t i = 0; i < data.size(); i++) data[i] = rand();
+    data[0] = 0xff;
+    data[1] = 0xd8;
+    data[data.size() - 2] = 0xff;
+    data[data.size() - 1] = 0xd9;
+
+    printf("%d files of %d kB in %s\n", BENCH_FILES, BENCH_FILE_SIZE / 1024, path.c_str());
+
+    for (int mode = 0; mode < DM_COUNT; mode++) {
+        CFileSink sink;
+        sink.SetDurability((Durability)mode);
+        sink.Init(path);
+
+        // Close() commits the last group
+        double start = GetTimeSec();
+        for (int i = 0; i < BENCH_FILES; i++)
+            sink.Write(0, "bench-" + ToString(i) + ".jpg", data, GetWallTimeMSec());
+        sink.Close();
+        double t = GetTimeSec() - start;
+
+        printf("%-8s %8.1f files/s %8.2f MB/s\n", c_modeNames[mode], BENCH_FILES / t,
+                BENCH_FILES * (double)BENCH_FILE_SIZE / (t * 1024 * 1024));
+
+        for (int i = 0; i < BENCH_FILES; i++) unlink((path + "bench-" + ToString(i) + ".jpg").c_str());
+    }
+
+    return 0;
+}
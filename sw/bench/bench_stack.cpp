@@ -0,0 +1,63 @@
+#include "common.h"
+#include <vector>
+
+#include "jpegenc.h"
+#include "stacker.h"
+#include "picture.h"
+
+// number of measured stacks
+#define BENCH_STACKS 20
+// stacked frames
+#define BENCH_FRAMES 8
+// standard deviation of added sensor noise
+#define BENCH_NOISE 12
+
+int main() {
+    CSyntheticSource source;
+    source.SetFormat(FRAME_WIDTH, FRAME_HEIGHT, PF_BGR);
+    source.Open();
+
+    cv::Mat clean;
+    source.Grab();
+    source.Retrieve(clean);
+
+    // the same scene with independent noise in every frame
+    cv::Mat frames[BENCH_FRAMES];
+    for (int i = 0; i < BENCH_FRAMES; i++) {
+        cv::Mat noise(clean.size(), CV_16SC3);
+        cv::randn(noise, cv::Scalar::all(0), cv::Scalar::all(BENCH_NOISE));
+        clean.convertTo(frames[i], CV_16SC3);
+        frames[i] += noise;
+        frames[i].convertTo(frames[i], CV_8UC3);
+    }
+
+    CFrameStacker stacker;
+    CJpegEncoder encoder;
+    std::vector<unsigned char> jpeg;
+    cv::Mat stacked;
+
+    double start = GetTimeSec();
+    for (int n = 0; n < BENCH_STACKS; n++) {
+        frames[0].copyTo(stacked);
+        stacker.Begin(stacked, PF_BGR);
+        for (int i = 1; i < BENCH_FRAMES; i++) stacker.Add(frames[i]);
+        stacker.Finish();
+    }
+    double tStack = (GetTimeSec() - start) * 1000.0 / BENCH_STACKS;
+
+    encoder.Encode(frames[0], jpeg);
+    size_t single = jpeg.size();
+    encoder.Encode(stacked, jpeg);
+    size_t averaged = jpeg.size();
+
+    printf("frame %dx%d, %d frames, noise sigma %d\n", FRAME_WIDTH, FRAME_HEIGHT, BENCH_FRAMES, BENCH_NOISE);
+    printf("stack    %8.3f ms (%.3f ms/frame), %u blocks moved\n", tStack, tStack / (BENCH_FRAMES - 1),
+            stacker.GetRejected());
+    printf("noise    %8.2f single, %.2f stacked (mean abs diff to clean frame)\n",
+            cv::norm(frames[0], clean, cv::NORM_L1) / clean.total() / 3,
+            cv::norm(stacked, clean, cv::NORM_L1) / clean.total() / 3);
+    printf("jpeg     %8u B single, %u B stacked (%.1f%%)\n", (unsigned)single, (unsigned)averaged,
+            averaged * 100.0 / single);
+
+    return 0;
+}
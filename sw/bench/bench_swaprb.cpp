@@ -0,0 +1,43 @@
+#include "common.h"
+
+#include "imgproc.h"
+#include "picture.h"
+
+// number of measured iterations
+#define BENCH_LOOPS 200
+
+static double Measure(const char *name, cv::Mat &image, ColorSwap swap) {
+    // warm up caches and allocator
+    CCamera::SwapChannels(image, swap);
+
+    double start = GetTimeSec();
+    for (int i = 0; i < BENCH_LOOPS; i++) CCamera::SwapChannels(image, swap);
+    double ms = (GetTimeSec() - start) * 1000.0 / BENCH_LOOPS;
+
+    printf("%-8s %8.3f ms/frame\n", name, ms);
+    return ms;
+}
+
+int main() {
+    cv::Mat image(FRAME_HEIGHT, FRAME_WIDTH, CV_8UC3);
+    cv::randu(image, cv::Scalar::all(0), cv::Scalar::all(255));
+
+    // verify SIMD result against scalar result
+    cv::Mat ref = image.clone();
+    CCamera::SwapChannels(ref, CS_SCALAR);
+    cv::Mat chk = image.clone();
+    CCamera::SwapChannels(chk, CS_SIMD);
+    if (cv::norm(ref, chk, cv::NORM_INF) != 0) {
+        fprintf(stderr, "Error: SIMD swap differs from scalar swap!\n");
+        return 1;
+    }
+
+    printf("frame %dx%d, simd: %s\n", FRAME_WIDTH, FRAME_HEIGHT, SwapRBImplName());
+
+    double split = Measure("split", image, CS_SPLIT);
+    Measure("scalar", image, CS_SCALAR);
+    double simd = Measure("simd", image, CS_SIMD);
+
+    printf("speedup simd/split: %.1fx\n", split / simd);
+    return 0;
+}
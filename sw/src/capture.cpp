@@ -0,0 +1,255 @@
+#include "common.h"
+#include "logger.h"
+#include <errno.h>
+#include <sys/time.h>
+
+#include "picture.h"
+#include "capture.h"
+
+CFrameRef::CFrameRef() :
+    m_pFrame(NULL) {
+}
+
+CFrameRef::CFrameRef(SFrame *pFrame) :
+    m_pFrame(pFrame) {
+}
+
+CFrameRef::CFrameRef(const CFrameRef &copy) :
+    m_pFrame(copy.m_pFrame) {
+    if (m_pFrame != NULL) __sync_fetch_and_add(&m_pFrame->refCount, 1);
+}
+
+CFrameRef& CFrameRef::operator=(const CFrameRef &copy) {
+    if (this == &copy) return *this;
+
+    // take new reference before the old one is dropped
+    if (copy.m_pFrame != NULL) __sync_fetch_and_add(&copy.m_pFrame->refCount, 1);
+    Release();
+    m_pFrame = copy.m_pFrame;
+
+    return *this;
+}
+
+CFrameRef::~CFrameRef() {
+    Release();
+}
+
+void CFrameRef::Release() {
+    if (m_pFrame == NULL) return;
+
+    __sync_fetch_and_sub(&m_pFrame->refCount, 1);
+    m_pFrame = NULL;
+}
+
+CFrameRing::CFrameRing() :
+    m_pNewest(NULL),
+    m_seq(0) {
+    pthread_mutex_init(&m_lock, NULL);
+    pthread_cond_init(&m_newFrame, NULL);
+
+    for (int i = 0; i < FRAME_RING_SIZE; i++) {
+        m_frames[i].format = PF_BGR;
+        m_frames[i].timestamp = 0;
+        m_frames[i].seq = 0;
+        m_frames[i].refCount = 0;
+    }
+}
+
+CFrameRing::~CFrameRing() {
+    for (int i = 0; i < FRAME_RING_SIZE; i++) {
+        if (m_frames[i].refCount)
+            LOG_WARNING("frame %i is still referenced!", i);
+        m_frames[i].image.release();
+    }
+
+    pthread_cond_destroy(&m_newFrame);
+    pthread_mutex_destroy(&m_lock);
+}
+
+bool CFrameRing::Init(int width, int height, PixelFormat format) {
+    pthread_mutex_lock(&m_lock);
+
+    // preallocate all buffers, retrieve() then only copies into them
+    for (int i = 0; i < FRAME_RING_SIZE; i++) {
+        if (m_frames[i].refCount) {
+            pthread_mutex_unlock(&m_lock);
+            LOG_ERROR("frame ring is in use!");
+            return false;
+        }
+        CreateFrame(m_frames[i].image, width, height, format);
+        m_frames[i].format = format;
+        m_frames[i].timestamp = 0;
+        m_frames[i].seq = 0;
+    }
+    m_pNewest = NULL;
+
+    pthread_mutex_unlock(&m_lock);
+    return true;
+}
+
+SFrame* CFrameRing::AcquireWrite() {
+    SFrame *pFrame = NULL;
+
+    pthread_mutex_lock(&m_lock);
+
+    // take the oldest free frame, the newest one stays readable
+    for (int i = 0; i < FRAME_RING_SIZE; i++) {
+        SFrame *pAct = &m_frames[i];
+        if ((pAct == m_pNewest) || pAct->refCount) continue;
+        if ((pFrame == NULL) || (pAct->seq < pFrame->seq)) pFrame = pAct;
+    }
+
+    // writer holds its own reference
+    if (pFrame != NULL) pFrame->refCount = 1;
+
+    pthread_mutex_unlock(&m_lock);
+    return pFrame;
+}
+
+void CFrameRing::Publish(SFrame *pFrame) {
+    if (pFrame == NULL) return;
+
+    pthread_mutex_lock(&m_lock);
+
+    pFrame->seq = ++m_seq;
+    pFrame->refCount--;
+    m_pNewest = pFrame;
+
+    pthread_cond_broadcast(&m_newFrame);
+    pthread_mutex_unlock(&m_lock);
+}
+
+void CFrameRing::Abort(SFrame *pFrame) {
+    if (pFrame == NULL) return;
+
+    pthread_mutex_lock(&m_lock);
+    pFrame->seq = 0;
+    pFrame->refCount--;
+    pthread_mutex_unlock(&m_lock);
+}
+
+bool CFrameRing::GetNewest(CFrameRef &ref, unsigned minSeq, unsigned tmt) {
+    struct timeval now;
+    struct timespec until;
+
+    // compute absolute timeout
+    gettimeofday(&now, NULL);
+    until.tv_sec = now.tv_sec + tmt / 1000;
+    until.tv_nsec = now.tv_usec * 1000 + (tmt % 1000) * 1000000;
+    if (until.tv_nsec >= 1000000000) {
+        until.tv_sec++;
+        until.tv_nsec -= 1000000000;
+    }
+
+    pthread_mutex_lock(&m_lock);
+
+    // wait for frame newer than requested
+    while ((m_pNewest == NULL) || (m_pNewest->seq < minSeq)) {
+        if (pthread_cond_timedwait(&m_newFrame, &m_lock, &until) == ETIMEDOUT) break;
+    }
+
+    if ((m_pNewest == NULL) || (m_pNewest->seq < minSeq)) {
+        pthread_mutex_unlock(&m_lock);
+        return false;
+    }
+
+    // reference the frame while ring is locked, so writer can not take it
+    __sync_fetch_and_add(&m_pNewest->refCount, 1);
+    ref.Release();
+    ref.m_pFrame = m_pNewest;
+
+    pthread_mutex_unlock(&m_lock);
+    return true;
+}
+
+CCaptureThread::CCaptureThread(CCamera *pCamera) :
+    m_pCamera(pCamera),
+    m_running(false),
+    m_stop(false),
+    m_dropped(0) {
+}
+
+CCaptureThread::~CCaptureThread() {
+    Stop();
+    m_pCamera = NULL;
+}
+
+bool CCaptureThread::Start(int width, int height) {
+    if (m_running) return true;
+
+    // check camera
+    if (m_pCamera == NULL) {
+        LOG_ERROR("camera for streaming is missing!");
+        return false;
+    }
+
+    // connect to camera, it stays open while streaming
+    if (!m_pCamera->Connect()) {
+        LOG_ERROR("can not connect to camera!");
+        return false;
+    }
+
+    // preallocate frames
+    if (!m_ring.Init(width, height, m_pCamera->GetFormat())) return false;
+
+    m_stop = false;
+    m_dropped = 0;
+
+    // start capture thread
+    if (pthread_create(&m_thread, NULL, Run, this)) {
+        LOG_ERROR("can not start capture thread!");
+        return false;
+    }
+    m_running = true;
+
+    LOG_DEBUG("capture thread was started");
+    return true;
+}
+
+void CCaptureThread::Stop() {
+    if (!m_running) return;
+
+    // wait for thread
+    m_stop = true;
+    pthread_join(m_thread, NULL);
+    m_running = false;
+
+    LOG_DEBUG("capture thread was stopped, %u frames dropped", m_dropped);
+}
+
+bool CCaptureThread::GetFrame(CFrameRef &ref, unsigned minSeq, unsigned tmt) {
+    if (!m_running) {
+        LOG_ERROR("capture thread is not running!");
+        return false;
+    }
+
+    return m_ring.GetNewest(ref, minSeq, tmt);
+}
+
+void* CCaptureThread::Run(void *pArg) {
+    static_cast<CCaptureThread*>(pArg)->Loop();
+    return NULL;
+}
+
+void CCaptureThread::Loop() {
+    while (!m_stop) {
+        // get free buffer
+        SFrame *pFrame = m_ring.AcquireWrite();
+        if (pFrame == NULL) {
+            // all frames are referenced, skip this one
+            m_dropped++;
+            usleep(1000);
+            continue;
+        }
+
+        // capture single frame, exposure is kept converged by streaming
+        if (!m_pCamera->Capture(pFrame->image, 1)) {
+            m_ring.Abort(pFrame);
+            usleep(100000);
+            continue;
+        }
+
+        pFrame->timestamp = GetTimeSec();
+        m_ring.Publish(pFrame);
+    }
+}
@@ -0,0 +1,95 @@
+#ifndef CAPTURE_H_
+#define CAPTURE_H_
+
+#include <pthread.h>
+#include <opencv2/core.hpp>
+
+#include "framesource.h"
+
+class CCamera;
+
+// count of preallocated frames in the ring
+#define FRAME_RING_SIZE 4
+// max time to wait for the first streamed frame [ms]
+#define FRAME_WAIT_TMT 2000
+
+// frame buffer owned by the ring
+struct SFrame {
+    cv::Mat image;
+    PixelFormat format;
+    double timestamp;   // capture time from start [s]
+    unsigned seq;       // sequence number, 0 = never written
+    int refCount;       // readers + writer holding the buffer
+};
+
+// reference to the ring frame, buffer is not reused while referenced
+class CFrameRef {
+public:
+    CFrameRef();
+    CFrameRef(const CFrameRef &copy);
+    CFrameRef& operator=(const CFrameRef &copy);
+    ~CFrameRef();
+
+    inline bool IsValid() const { return m_pFrame != NULL; }
+    inline const cv::Mat& GetImage() const { return m_pFrame->image; }
+    inline PixelFormat GetFormat() const { return m_pFrame->format; }
+    inline double GetTimestamp() const { return m_pFrame->timestamp; }
+    inline unsigned GetSeq() const { return m_pFrame->seq; }
+
+    void Release();
+
+private:
+    explicit CFrameRef(SFrame *pFrame);
+
+private:
+    SFrame *m_pFrame;
+    friend class CFrameRing;
+};
+
+class CFrameRing {
+public:
+    CFrameRing();
+    ~CFrameRing();
+
+    bool Init(int width, int height, PixelFormat format);
+
+    SFrame* AcquireWrite();
+    void Publish(SFrame *pFrame);
+    void Abort(SFrame *pFrame);
+
+    bool GetNewest(CFrameRef &ref, unsigned minSeq, unsigned tmt);
+
+private:
+    SFrame m_frames[FRAME_RING_SIZE];
+    SFrame *m_pNewest;
+    unsigned m_seq;
+    pthread_mutex_t m_lock;
+    pthread_cond_t m_newFrame;
+};
+
+class CCaptureThread {
+public:
+    explicit CCaptureThread(CCamera *pCamera);
+    ~CCaptureThread();
+
+    bool Start(int width, int height);
+    void Stop();
+    inline bool IsRunning() { return m_running; }
+
+    bool GetFrame(CFrameRef &ref, unsigned minSeq = 0, unsigned tmt = FRAME_WAIT_TMT);
+    inline unsigned GetDropped() { return m_dropped; }
+
+private:
+    static void* Run(void *pArg);
+    void Loop();
+
+private:
+    CCamera *m_pCamera;
+    CFrameRing m_ring;
+    pthread_t m_thread;
+    volatile bool m_running;
+    volatile bool m_stop;
+    unsigned m_dropped;
+};
+
+#endif // CAPTURE_H_
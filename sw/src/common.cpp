@@ -31,3 +31,54 @@ double GetTimeSec() {
     clock_gettime(CLOCK_MONOTONIC, &tm);
     return ((tm.tv_sec - c_TimeStart.tv_sec) + tm.tv_nsec * 0.000000001);
 }
+
+uint64_t GetWallTimeMSec() {
+    struct timespec tm;
+    clock_gettime(CLOCK_REALTIME, &tm);
+    return (uint64_t)tm.tv_sec * 1000 + tm.tv_nsec / 1000000;
+}
+
+uint64_t GetMonoTimeMSec() {
+    struct timespec tm;
+    clock_gettime(CLOCK_MONOTONIC, &tm);
+    return (uint64_t)tm.tv_sec * 1000 + tm.tv_nsec / 1000000;
+}
+
+// tables for CRC-32 by 8 bytes (slicing-by-8), reflected polynomial 0xEDB88320
+static class CCrc32Table
+{
+public:
+    uint32_t table[8][256];
+
+    CCrc32Table() {
+        for (uint32_t i = 0; i < 256; i++) {
+            uint32_t c = i;
+            for (int k = 0; k < 8; k++) c = (c & 1) ? (0xEDB88320 ^ (c >> 1)) : (c >> 1);
+            table[0][i] = c;
+        }
+        for (uint32_t i = 0; i < 256; i++) {
+            for (int t = 1; t < 8; t++) table[t][i] = (table[t - 1][i] >> 8) ^ table[0][table[t - 1][i] & 0xff];
+        }
+    }
+} c_crc32Table;
+
+uint32_t Crc32(const void *pData, size_t len, uint32_t crc) {
+    const unsigned char *p = (const unsigned char*)pData;
+    const uint32_t (*t)[256] = c_crc32Table.table;
+
+    crc = ~crc;
+
+    // 8 bytes per step, little endian load
+    while (len >= 8) {
+        uint32_t lo = crc ^ (p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24));
+        uint32_t hi = p[4] | (p[5] << 8) | (p[6] << 16) | ((uint32_t)p[7] << 24);
+        crc = t[7][lo & 0xff] ^ t[6][(lo >> 8) & 0xff] ^ t[5][(lo >> 16) & 0xff] ^ t[4][lo >> 24] ^
+                t[3][hi & 0xff] ^ t[2][(hi >> 8) & 0xff] ^ t[1][(hi >> 16) & 0xff] ^ t[0][hi >> 24];
+        p += 8;
+        len -= 8;
+    }
+
+    while (len--) crc = t[0][(crc ^ *p++) & 0xff] ^ (crc >> 8);
+
+    return ~crc;
+}
@@ -6,6 +6,7 @@
 #include <fcntl.h>
 #include <unistd.h>
 #include <string.h>
+#include <stdint.h>
 
 // std
 #include <iostream>
@@ -33,5 +34,12 @@ static char ToASCII(const T& n) { static const char a[] = " .:-=0123456789X"; re
 unsigned GetTimeMSec();
 // get time from start in [s]
 double GetTimeSec();
+// get wall clock time since epoch in [ms]
+uint64_t GetWallTimeMSec();
+// get monotonic time since boot in [ms]
+uint64_t GetMonoTimeMSec();
+
+// CRC-32 (IEEE 802.3), crc of previous block continues the checksum
+uint32_t Crc32(const void *pData, size_t len, uint32_t crc = 0);
 
 #endif // COMMON_H
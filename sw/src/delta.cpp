@@ -0,0 +1,288 @@
+#include "common.h"
+#include "logger.h"
+#include <algorithm>
+
+#include <opencv2/imgproc.hpp>
+#include <opencv2/highgui.hpp>
+
+#include "framesource.h"
+#include "imgproc.h"
+#include "delta.h"
+
+CDeltaEncoder::CDeltaEncoder() :
+    m_tileSize(DELTA_DEF_TILE),
+    m_keyInterval(DELTA_DEF_KEY_INTERVAL),
+    m_pixelDiff(DELTA_DEF_PIXEL_DIFF),
+    m_seq(0),
+    m_sinceKey(0),
+    m_forceKey(false),
+    m_key(false),
+    m_changed(0),
+    m_tiles(0),
+    m_refSeq(0) {
+    pthread_mutex_init(&m_lock, NULL);
+}
+
+CDeltaEncoder::~CDeltaEncoder() {
+    pthread_mutex_destroy(&m_lock);
+}
+
+void CDeltaEncoder::SetParams(unsigned tileSize, unsigned keyInterval, unsigned pixelDiff) {
+    // keep tiles aligned to 16x16 MCU
+    m_tileSize = std::max(16u, (tileSize + 15) & ~15u);
+    m_keyInterval = keyInterval;
+    m_pixelDiff = pixelDiff;
+    ForceKey();
+}
+
+void CDeltaEncoder::ForceKey() {
+    pthread_mutex_lock(&m_lock);
+    m_forceKey = true;
+    pthread_mutex_unlock(&m_lock);
+}
+
+void CDeltaEncoder::Ack(unsigned seq) {
+    pthread_mutex_lock(&m_lock);
+
+    // any pending packet newer than the base, late ack of older one is ignored
+    std::map<unsigned, SDeltaFrame>::iterator it = m_pending.find(seq);
+    if (seq && (seq > m_refSeq) && (it != m_pending.end())) {
+        std::swap(m_ref, it->second);
+        m_refSeq = seq;
+        // older packets can not become base anymore
+        m_pending.erase(m_pending.begin(), ++it);
+    }
+
+    pthread_mutex_unlock(&m_lock);
+}
+
+cv::Rect CDeltaEncoder::GetTile(const cv::Mat &frame, int idx, int tilesX) {
+    int x = (idx % tilesX) * m_tileSize;
+    int y = (idx / tilesX) * m_tileSize;
+
+    // tiles on the right and bottom edge can be smaller
+    return cv::Rect(x, y, std::min((int)m_tileSize, frame.cols - x), std::min((int)m_tileSize, frame.rows - y));
+}
+
+bool CDeltaEncoder::Encode(const cv::Mat &frame, PixelFormat format, uint64_t timeMs, std::vector<unsigned char> &packet) {
+    const cv::Mat *pFrame = &frame;
+
+    if (!CheckFrame(frame, format)) {
+        LOG_ERROR("delta encoder needs BGR or YUV420 frame!");
+        return false;
+    }
+
+    // tiles are compared on luma and sent in BGR
+    if (format == PF_I420) {
+        cv::cvtColor(frame, m_bgr, cv::COLOR_YUV2BGR_I420);
+        pFrame = &m_bgr;
+    }
+    cv::cvtColor(*pFrame, m_luma, cv::COLOR_BGR2GRAY);
+
+    int tilesX = (pFrame->cols + m_tileSize - 1) / m_tileSize;
+    m_tiles = tilesX * ((pFrame->rows + m_tileSize - 1) / m_tileSize);
+
+    pthread_mutex_lock(&m_lock);
+
+    // decoder may not have the base anymore when acks are lost too long
+    m_key = m_forceKey || !m_refSeq || (m_ref.image.size() != pFrame->size()) ||
+            (m_keyInterval && (m_sinceKey >= m_keyInterval)) || (m_seq - m_refSeq >= DELTA_DECODER_HISTORY);
+
+    if (!m_key) {
+        unsigned limit;
+        m_map.assign((m_tiles + 7) / 8, 0);
+        m_changed = 0;
+
+        // mark tiles with mean difference over threshold
+        for (unsigned i = 0; i < m_tiles; i++) {
+            cv::Rect tile = GetTile(*pFrame, i, tilesX);
+            limit = m_pixelDiff * tile.area();
+            if (BlockSAD(m_luma.ptr<unsigned char>(tile.y) + tile.x, m_ref.luma.ptr<unsigned char>(tile.y) + tile.x,
+                    m_luma.step, tile.width, tile.height) > limit) {
+                m_map[i / 8] |= 1 << (i % 8);
+                m_changed++;
+            }
+        }
+
+        // too many tiles, whole frame is cheaper
+        if (m_changed * 100 > m_tiles * DELTA_KEY_RATIO) m_key = true;
+    }
+
+    // the oldest unacknowledged frame gives its buffers to the new one
+    SDeltaFrame pending;
+    if (m_pending.size() >= DELTA_MAX_PENDING) {
+        std::swap(pending, m_pending.begin()->second);
+        m_pending.erase(m_pending.begin());
+    }
+
+    bool ok = m_key ? EncodeKey(*pFrame, pending) : EncodeDelta(*pFrame, tilesX, pending);
+    if (!ok) {
+        pthread_mutex_unlock(&m_lock);
+        return false;
+    }
+
+    SDeltaHeader header;
+    memset(&header, 0, sizeof(header));
+    header.magic = DELTA_MAGIC;
+    header.version = DELTA_VERSION;
+    header.type = m_key ? DPT_KEY : DPT_DELTA;
+    header.tileSize = m_tileSize;
+    header.timeMs = timeMs;
+    header.seq = ++m_seq;
+    header.baseSeq = m_key ? 0 : m_refSeq;
+    header.width = pFrame->cols;
+    header.height = pFrame->rows;
+    header.mapSize = m_map.size();
+    header.payloadSize = m_payload.size();
+
+    // header, tile map and payload in one buffer
+    packet.resize(sizeof(header) + m_map.size() + m_payload.size());
+    memcpy(&packet[0], &header, sizeof(header));
+    if (!m_map.empty()) memcpy(&packet[sizeof(header)], &m_map[0], m_map.size());
+    memcpy(&packet[sizeof(header) + m_map.size()], &m_payload[0], m_payload.size());
+
+    // receiver gets this frame when the packet is acknowledged
+    std::swap(m_pending[m_seq], pending);
+    if (m_key) {
+        m_forceKey = false;
+        m_sinceKey = 0;
+    } else m_sinceKey++;
+
+    pthread_mutex_unlock(&m_lock);
+
+    LOG_DEBUG("uplink packet %u: %s, %u/%u tiles, %u bytes", m_seq,
+            m_key ? "keyframe" : "delta", m_changed, m_tiles, (unsigned)packet.size());
+    return true;
+}
+
+bool CDeltaEncoder::EncodeKey(const cv::Mat &frame, SDeltaFrame &pending) {
+    m_map.clear();
+    m_changed = m_tiles;
+
+    if (!m_encoder.Encode(frame, m_payload)) return false;
+
+    frame.copyTo(pending.image);
+    m_luma.copyTo(pending.luma);
+    return true;
+}
+
+bool CDeltaEncoder::EncodeDelta(const cv::Mat &frame, int tilesX, SDeltaFrame &pending) {
+    // mosaic has rows of tilesX tiles, buffer is reused
+    int rows = std::max(1, (int)(m_changed + tilesX - 1) / tilesX);
+    m_mosaic.create(rows * m_tileSize, tilesX * m_tileSize, CV_8UC3);
+
+    // receiver gets base frame with changed tiles
+    m_ref.image.copyTo(pending.image);
+    m_ref.luma.copyTo(pending.luma);
+
+    unsigned n = 0;
+    for (unsigned i = 0; i < m_tiles; i++) {
+        if (!(m_map[i / 8] & (1 << (i % 8)))) continue;
+
+        cv::Rect tile = GetTile(frame, i, tilesX);
+        cv::Mat cell = m_mosaic(cv::Rect((n % tilesX) * m_tileSize, (n / tilesX) * m_tileSize, tile.width, tile.height));
+        frame(tile).copyTo(cell);
+
+        cv::Mat pendingImage = pending.image(tile);
+        frame(tile).copyTo(pendingImage);
+        cv::Mat pendingLuma = pending.luma(tile);
+        m_luma(tile).copyTo(pendingLuma);
+        n++;
+    }
+
+    // nothing has changed, mosaic has one empty row
+    if (!n) m_mosaic.setTo(cv::Scalar::all(0));
+
+    return m_encoder.Encode(m_mosaic, m_payload);
+}
+
+void CDeltaDecoder::Reset() {
+    m_frames.clear();
+    m_lastBase = 0;
+}
+
+size_t CDeltaDecoder::Decode(const unsigned char *pData, size_t len, cv::Mat &image, SDeltaHeader &header) {
+    // check header
+    if (len < sizeof(header)) {
+        LOG_ERROR("delta packet is truncated!");
+        return 0;
+    }
+    memcpy(&header, pData, sizeof(header));
+
+    if ((header.magic != DELTA_MAGIC) || (header.version != DELTA_VERSION) || (header.type >= DPT_COUNT) ||
+            !header.tileSize || !header.width || !header.height) {
+        LOG_ERROR("delta packet is not valid!");
+        return 0;
+    }
+
+    size_t total = sizeof(header) + header.mapSize + header.payloadSize;
+    int tilesX = (header.width + header.tileSize - 1) / header.tileSize;
+    int tilesY = (header.height + header.tileSize - 1) / header.tileSize;
+    unsigned tiles = tilesX * tilesY;
+
+    if ((total > len) || ((header.type == DPT_DELTA) && (header.mapSize < (tiles + 7) / 8))) {
+        LOG_ERROR("delta packet %u is truncated!", header.seq);
+        return 0;
+    }
+
+    const unsigned char *pMap = pData + sizeof(header);
+    cv::Mat payload = cv::imdecode(cv::Mat(1, header.payloadSize, CV_8UC1, (void*)(pMap + header.mapSize)),
+            cv::IMREAD_COLOR);
+    if (payload.empty()) {
+        LOG_ERROR("can not decode payload of packet %u!", header.seq);
+        return 0;
+    }
+
+    if (header.type == DPT_KEY) {
+        if ((payload.cols != header.width) || (payload.rows != header.height)) {
+            LOG_ERROR("keyframe %u has wrong size!", header.seq);
+            return 0;
+        }
+
+        // older frames can not be referenced anymore
+        m_frames.clear();
+        m_lastBase = 0;
+        image = payload;
+    } else {
+        std::map<unsigned, cv::Mat>::iterator base = m_frames.find(header.baseSeq);
+        if (base == m_frames.end()) {
+            LOG_ERROR("base frame %u of packet %u is missing!", header.baseSeq,
+                    header.seq);
+            return 0;
+        }
+        image = base->second.clone();
+        m_lastBase = header.baseSeq;
+
+        // copy tiles from mosaic in map order
+        unsigned n = 0;
+        for (unsigned i = 0; i < tiles; i++) {
+            if (!(pMap[i / 8] & (1 << (i % 8)))) continue;
+
+            int x = (i % tilesX) * header.tileSize;
+            int y = (i / tilesX) * header.tileSize;
+            cv::Rect tile(x, y, std::min((int)header.tileSize, image.cols - x),
+                    std::min((int)header.tileSize, image.rows - y));
+            cv::Rect cell((n % tilesX) * header.tileSize, (n / tilesX) * header.tileSize, tile.width, tile.height);
+            n++;
+
+            if ((cell.y + cell.height > payload.rows) || (cell.x + cell.width > payload.cols)) {
+                LOG_ERROR("mosaic of packet %u is too small!", header.seq);
+                return 0;
+            }
+
+            cv::Mat dst = image(tile);
+            payload(cell).copyTo(dst);
+        }
+    }
+
+    // keep limited history for deltas based on older frames, the oldest one goes first
+    // unless it is the base in use, encoder keeps it until a newer frame is acknowledged
+    m_frames[header.seq] = image;
+    while (m_frames.size() > DELTA_DECODER_HISTORY) {
+        std::map<unsigned, cv::Mat>::iterator oldest = m_frames.begin();
+        if (oldest->first == m_lastBase) ++oldest;
+        m_frames.erase(oldest);
+    }
+
+    return total;
+}
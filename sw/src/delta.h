@@ -0,0 +1,126 @@
+#ifndef DELTA_H_
+#define DELTA_H_
+
+#include <pthread.h>
+#include <stdint.h>
+#include <map>
+#include <vector>
+#include <opencv2/core.hpp>
+
+#include "framesource.h"
+#include "jpegenc.h"
+
+// packet header tag, "CDLT"
+#define DELTA_MAGIC 0x544c4443
+#define DELTA_VERSION 1
+// tile size in pixels, multiple of JPEG MCU so tiles do not bleed into each other
+#define DELTA_DEF_TILE 32
+// full frame after given count of deltas
+#define DELTA_DEF_KEY_INTERVAL 30
+// default mean absolute luma difference of changed tile
+#define DELTA_DEF_PIXEL_DIFF 6
+// changed tiles [%] when keyframe is cheaper than delta
+#define DELTA_KEY_RATIO 60
+// reconstructed frames kept by decoder as possible bases, encoder sends keyframe when its base is older
+#define DELTA_DECODER_HISTORY 16
+// sent frames kept by encoder until acknowledged, acks may come late or out of order
+#define DELTA_MAX_PENDING 8
+
+typedef enum DeltaPacketType {
+    DPT_KEY = 0,    // whole frame
+    DPT_DELTA,      // changed tiles against base frame
+    DPT_COUNT
+} DeltaPacketType;
+
+// packet = header, tile map (1 bit per tile, row by row), JPEG payload
+// payload of delta is a mosaic of changed tiles in map order, tilesX tiles per row
+struct SDeltaHeader {
+    uint32_t magic;
+    uint8_t version;
+    uint8_t type;           // DeltaPacketType
+    uint16_t tileSize;
+    uint64_t timeMs;        // wall clock capture time [ms]
+    uint32_t seq;           // packet sequence number, starts with 1
+    uint32_t baseSeq;       // frame the delta applies to, 0 for keyframe
+    uint16_t width;
+    uint16_t height;
+    uint32_t mapSize;
+    uint32_t payloadSize;
+    uint32_t reserved;
+};
+
+// frame as the receiver rebuilds it, with luma for comparison
+struct SDeltaFrame {
+    cv::Mat image;
+    cv::Mat luma;
+};
+
+// tile delta encoder for uplink, deltas are based on the last acknowledged frame
+class CDeltaEncoder {
+public:
+    CDeltaEncoder();
+    ~CDeltaEncoder();
+
+    void SetParams(unsigned tileSize, unsigned keyInterval, unsigned pixelDiff);
+    inline void SetJpegParams(const SJpegParams &params) { m_encoder.SetParams(params); }
+
+    // BGR or I420 frame into keyframe or delta packet
+    bool Encode(const cv::Mat &frame, PixelFormat format, uint64_t timeMs, std::vector<unsigned char> &packet);
+    // receiver has got the packet, it becomes the base of next deltas,
+    // any packet newer than the current base is accepted, older pending packets are dropped
+    void Ack(unsigned seq);
+    // the next packet is a keyframe
+    void ForceKey();
+
+    inline unsigned GetSeq() { return m_seq; }
+    inline bool WasKey() { return m_key; }
+    inline unsigned GetChangedTiles() { return m_changed; }
+    inline unsigned GetTileCount() { return m_tiles; }
+
+private:
+    bool EncodeKey(const cv::Mat &frame, SDeltaFrame &pending);
+    bool EncodeDelta(const cv::Mat &frame, int tilesX, SDeltaFrame &pending);
+    cv::Rect GetTile(const cv::Mat &frame, int idx, int tilesX);
+
+private:
+    unsigned m_tileSize;
+    unsigned m_keyInterval;
+    unsigned m_pixelDiff;
+    unsigned m_seq;
+    unsigned m_sinceKey;
+    bool m_forceKey;
+    bool m_key;
+    unsigned m_changed;
+    unsigned m_tiles;
+    // frame as the receiver has it
+    SDeltaFrame m_ref;
+    unsigned m_refSeq;      // 0 = receiver has no frame
+    // frames the receiver gets from not yet acknowledged packets
+    std::map<unsigned, SDeltaFrame> m_pending;
+    // reused buffers
+    cv::Mat m_bgr;
+    cv::Mat m_luma;
+    cv::Mat m_mosaic;
+    std::vector<unsigned char> m_map;
+    std::vector<unsigned char> m_payload;
+    CJpegEncoder m_encoder;
+    pthread_mutex_t m_lock;
+};
+
+// rebuilds frames from keyframes and deltas
+class CDeltaDecoder {
+public:
+    CDeltaDecoder() : m_lastBase(0) {}
+
+    // decode one packet, returns its size or 0 on error, image is shared with history
+    size_t Decode(const unsigned char *pData, size_t len, cv::Mat &image, SDeltaHeader &header);
+    void Reset();
+
+private:
+    // reconstructed frames since the last keyframe
+    std::map<unsigned, cv::Mat> m_frames;
+    // base of the last delta, kept while acks are lost
+    unsigned m_lastBase;
+};
+
+#endif // DELTA_H_
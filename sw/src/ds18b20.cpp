@@ -27,7 +27,7 @@ bool CDS18B20::Init() {
 
 	// check directory for 1-wire devices exist
 	if ((dir = opendir(m_devPath.c_str())) == NULL) {
-		CLogger::GetLogger()->LogPrintf(LL_ERROR, "directory %s for one-wire is missing!", m_devPath.c_str());
+		LOG_ERROR("directory %s for one-wire is missing!", m_devPath.c_str());
 		return false;
 	}
 
@@ -49,7 +49,7 @@ bool CDS18B20::Init() {
 	// make some reading for all devices
 	for (std::vector<std::string>::size_type i = 0; i < m_devices.size(); i++) {
 		if (GetTemp(i) == -1) {
-			CLogger::GetLogger()->LogPrintf(LL_ERROR, "can not get temperature from device %s!",
+			LOG_ERROR("can not get temperature from device %s!",
 					m_devices.at(i).c_str());
 			ret = false;
 			break;
@@ -63,7 +63,7 @@ bool CDS18B20::Init() {
 
 	// check device count
 	if (!m_devCount) {
-		CLogger::GetLogger()->LogPrintf(LL_WARNING, "no DS18B20 devices has been found!");
+		LOG_WARNING("no DS18B20 devices has been found!");
 		ret = false;
 	}
 
@@ -73,12 +73,12 @@ bool CDS18B20::Init() {
 float CDS18B20::GetTemp(unsigned char idx) {
 	// check index range
 	if (idx > m_devCount) {
-		CLogger::GetLogger()->LogPrintf(LL_ERROR, "index %i is out of range!", idx);
+		LOG_ERROR("index %i is out of range!", idx);
 		return -1;
 	}
 
 	if (m_devCount == 0) {
-		CLogger::GetLogger()->LogPrintf(LL_ERROR, "no DS18B20 devices has been found!", idx);
+		LOG_ERROR("no DS18B20 devices has been found!", idx);
 		return -1;
 	}
 
@@ -88,7 +88,7 @@ float CDS18B20::GetTemp(unsigned char idx) {
 
 	// open file for reading
 	if (!devFile.is_open()) {
-		CLogger::GetLogger()->LogPrintf(LL_ERROR, "can not open file %s for reading!", m_devPath.c_str());
+		LOG_ERROR("can not open file %s for reading!", m_devPath.c_str());
 		return -1;
 	}
 
@@ -98,7 +98,7 @@ float CDS18B20::GetTemp(unsigned char idx) {
 		    // check if crc has not bee verified
 		    if (!crc) {
 			    if (line.substr(line.size() - 3).compare("YES")) {
-				    CLogger::GetLogger()->LogPrintf(LL_ERROR, "CRC \"%s\" is not correct!", line.c_str());
+				    LOG_ERROR("CRC \"%s\" is not correct!", line.c_str());
 				    break;
 			    } else {
 				    // CRC is OK
@@ -112,21 +112,21 @@ float CDS18B20::GetTemp(unsigned char idx) {
 		    line = line.substr(line.find("t="));
 		    // check size
 		    if (!line.size()) {
-			    CLogger::GetLogger()->LogPrintf(LL_ERROR, "temperature %s is missing!", line.c_str());
+			    LOG_ERROR("temperature %s is missing!", line.c_str());
 		    }
 
 		    // remove t= prefix
 		    line = line.erase(0,2);
 	    }
 	} catch (std::exception &ex) {
-	    CLogger::GetLogger()->LogPrintf(LL_ERROR, "GetTemp() %s", ex.what());
+	    LOG_ERROR("GetTemp() %s", ex.what());
 	    crc = false;
 	}
 
 	// close file
 	devFile.close();
 
-	CLogger::GetLogger()->LogPrintf(LL_DEBUG, "dev: %i temp:%s", idx, line.c_str());
+	LOG_DEBUG("dev: %i temp:%s", idx, line.c_str());
 
 	// convert output to float
 	return (!crc ? -1 : (atof(line.c_str()) / 1000.0));
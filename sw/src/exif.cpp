@@ -0,0 +1,180 @@
+#include "common.h"
+#include <math.h>
+#include <time.h>
+
+#include "exif.h"
+
+// TIFF field types
+#define TIFF_ASCII 2
+#define TIFF_LONG 4
+#define TIFF_UNDEFINED 7
+#define TIFF_SRATIONAL 10
+
+// used tags, every IFD is sorted by tag
+#define TAG_SOFTWARE 0x0131
+#define TAG_DATETIME 0x0132
+#define TAG_EXIF_IFD 0x8769
+#define TAG_EXIF_VERSION 0x9000
+#define TAG_DATETIME_ORIGINAL 0x9003
+#define TAG_OFFSET_TIME_ORIGINAL 0x9011
+#define TAG_USER_COMMENT 0x9286
+#define TAG_SUBSEC_TIME_ORIGINAL 0x9291
+#define TAG_TEMPERATURE 0x9400
+#define TAG_BODY_SERIAL 0xa431
+
+struct SExifEntry {
+    uint16_t tag;
+    uint16_t type;
+    uint32_t count;
+    std::vector<unsigned char> value;
+};
+
+static void Put16(std::vector<unsigned char> &out, uint16_t v) {
+    out.push_back(v & 0xff);
+    out.push_back(v >> 8);
+}
+
+static void Put32(std::vector<unsigned char> &out, uint32_t v) {
+    Put16(out, v & 0xffff);
+    Put16(out, v >> 16);
+}
+
+static void AddAscii(std::vector<SExifEntry> &ifd, uint16_t tag, const std::string &text) {
+    SExifEntry entry;
+    entry.tag = tag;
+    entry.type = TIFF_ASCII;
+    entry.value.assign(text.begin(), text.end());
+    entry.value.push_back('\0');
+    entry.count = entry.value.size();
+    ifd.push_back(entry);
+}
+
+// size of IFD with its values stored behind it
+static size_t IfdSize(const std::vector<SExifEntry> &ifd) {
+    size_t size = 2 + ifd.size() * 12 + 4;
+    for (size_t i = 0; i < ifd.size(); i++) {
+        if (ifd[i].value.size() > 4) size += (ifd[i].value.size() + 1) & ~1;
+    }
+    return size;
+}
+
+// offsets are relative to TIFF header
+static void WriteIfd(std::vector<unsigned char> &tiff, const std::vector<SExifEntry> &ifd) {
+    size_t start = tiff.size();
+    uint32_t data = start + 2 + ifd.size() * 12 + 4;
+
+    Put16(tiff, ifd.size());
+    for (size_t i = 0; i < ifd.size(); i++) {
+        const SExifEntry &entry = ifd[i];
+        Put16(tiff, entry.tag);
+        Put16(tiff, entry.type);
+        Put32(tiff, entry.count);
+
+        // short values are stored in the entry itself
+        if (entry.value.size() <= 4) {
+            for (size_t k = 0; k < 4; k++) tiff.push_back((k < entry.value.size()) ? entry.value[k] : 0);
+        } else {
+            Put32(tiff, data);
+            data += (entry.value.size() + 1) & ~1;
+        }
+    }
+    // no next IFD
+    Put32(tiff, 0);
+
+    for (size_t i = 0; i < ifd.size(); i++) {
+        if (ifd[i].value.size() <= 4) continue;
+        tiff.insert(tiff.end(), ifd[i].value.begin(), ifd[i].value.end());
+        if (ifd[i].value.size() & 1) tiff.push_back(0);
+    }
+}
+
+bool BuildExif(const SExifInfo &info, std::vector<unsigned char> &app1) {
+    std::vector<SExifEntry> ifd0, exifIfd;
+    char text[64];
+    struct tm tmAct;
+    time_t t = info.wallMs / 1000;
+
+    localtime_r(&t, &tmAct);
+    strftime(text, sizeof(text), "%Y:%m:%d %H:%M:%S", &tmAct);
+    std::string dateTime = text;
+
+    AddAscii(ifd0, TAG_SOFTWARE, EXIF_SOFTWARE);
+    AddAscii(ifd0, TAG_DATETIME, dateTime);
+
+    // pointer to Exif IFD is filled in below
+    SExifEntry pointer;
+    pointer.tag = TAG_EXIF_IFD;
+    pointer.type = TIFF_LONG;
+    pointer.count = 1;
+    pointer.value.resize(4, 0);
+    ifd0.push_back(pointer);
+
+    // mandatory, Exif 2.31 is needed for OffsetTimeOriginal
+    SExifEntry version;
+    version.tag = TAG_EXIF_VERSION;
+    version.type = TIFF_UNDEFINED;
+    version.value.assign((const unsigned char*)"0231", (const unsigned char*)"0231" + 4);
+    version.count = version.value.size();
+    exifIfd.push_back(version);
+
+    AddAscii(exifIfd, TAG_DATETIME_ORIGINAL, dateTime);
+
+    // local time offset as "+HH:MM"
+    long offset = tmAct.tm_gmtoff / 60;
+    snprintf(text, sizeof(text), "%c%02ld:%02ld", (offset < 0) ? '-' : '+', labs(offset) / 60, labs(offset) % 60);
+    AddAscii(exifIfd, TAG_OFFSET_TIME_ORIGINAL, text);
+
+    // all values for downstream indexing, 8 byte character code first
+    std::string comment = "mono_ms=" + ToString(info.monoMs) + ";wall_ms=" + ToString(info.wallMs) + ";temp=";
+    for (unsigned i = 0; (i < info.sensorCount) && (i < EXIF_MAX_SENSORS); i++) {
+        snprintf(text, sizeof(text), "%s%.2f", i ? "," : "", info.sensors[i]);
+        comment += text;
+    }
+    if (info.sharpness >= 0) {
+        snprintf(text, sizeof(text), ";sharpness=%.1f;luma=%.0f", info.sharpness, info.luma);
+        comment += text;
+    }
+    comment += ";camera=" + info.cameraId + ";imei=" + info.imei;
+
+    SExifEntry userComment;
+    userComment.tag = TAG_USER_COMMENT;
+    userComment.type = TIFF_UNDEFINED;
+    userComment.value.assign((const unsigned char*)"ASCII\0\0\0", (const unsigned char*)"ASCII\0\0\0" + 8);
+    userComment.value.insert(userComment.value.end(), comment.begin(), comment.end());
+    userComment.count = userComment.value.size();
+    exifIfd.push_back(userComment);
+
+    snprintf(text, sizeof(text), "%03u", (unsigned)(info.wallMs % 1000));
+    AddAscii(exifIfd, TAG_SUBSEC_TIME_ORIGINAL, text);
+
+    // ambient temperature in 1/100 deg C
+    if (info.sensorCount && !isnan(info.sensors[0])) {
+        SExifEntry temp;
+        temp.tag = TAG_TEMPERATURE;
+        temp.type = TIFF_SRATIONAL;
+        temp.count = 1;
+        Put32(temp.value, (uint32_t)(int32_t)lrintf(info.sensors[0] * 100));
+        Put32(temp.value, 100);
+        exifIfd.push_back(temp);
+    }
+
+    if (!info.cameraId.empty()) AddAscii(exifIfd, TAG_BODY_SERIAL, info.cameraId);
+
+    // Exif IFD follows IFD0
+    uint32_t exifOffset = 8 + IfdSize(ifd0);
+    ifd0.back().value.clear();
+    Put32(ifd0.back().value, exifOffset);
+
+    // "Exif\0\0", TIFF header, IFD0 and Exif IFD
+    static const unsigned char c_header[] = { 'E', 'x', 'i', 'f', 0, 0, 'I', 'I', 0x2a, 0, 8, 0, 0, 0 };
+    std::vector<unsigned char> tiff(c_header + 6, c_header + sizeof(c_header));
+    WriteIfd(tiff, ifd0);
+    WriteIfd(tiff, exifIfd);
+
+    // APP1 length is 16-bit including itself
+    if (tiff.size() + 6 + 2 > 0xffff) return false;
+
+    app1.assign(c_header, c_header + 6);
+    app1.insert(app1.end(), tiff.begin(), tiff.end());
+    return true;
+}
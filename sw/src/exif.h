@@ -0,0 +1,30 @@
+#ifndef EXIF_H_
+#define EXIF_H_
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+// max count of sensor readings in user comment
+#define EXIF_MAX_SENSORS 8
+// software tag value
+#define EXIF_SOFTWARE "cam-system"
+
+// what is written into APP1 of one picture
+struct SExifInfo {
+    uint64_t wallMs;        // wall clock capture time [ms]
+    uint64_t monoMs;        // monotonic capture time since boot [ms]
+    float sensors[EXIF_MAX_SENSORS];    // DS18B20 temperatures [deg C]
+    unsigned sensorCount;
+    float sharpness;        // quality scores, < 0 if not measured
+    float luma;
+    std::string cameraId;
+    std::string imei;
+};
+
+// EXIF APP1 payload (without marker and length), little endian TIFF
+// times go to DateTimeOriginal/SubSecTimeOriginal/OffsetTimeOriginal, the first reading to Temperature,
+// camera ID to BodySerialNumber, and all values to UserComment as "key=value;..." for parsers
+bool BuildExif(const SExifInfo &info, std::vector<unsigned char> &app1);
+
+#endif // EXIF_H_
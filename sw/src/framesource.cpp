@@ -0,0 +1,335 @@
+#include "common.h"
+#include "logger.h"
+
+#include <opencv2/imgproc.hpp>
+
+#ifdef HAVE_RASPICAM
+#include <raspicam/raspicam.h>
+#include <raspicam/raspicam_cv.h>
+#endif
+
+#include "picture.h"
+#include "framesource.h"
+
+// wait until the next frame is due according to frame rate
+static void WaitFrame(double &nextTime, double fps) {
+    if (fps <= 0) return;
+
+    double now = GetTimeSec();
+    double period = 1.0 / fps;
+
+    // first frame or too late, restart the schedule
+    if ((nextTime == 0) || (nextTime < now - period)) nextTime = now;
+    if (nextTime > now) usleep((useconds_t)((nextTime - now) * 1000000));
+
+    nextTime += period;
+}
+
+bool CheckFrame(const cv::Mat &frame, PixelFormat format) {
+    if (frame.empty() || (frame.type() != GetFrameType(format))) return false;
+
+    // planes of even picture size in one continuous buffer
+    if (format == PF_I420) return frame.isContinuous() && !(frame.cols & 1) && !(frame.rows % 3) && !((frame.rows / 3) & 1);
+    return format == PF_BGR;
+}
+
+void CreateFrame(cv::Mat &frame, int width, int height, PixelFormat format) {
+    frame.create((format == PF_I420) ? height * 3 / 2 : height, width, GetFrameType(format));
+}
+
+cv::Size GetFrameSize(const cv::Mat &frame, PixelFormat format) {
+    if (format == PF_I420) return cv::Size(frame.cols, frame.rows * 2 / 3);
+    return frame.size();
+}
+
+void GetLumaView(const cv::Mat &frame, PixelFormat format, cv::Mat &luma) {
+    // Y plane is the first part of I420 frame
+    if (format == PF_I420) {
+        luma = frame.rowRange(0, frame.rows * 2 / 3);
+        return;
+    }
+
+    cv::cvtColor(frame, luma, cv::COLOR_BGR2GRAY);
+}
+
+void ResizeI420(const cv::Mat &src, cv::Mat &dst, const cv::Size &size) {
+    cv::Size srcSize = GetFrameSize(src, PF_I420);
+    // chroma planes need even size
+    cv::Size dstSize(size.width & ~1, size.height & ~1);
+
+    CreateFrame(dst, dstSize.width, dstSize.height, PF_I420);
+
+    cv::Mat dstY = dst.rowRange(0, dstSize.height);
+    cv::resize(src.rowRange(0, srcSize.height), dstY, dstSize, 0, 0, cv::INTER_AREA);
+
+    // chroma planes are continuous blocks with half width rows
+    size_t srcPlane = srcSize.area() / 4;
+    size_t dstPlane = dstSize.area() / 4;
+    for (int i = 0; i < 2; i++) {
+        cv::Mat srcC(srcSize.height / 2, srcSize.width / 2, CV_8UC1, src.data + srcSize.area() + i * srcPlane);
+        cv::Mat dstC(dstSize.height / 2, dstSize.width / 2, CV_8UC1, dst.data + dstSize.area() + i * dstPlane);
+        cv::resize(srcC, dstC, dstC.size(), 0, 0, cv::INTER_AREA);
+    }
+}
+
+CFrameSource::CFrameSource() :
+    m_width(FRAME_WIDTH),
+    m_height(FRAME_HEIGHT),
+    m_format(PF_BGR) {
+}
+
+CFrameSource::~CFrameSource() {
+}
+
+bool CFrameSource::SetFormat(int width, int height, PixelFormat format) {
+    // check format, I420 planes need even size
+    if ((width <= 0) || (height <= 0) || (format >= PF_COUNT) || ((format == PF_I420) && ((width | height) & 1))) {
+        LOG_ERROR("frame format %ix%i/%i is not supported!", width, height, format);
+        return false;
+    }
+
+    m_width = width;
+    m_height = height;
+    m_format = format;
+    return true;
+}
+
+bool CFrameSource::SetCrop(const cv::Rect2f &roi) {
+    return (roi.x == 0) && (roi.y == 0) && (roi.width == 1) && (roi.height == 1);
+}
+
+#ifdef HAVE_RASPICAM
+
+CRaspiCamSource::CRaspiCamSource() {
+    m_pRaspiCam = new raspicam::RaspiCam_Cv;
+    m_pRaspiRaw = NULL;
+}
+
+CRaspiCamSource::~CRaspiCamSource() {
+    Release();
+    delete m_pRaspiCam;
+    m_pRaspiCam = NULL;
+    if (m_pRaspiRaw != NULL) delete m_pRaspiRaw;
+    m_pRaspiRaw = NULL;
+}
+
+bool CRaspiCamSource::SetFormat(int width, int height, PixelFormat format) {
+    if (!CFrameSource::SetFormat(width, height, format)) return false;
+
+    // native sensor format without colour conversion
+    if (format == PF_I420) {
+        if (m_pRaspiRaw == NULL) m_pRaspiRaw = new raspicam::RaspiCam;
+        m_pRaspiRaw->setFormat(raspicam::RASPICAM_FORMAT_YUV420);
+        m_pRaspiRaw->setCaptureSize(width, height);
+        return true;
+    }
+
+    //set camera parameters
+    m_pRaspiCam->set(CV_CAP_PROP_FORMAT, GetFrameType(format)); // color
+    m_pRaspiCam->set(CV_CAP_PROP_FRAME_WIDTH, width); // width
+    m_pRaspiCam->set(CV_CAP_PROP_FRAME_HEIGHT, height); // height
+
+    return true;
+}
+
+bool CRaspiCamSource::Open() {
+    if (m_format != PF_I420) return m_pRaspiCam->open();
+
+    if (!m_pRaspiRaw->open()) return false;
+
+    // camera pads planes to its own alignment, frame has to be packed
+    if (m_pRaspiRaw->getImageTypeSize(raspicam::RASPICAM_FORMAT_YUV420) != (size_t)m_width * m_height * 3 / 2) {
+        LOG_ERROR("camera can not deliver packed YUV420 %ix%i!", m_width, m_height);
+        m_pRaspiRaw->release();
+        return false;
+    }
+
+    return true;
+}
+
+void CRaspiCamSource::Release() {
+    if (m_pRaspiCam->isOpened()) m_pRaspiCam->release();
+    if ((m_pRaspiRaw != NULL) && m_pRaspiRaw->isOpened()) m_pRaspiRaw->release();
+}
+
+bool CRaspiCamSource::Grab() {
+    if (m_format == PF_I420) return m_pRaspiRaw->grab();
+    return m_pRaspiCam->grab();
+}
+
+bool CRaspiCamSource::Retrieve(cv::Mat &image) {
+    if (m_format == PF_I420) {
+        // copy planes straight into the frame buffer
+        CreateFrame(image, m_width, m_height, m_format);
+        m_pRaspiRaw->retrieve(image.data, raspicam::RASPICAM_FORMAT_IGNORE);
+        return true;
+    }
+
+    m_pRaspiCam->retrieve(image);
+    return !image.empty();
+}
+
+std::string CRaspiCamSource::GetId() {
+    if (m_format == PF_I420) return m_pRaspiRaw->getId();
+    return m_pRaspiCam->getId();
+}
+
+#endif // HAVE_RASPICAM
+
+CSyntheticSource::CSyntheticSource(double fps) :
+    m_roi(0, 0, 1, 1),
+    m_fps(fps),
+    m_nextTime(0),
+    m_seq(0),
+    m_opened(false) {
+}
+
+CSyntheticSource::~CSyntheticSource() {
+    Release();
+}
+
+bool CSyntheticSource::SetCrop(const cv::Rect2f &roi) {
+    // pattern is rendered only for the region
+    m_roi = roi;
+    return true;
+}
+
+bool CSyntheticSource::Open() {
+    m_seq = 0;
+    m_nextTime = 0;
+    m_opened = true;
+    return true;
+}
+
+void CSyntheticSource::Release() {
+    m_opened = false;
+}
+
+bool CSyntheticSource::Grab() {
+    if (!m_opened) return false;
+
+    WaitFrame(m_nextTime, m_fps);
+    m_seq++;
+    return true;
+}
+
+bool CSyntheticSource::Retrieve(cv::Mat &image) {
+    if (!m_opened || !m_seq) return false;
+
+    CreateFrame(image, m_width, m_height, m_format);
+
+    if (m_format == PF_I420) {
+        RenderI420(image);
+        return true;
+    }
+
+    // moving gradients with checkerboard and small noise, channels are RGB like raspicam
+    for (int py = 0; py < m_height; py++) {
+        unsigned char *pPx = image.ptr<unsigned char>(py);
+        int y = FieldY(py);
+        for (int px = 0; px < m_width; px++, pPx += 3) {
+            int x = FieldX(px);
+            unsigned noise = ((x * 73856093u) ^ (y * 19349663u) ^ (m_seq * 83492791u)) >> 28;
+            pPx[0] = (unsigned char)(x + 4 * m_seq + noise);
+            pPx[1] = (unsigned char)(y + 2 * m_seq + noise);
+            pPx[2] = (unsigned char)((((x >> 5) ^ (y >> 5)) & 1) * 128 + noise);
+        }
+    }
+
+    return true;
+}
+
+void CSyntheticSource::RenderI420(cv::Mat &image) {
+    unsigned char *pU = image.data + m_width * m_height;
+    unsigned char *pV = pU + m_width * m_height / 4;
+
+    // the same moving pattern in planar form
+    for (int py = 0; py < m_height; py++) {
+        unsigned char *pY = image.ptr<unsigned char>(py);
+        int y = FieldY(py);
+        for (int px = 0; px < m_width; px++) {
+            int x = FieldX(px);
+            unsigned noise = ((x * 73856093u) ^ (y * 19349663u) ^ (m_seq * 83492791u)) >> 28;
+            pY[px] = (unsigned char)(((x + 4 * m_seq) & 0xff) / 2 + ((y + 2 * m_seq) & 0xff) / 4 + noise);
+        }
+    }
+
+    for (int py = 0; py < m_height / 2; py++) {
+        int y = FieldY(2 * py) / 2;
+        for (int px = 0; px < m_width / 2; px++) {
+            int x = FieldX(2 * px) / 2;
+            *pU++ = (unsigned char)((((x >> 4) ^ (y >> 4)) & 1) * 64 + 96);
+            *pV++ = (unsigned char)((x + y + m_seq) & 0xff);
+        }
+    }
+}
+
+std::string CSyntheticSource::GetId() {
+    return "synthetic";
+}
+
+CReplaySource::CReplaySource(const std::string &fileName, double fps, bool loop) :
+    m_fileName(fileName),
+    m_pFile(NULL),
+    m_fps(fps),
+    m_nextTime(0),
+    m_loop(loop) {
+}
+
+CReplaySource::~CReplaySource() {
+    Release();
+    m_frame.release();
+}
+
+bool CReplaySource::Open() {
+    if (m_pFile != NULL) return true;
+
+    // open recorded frames
+    if ((m_pFile = fopen(m_fileName.c_str(), "rb")) == NULL) {
+        LOG_ERROR("can not open replay file %s!", m_fileName.c_str());
+        return false;
+    }
+
+    CreateFrame(m_frame, m_width, m_height, m_format);
+    m_nextTime = 0;
+    return true;
+}
+
+void CReplaySource::Release() {
+    if (m_pFile == NULL) return;
+
+    fclose(m_pFile);
+    m_pFile = NULL;
+}
+
+bool CReplaySource::Grab() {
+    if (m_pFile == NULL) return false;
+
+    WaitFrame(m_nextTime, m_fps);
+
+    size_t size = m_frame.total() * m_frame.elemSize();
+
+    // read the next frame, rewind at the end of file
+    if (fread(m_frame.data, size, 1, m_pFile) != 1) {
+        if (!m_loop) return false;
+
+        rewind(m_pFile);
+        if (fread(m_frame.data, size, 1, m_pFile) != 1) {
+            LOG_ERROR("replay file %s has no complete frame!", m_fileName.c_str());
+            return false;
+        }
+    }
+
+    return true;
+}
+
+bool CReplaySource::Retrieve(cv::Mat &image) {
+    if (m_pFile == NULL) return false;
+
+    m_frame.copyTo(image);
+    return true;
+}
+
+std::string CReplaySource::GetId() {
+    return "replay:" + m_fileName;
+}
@@ -0,0 +1,139 @@
+#ifndef FRAMESOURCE_H_
+#define FRAMESOURCE_H_
+
+#include <stdio.h>
+#include <string>
+#include <opencv2/core.hpp>
+
+// pixel format of frames, it travels with the frame because Mat type of I420
+// can not be told apart from greyscale image
+typedef enum PixelFormat {
+    PF_BGR = 0,     // packed 3 channels
+    PF_I420,        // planar YUV420
+    PF_COUNT
+} PixelFormat;
+
+// planar YUV420 frame is a single channel Mat like in OpenCV,
+// Y plane is followed by U and V planes, so it has height * 3 / 2 rows
+#define FRAME_TYPE_I420 CV_8UC1
+
+inline int GetFrameType(PixelFormat format) { return (format == PF_I420) ? FRAME_TYPE_I420 : CV_8UC3; }
+// buffer has type and shape of the format
+bool CheckFrame(const cv::Mat &frame, PixelFormat format);
+// allocate frame buffer for picture size and format
+void CreateFrame(cv::Mat &frame, int width, int height, PixelFormat format);
+// picture size of frame
+cv::Size GetFrameSize(const cv::Mat &frame, PixelFormat format);
+// luma plane of I420 frame without copying, packed frame is converted into luma
+void GetLumaView(const cv::Mat &frame, PixelFormat format, cv::Mat &luma);
+// area downscale of I420 frame plane by plane
+void ResizeI420(const cv::Mat &src, cv::Mat &dst, const cv::Size &size);
+
+// source of raw frames for CCamera
+class CFrameSource {
+public:
+    CFrameSource();
+    virtual ~CFrameSource();
+
+    virtual bool SetFormat(int width, int height, PixelFormat format);
+    // crop to region of field of view (normalised 0..1) before scaling to frame size,
+    // false if the source can not crop, the whole field of view is always supported
+    virtual bool SetCrop(const cv::Rect2f &roi);
+    virtual bool Open() = 0;
+    virtual void Release() = 0;
+
+    // grab the next frame, retrieve decodes the last grabbed one
+    virtual bool Grab() = 0;
+    virtual bool Retrieve(cv::Mat &image) = 0;
+
+    virtual std::string GetId() = 0;
+
+    inline int GetWidth() { return m_width; }
+    inline int GetHeight() { return m_height; }
+    inline PixelFormat GetFormat() { return m_format; }
+
+protected:
+    int m_width;
+    int m_height;
+    PixelFormat m_format;
+};
+
+#ifdef HAVE_RASPICAM
+
+namespace raspicam {
+    class RaspiCam;
+    class RaspiCam_Cv;
+}
+
+// raspberry pi camera module
+class CRaspiCamSource : public CFrameSource {
+public:
+    CRaspiCamSource();
+    ~CRaspiCamSource();
+
+    bool SetFormat(int width, int height, PixelFormat format);
+    bool Open();
+    void Release();
+    bool Grab();
+    bool Retrieve(cv::Mat &image);
+    std::string GetId();
+
+private:
+    raspicam::RaspiCam_Cv *m_pRaspiCam;
+    // RaspiCam_Cv delivers only RGB/gray, YUV420 needs the raw interface
+    raspicam::RaspiCam *m_pRaspiRaw;
+};
+
+#endif // HAVE_RASPICAM
+
+// deterministic moving test pattern paced to given frame rate
+class CSyntheticSource : public CFrameSource {
+public:
+    explicit CSyntheticSource(double fps = 0);
+    ~CSyntheticSource();
+
+    bool SetCrop(const cv::Rect2f &roi);
+    bool Open();
+    void Release();
+    bool Grab();
+    bool Retrieve(cv::Mat &image);
+    std::string GetId();
+
+    inline void SetFrameRate(double fps) { m_fps = fps; }
+
+private:
+    void RenderI420(cv::Mat &image);
+    // pattern coordinates of frame pixel, field of view has frame size
+    inline int FieldX(int x) { return (int)((m_roi.x + m_roi.width * x / m_width) * m_width); }
+    inline int FieldY(int y) { return (int)((m_roi.y + m_roi.height * y / m_height) * m_height); }
+
+private:
+    cv::Rect2f m_roi;
+    double m_fps;
+    double m_nextTime;
+    unsigned m_seq;
+    bool m_opened;
+};
+
+// replay of raw frames recorded to file (e.g. raspividyuv --rgb, or plain raspividyuv for I420)
+class CReplaySource : public CFrameSource {
+public:
+    explicit CReplaySource(const std::string &fileName, double fps = 0, bool loop = true);
+    ~CReplaySource();
+
+    bool Open();
+    void Release();
+    bool Grab();
+    bool Retrieve(cv::Mat &image);
+    std::string GetId();
+
+private:
+    std::string m_fileName;
+    FILE *m_pFile;
+    cv::Mat m_frame;
+    double m_fps;
+    double m_nextTime;
+    bool m_loop;
+};
+
+#endif // FRAMESOURCE_H_
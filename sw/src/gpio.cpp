@@ -12,7 +12,7 @@ CGpIOBase::~CGpIOBase() {
 
 bool CGpIOBase::RunCmd(const std::string &cmd) {
     if (cmd.empty()) {
-        CLogger::GetLogger()->LogPrintf(LL_ERROR, "command to run is missing!");
+        LOG_ERROR("command to run is missing!");
         return false;
     }
     // execute the command
@@ -23,7 +23,7 @@ bool CGpIOBase::RunCmd(const std::string &cmd) {
 bool CGpIOBase::WriteFile(const std::string &file, const char *data, int wait) {
     // check file and data
     if (file.empty() || data == NULL) {
-        CLogger::GetLogger()->LogPrintf(LL_ERROR, "file or data are NULL");
+        LOG_ERROR("file or data are NULL");
         return false;
     }
 
@@ -41,7 +41,7 @@ bool CGpIOBase::WriteFile(const std::string &file, const char *data, int wait) {
 
     // check if file has been successfully open
     if (fd < 0) {
-        CLogger::GetLogger()->LogPrintf(LL_ERROR, "Unable to open file + for writing!", file.c_str());
+        LOG_ERROR("Unable to open file + for writing!", file.c_str());
         return false;
     }
 
@@ -50,7 +50,7 @@ bool CGpIOBase::WriteFile(const std::string &file, const char *data, int wait) {
 
     // write data to file
     if ((ret = write(fd, data, len)) < 0) {
-        CLogger::GetLogger()->LogPrintf(LL_ERROR, "Unable write value to file %s!", file.c_str());
+        LOG_ERROR("Unable write value to file %s!", file.c_str());
         ret = -1;
     }
 
@@ -63,7 +63,7 @@ bool CGpIOBase::WriteFile(const std::string &file, const char *data, int wait) {
 std::string CGpIOBase::ReadFile(const std::string &file) {
     // check file and data
     if (file.empty()) {
-        CLogger::GetLogger()->LogPrintf(LL_ERROR, "file for reading is empty");
+        LOG_ERROR("file for reading is empty");
         return std::string();
     }
 
@@ -71,7 +71,7 @@ std::string CGpIOBase::ReadFile(const std::string &file) {
 
     // open file for reading
     if ((fd = open(file.c_str(), O_RDONLY, 0)) < 0) {
-        CLogger::GetLogger()->LogPrintf(LL_ERROR, "Unable to open file %s for reading!", file.c_str());
+        LOG_ERROR("Unable to open file %s for reading!", file.c_str());
         return std::string();
     }
 
@@ -80,7 +80,7 @@ std::string CGpIOBase::ReadFile(const std::string &file) {
 
     // read the file
     if ((cnt = read(fd, buf, arraysize(buf) - 1)) < 0) {
-        CLogger::GetLogger()->LogPrintf(LL_ERROR, "Unable to read data from file %s!", file.c_str());
+        LOG_ERROR("Unable to read data from file %s!", file.c_str());
         // empty string
         buf[0] = '\0';
     } else buf[cnt] = '\0';
@@ -95,7 +95,7 @@ CGpIOAny::CGpIOAny(unsigned int pin) :
     m_pin(pin) {
     // check ranges
     if (pin < GPIO_PIN_MIN || pin > GPIO_PIN_MAX) {
-        CLogger::GetLogger()->LogPrintf(LL_ERROR, "GPIO pin %i is out of range!", pin);
+        LOG_ERROR("GPIO pin %i is out of range!", pin);
         return;
     }
 
@@ -156,7 +156,7 @@ void CGpIOOutput::SetValue(const bool on) {
  CGPIO::CGPIO(unsigned char pin) {
  // check ranges
  if (pin < GPIO_PIN_MIN || pin > GPIO_PIN_MAX) {
- CLogger::GetLogger()->LogPrintf(LL_ERROR, "GPIO pin %i is out of range!", pin);
+ LOG_ERROR("GPIO pin %i is out of range!", pin);
  return;
  }
  // set GPIO pin
@@ -198,7 +198,7 @@ void CGpIOOutput::SetValue(const bool on) {
 
  // check if gpio file is open
  if (!gpioFile.is_open()) {
- CLogger::GetLogger()->LogPrintf(LL_ERROR, "Unable write value to GPIO pin %i!", m_pin);
+ LOG_ERROR("Unable write value to GPIO pin %i!", m_pin);
  ret = false;
  }
 
@@ -219,7 +219,7 @@ void CGpIOOutput::SetValue(const bool on) {
 
  // check if gpio file is open
  if (!gpioFile.is_open()) {
- CLogger::GetLogger()->LogPrintf(LL_ERROR, "Unable read value from GPIO pin %i!", m_pin);
+ LOG_ERROR("Unable read value from GPIO pin %i!", m_pin);
  ret = false;
  }
 
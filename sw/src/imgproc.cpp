@@ -0,0 +1,398 @@
+#include "common.h"
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define IMGPROC_NEON
+#elif (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#include <immintrin.h>
+#define IMGPROC_X86
+#endif
+
+#include "imgproc.h"
+
+void SwapRBScalar(unsigned char *pData, size_t pixels) {
+    unsigned char *pEnd = pData + pixels * 3;
+
+    for (; pData < pEnd; pData += 3) {
+        unsigned char c = pData[0];
+        pData[0] = pData[2];
+        pData[2] = c;
+    }
+}
+
+#if defined(IMGPROC_NEON)
+
+static void SwapRBNeon(unsigned char *pData, size_t pixels) {
+    size_t blocks = pixels / 16;
+
+    // de-interleave 16 pixels, swap planes and interleave them back
+    for (size_t i = 0; i < blocks; i++, pData += 48) {
+        uint8x16x3_t px = vld3q_u8(pData);
+        uint8x16_t tmp = px.val[0];
+        px.val[0] = px.val[2];
+        px.val[2] = tmp;
+        vst3q_u8(pData, px);
+    }
+
+    // finish the tail
+    SwapRBScalar(pData, pixels % 16);
+}
+
+#elif defined(IMGPROC_X86)
+
+// shuffle masks for one 48-byte block (16 pixels) split into three vectors,
+// mask Mkv selects bytes of input vector v into output vector k
+#define SWAP_MASKS \
+    const __m128i m00 = _mm_setr_epi8(2, 1, 0, 5, 4, 3, 8, 7, 6, 11, 10, 9, 14, 13, 12, -1); \
+    const __m128i m01 = _mm_setr_epi8(-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 1); \
+    const __m128i m10 = _mm_setr_epi8(-1, 15, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1); \
+    const __m128i m11 = _mm_setr_epi8(0, -1, 4, 3, 2, 7, 6, 5, 10, 9, 8, 13, 12, 11, -1, 15); \
+    const __m128i m12 = _mm_setr_epi8(-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 0, -1); \
+    const __m128i m21 = _mm_setr_epi8(14, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1); \
+    const __m128i m22 = _mm_setr_epi8(-1, 3, 2, 1, 6, 5, 4, 9, 8, 7, 12, 11, 10, 15, 14, 13)
+
+__attribute__((target("ssse3")))
+static void SwapRBSsse3(unsigned char *pData, size_t pixels) {
+    SWAP_MASKS;
+    size_t blocks = pixels / 16;
+
+    for (size_t i = 0; i < blocks; i++, pData += 48) {
+        __m128i a = _mm_loadu_si128((const __m128i *)pData);
+        __m128i b = _mm_loadu_si128((const __m128i *)(pData + 16));
+        __m128i c = _mm_loadu_si128((const __m128i *)(pData + 32));
+
+        __m128i oa = _mm_or_si128(_mm_shuffle_epi8(a, m00), _mm_shuffle_epi8(b, m01));
+        __m128i ob = _mm_or_si128(_mm_or_si128(_mm_shuffle_epi8(a, m10), _mm_shuffle_epi8(b, m11)),
+                _mm_shuffle_epi8(c, m12));
+        __m128i oc = _mm_or_si128(_mm_shuffle_epi8(b, m21), _mm_shuffle_epi8(c, m22));
+
+        _mm_storeu_si128((__m128i *)pData, oa);
+        _mm_storeu_si128((__m128i *)(pData + 16), ob);
+        _mm_storeu_si128((__m128i *)(pData + 32), oc);
+    }
+
+    // finish the tail
+    SwapRBScalar(pData, pixels % 16);
+}
+
+// load two 48-byte blocks into low and high lane
+#define LOAD2(p, off) _mm256_inserti128_si256(_mm256_castsi128_si256( \
+    _mm_loadu_si128((const __m128i *)((p) + (off)))), _mm_loadu_si128((const __m128i *)((p) + 48 + (off))), 1)
+// store low and high lane back to two 48-byte blocks
+#define STORE2(p, off, v) do { \
+    _mm_storeu_si128((__m128i *)((p) + (off)), _mm256_castsi256_si128(v)); \
+    _mm_storeu_si128((__m128i *)((p) + 48 + (off)), _mm256_extracti128_si256(v, 1)); } while (0)
+
+__attribute__((target("avx2")))
+static void SwapRBAvx2(unsigned char *pData, size_t pixels) {
+    SWAP_MASKS;
+    const __m256i w00 = _mm256_broadcastsi128_si256(m00);
+    const __m256i w01 = _mm256_broadcastsi128_si256(m01);
+    const __m256i w10 = _mm256_broadcastsi128_si256(m10);
+    const __m256i w11 = _mm256_broadcastsi128_si256(m11);
+    const __m256i w12 = _mm256_broadcastsi128_si256(m12);
+    const __m256i w21 = _mm256_broadcastsi128_si256(m21);
+    const __m256i w22 = _mm256_broadcastsi128_si256(m22);
+    size_t blocks = pixels / 32;
+
+    // vpshufb works per 128-bit lane, so each lane handles its own 48-byte block
+    for (size_t i = 0; i < blocks; i++, pData += 96) {
+        __m256i a = LOAD2(pData, 0);
+        __m256i b = LOAD2(pData, 16);
+        __m256i c = LOAD2(pData, 32);
+
+        __m256i oa = _mm256_or_si256(_mm256_shuffle_epi8(a, w00), _mm256_shuffle_epi8(b, w01));
+        __m256i ob = _mm256_or_si256(_mm256_or_si256(_mm256_shuffle_epi8(a, w10), _mm256_shuffle_epi8(b, w11)),
+                _mm256_shuffle_epi8(c, w12));
+        __m256i oc = _mm256_or_si256(_mm256_shuffle_epi8(b, w21), _mm256_shuffle_epi8(c, w22));
+
+        STORE2(pData, 0, oa);
+        STORE2(pData, 16, ob);
+        STORE2(pData, 32, oc);
+    }
+
+    // finish the tail
+    SwapRBSsse3(pData, pixels % 32);
+}
+
+typedef void (*SwapRBFunc)(unsigned char *, size_t);
+
+// select implementation according to CPU features
+static SwapRBFunc SelectSwapRB(const char **ppName) {
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        *ppName = "avx2";
+        return SwapRBAvx2;
+    }
+    if (__builtin_cpu_supports("ssse3")) {
+        *ppName = "ssse3";
+        return SwapRBSsse3;
+    }
+    *ppName = "scalar";
+    return SwapRBScalar;
+}
+
+static const char *c_pSwapRBName = NULL;
+static const SwapRBFunc c_pSwapRB = SelectSwapRB(&c_pSwapRBName);
+
+#endif
+
+void SwapRB(unsigned char *pData, size_t pixels) {
+#if defined(IMGPROC_NEON)
+    SwapRBNeon(pData, pixels);
+#elif defined(IMGPROC_X86)
+    c_pSwapRB(pData, pixels);
+#else
+    SwapRBScalar(pData, pixels);
+#endif
+}
+
+const char *SwapRBImplName() {
+#if defined(IMGPROC_NEON)
+    return "neon";
+#elif defined(IMGPROC_X86)
+    return c_pSwapRBName;
+#else
+    return "scalar";
+#endif
+}
+
+unsigned LumaGridMean(const unsigned char *pData, int width, int height, size_t stride, int gridStep,
+        int channels) {
+    unsigned long sum = 0;
+    unsigned long count = 0;
+
+    if (pData == NULL || gridStep <= 0) return 0;
+
+    for (int y = gridStep / 2; y < height; y += gridStep) {
+        const unsigned char *pRow = pData + y * stride;
+        for (int x = gridStep / 2; x < width; x += gridStep) {
+            const unsigned char *pPx = pRow + x * channels;
+            // (R + 2G + B) / 4 does not depend on channel order
+            sum += (channels == 1) ? pPx[0] : (pPx[0] + 2 * pPx[1] + pPx[2]) >> 2;
+            count++;
+        }
+    }
+
+    return count ? (unsigned)(sum / count) : 0;
+}
+
+void DownscaleLuma(const unsigned char *pSrc, int width, int height, size_t stride, int factor,
+        unsigned char *pDst, size_t dstStride, int channels) {
+    int dw = width / factor;
+    int dh = height / factor;
+    unsigned div = factor * factor * ((channels == 1) ? 1 : 4);
+
+    for (int y = 0; y < dh; y++) {
+        unsigned char *pOut = pDst + y * dstStride;
+        for (int x = 0; x < dw; x++) {
+            unsigned sum = 0;
+            for (int by = 0; by < factor; by++) {
+                const unsigned char *pPx = pSrc + (y * factor + by) * stride + x * factor * channels;
+                // plain luma box
+                if (channels == 1) {
+                    for (int bx = 0; bx < factor; bx++) sum += pPx[bx];
+                    continue;
+                }
+                // (R + 2G + B) over the box
+                for (int bx = 0; bx < factor; bx++, pPx += 3) sum += pPx[0] + 2 * pPx[1] + pPx[2];
+            }
+            pOut[x] = (unsigned char)(sum / div);
+        }
+    }
+}
+
+void SubsampleLuma(const unsigned char *pSrc, int width, int height, size_t stride, int step,
+        unsigned char *pDst, size_t dstStride, int channels) {
+    int dw = width / step;
+    int dh = height / step;
+    int pxStep = step * channels;
+
+    for (int y = 0; y < dh; y++) {
+        const unsigned char *pPx = pSrc + y * step * stride;
+        unsigned char *pOut = pDst + y * dstStride;
+        if (channels == 1) {
+            for (int x = 0; x < dw; x++, pPx += step) pOut[x] = *pPx;
+            continue;
+        }
+        // (R + 2G + B) / 4 does not depend on channel order
+        for (int x = 0; x < dw; x++, pPx += pxStep) pOut[x] = (pPx[0] + 2 * pPx[1] + pPx[2]) >> 2;
+    }
+}
+
+unsigned BlockSAD(const unsigned char *pA, const unsigned char *pB, size_t stride, int width, int height) {
+    unsigned sad = 0;
+
+    for (int y = 0; y < height; y++, pA += stride, pB += stride) {
+        int x = 0;
+#if defined(IMGPROC_NEON)
+        uint32x4_t acc = vdupq_n_u32(0);
+        for (; x + 16 <= width; x += 16) {
+            uint8x16_t a = vld1q_u8(pA + x);
+            uint8x16_t b = vld1q_u8(pB + x);
+            // |a - b| widened and accumulated pairwise
+            acc = vpadalq_u16(acc, vpaddlq_u8(vabdq_u8(a, b)));
+        }
+        uint64x2_t acc2 = vpaddlq_u32(acc);
+        sad += (unsigned)(vgetq_lane_u64(acc2, 0) + vgetq_lane_u64(acc2, 1));
+#elif defined(IMGPROC_X86) && defined(__SSE2__)
+        __m128i acc = _mm_setzero_si128();
+        for (; x + 16 <= width; x += 16) {
+            __m128i a = _mm_loadu_si128((const __m128i *)(pA + x));
+            __m128i b = _mm_loadu_si128((const __m128i *)(pB + x));
+            acc = _mm_add_epi64(acc, _mm_sad_epu8(a, b));
+        }
+        sad += (unsigned)(_mm_cvtsi128_si32(acc) + _mm_cvtsi128_si32(_mm_srli_si128(acc, 8)));
+#endif
+        // finish the tail
+        for (; x < width; x++) sad += abs((int)pA[x] - (int)pB[x]);
+    }
+
+    return sad;
+}
+
+void AccumulateU8(const unsigned char *pSrc, uint16_t *pAcc, int len) {
+    int i = 0;
+#if defined(IMGPROC_NEON)
+    for (; i + 16 <= len; i += 16) {
+        uint8x16_t src = vld1q_u8(pSrc + i);
+        vst1q_u16(pAcc + i, vaddw_u8(vld1q_u16(pAcc + i), vget_low_u8(src)));
+        vst1q_u16(pAcc + i + 8, vaddw_u8(vld1q_u16(pAcc + i + 8), vget_high_u8(src)));
+    }
+#elif defined(IMGPROC_X86) && defined(__SSE2__)
+    const __m128i zero = _mm_setzero_si128();
+    for (; i + 16 <= len; i += 16) {
+        __m128i src = _mm_loadu_si128((const __m128i *)(pSrc + i));
+        __m128i *pLo = (__m128i *)(pAcc + i);
+        __m128i *pHi = (__m128i *)(pAcc + i + 8);
+        _mm_storeu_si128(pLo, _mm_add_epi16(_mm_loadu_si128(pLo), _mm_unpacklo_epi8(src, zero)));
+        _mm_storeu_si128(pHi, _mm_add_epi16(_mm_loadu_si128(pHi), _mm_unpackhi_epi8(src, zero)));
+    }
+#endif
+    // finish the tail
+    for (; i < len; i++) pAcc[i] += pSrc[i];
+}
+
+void AverageU16(const uint16_t *pAcc, unsigned count, unsigned char *pDst, int len) {
+    int i = 0;
+
+    if (count <= 1) {
+        for (; i < len; i++) pDst[i] = (unsigned char)pAcc[i];
+        return;
+    }
+
+    // (sum + count / 2) / count by high half of multiplication with rounded up reciprocal,
+    // exact for up to 16 summed bytes
+    unsigned recip = (65536 + count - 1) / count;
+    unsigned half = count / 2;
+#if defined(IMGPROC_NEON)
+    uint16x8_t vHalf = vdupq_n_u16(half);
+    uint16x4_t vRecip = vdup_n_u16(recip);
+    for (; i + 8 <= len; i += 8) {
+        uint16x8_t sum = vaddq_u16(vld1q_u16(pAcc + i), vHalf);
+        uint32x4_t lo = vmull_u16(vget_low_u16(sum), vRecip);
+        uint32x4_t hi = vmull_u16(vget_high_u16(sum), vRecip);
+        uint16x8_t avg = vcombine_u16(vshrn_n_u32(lo, 16), vshrn_n_u32(hi, 16));
+        vst1_u8(pDst + i, vqmovn_u16(avg));
+    }
+#elif defined(IMGPROC_X86) && defined(__SSE2__)
+    const __m128i vHalf = _mm_set1_epi16((short)half);
+    const __m128i vRecip = _mm_set1_epi16((short)recip);
+    for (; i + 8 <= len; i += 8) {
+        __m128i sum = _mm_add_epi16(_mm_loadu_si128((const __m128i *)(pAcc + i)), vHalf);
+        __m128i avg = _mm_mulhi_epu16(sum, vRecip);
+        _mm_storel_epi64((__m128i *)(pDst + i), _mm_packus_epi16(avg, avg));
+    }
+#endif
+    // finish the tail
+    for (; i < len; i++) pDst[i] = (unsigned char)(((pAcc[i] + half) * recip) >> 16);
+}
+
+// scalar Laplacian of pixels [x, width - 1) in row y
+static inline void LaplacianRow(const unsigned char *pRow, size_t stride, int x, int width, int64_t &sum,
+        uint64_t &sumSq) {
+    const unsigned char *pUp = pRow - stride;
+    const unsigned char *pDown = pRow + stride;
+
+    for (; x < width - 1; x++) {
+        int lap = 4 * pRow[x] - pRow[x - 1] - pRow[x + 1] - pUp[x] - pDown[x];
+        sum += lap;
+        sumSq += lap * lap;
+    }
+}
+
+void LaplacianSums(const unsigned char *pSrc, int width, int height, size_t stride, int64_t &sum,
+        uint64_t &sumSq) {
+    sum = 0;
+    sumSq = 0;
+
+    for (int y = 1; y < height - 1; y++) {
+        const unsigned char *pRow = pSrc + y * stride;
+        int x = 1;
+#if defined(IMGPROC_NEON)
+        // |lap| <= 1020, squares are summed in 32 bits within one row
+        int32x4_t acc = vdupq_n_s32(0);
+        int32x4_t accSq = vdupq_n_s32(0);
+        for (; x + 8 < width; x += 8) {
+            int16x8_t c = vreinterpretq_s16_u16(vshll_n_u8(vld1_u8(pRow + x), 2));
+            uint16x8_t n = vaddl_u8(vld1_u8(pRow + x - 1), vld1_u8(pRow + x + 1));
+            n = vaddw_u8(n, vld1_u8(pRow + x - stride));
+            n = vaddw_u8(n, vld1_u8(pRow + x + stride));
+            int16x8_t lap = vsubq_s16(c, vreinterpretq_s16_u16(n));
+            acc = vpadalq_s16(acc, lap);
+            accSq = vmlal_s16(accSq, vget_low_s16(lap), vget_low_s16(lap));
+            accSq = vmlal_s16(accSq, vget_high_s16(lap), vget_high_s16(lap));
+        }
+        int64x2_t acc2 = vpaddlq_s32(acc);
+        uint64x2_t accSq2 = vpaddlq_u32(vreinterpretq_u32_s32(accSq));
+        sum += vgetq_lane_s64(acc2, 0) + vgetq_lane_s64(acc2, 1);
+        sumSq += vgetq_lane_u64(accSq2, 0) + vgetq_lane_u64(accSq2, 1);
+#elif defined(IMGPROC_X86) && defined(__SSE2__)
+        const __m128i zero = _mm_setzero_si128();
+        const __m128i ones = _mm_set1_epi16(1);
+        __m128i acc = _mm_setzero_si128();
+        __m128i accSq = _mm_setzero_si128();
+        for (; x + 8 < width; x += 8) {
+            __m128i c = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *)(pRow + x)), zero);
+            __m128i l = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *)(pRow + x - 1)), zero);
+            __m128i r = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *)(pRow + x + 1)), zero);
+            __m128i u = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *)(pRow + x - stride)), zero);
+            __m128i d = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *)(pRow + x + stride)), zero);
+            __m128i lap = _mm_sub_epi16(_mm_slli_epi16(c, 2),
+                    _mm_add_epi16(_mm_add_epi16(l, r), _mm_add_epi16(u, d)));
+            acc = _mm_add_epi32(acc, _mm_madd_epi16(lap, ones));
+            accSq = _mm_add_epi32(accSq, _mm_madd_epi16(lap, lap));
+        }
+        int32_t lanes[4];
+        uint32_t lanesSq[4];
+        _mm_storeu_si128((__m128i *)lanes, acc);
+        _mm_storeu_si128((__m128i *)lanesSq, accSq);
+        for (int i = 0; i < 4; i++) {
+            sum += lanes[i];
+            sumSq += lanesSq[i];
+        }
+#endif
+        // finish the tail
+        LaplacianRow(pRow, stride, x, width, sum, sumSq);
+    }
+}
+
+void Histogram(const unsigned char *pSrc, int width, int height, size_t stride, unsigned *pHist) {
+    // interleaved partial histograms do not wait for increments of the same bin
+    unsigned part[4][256];
+    memset(part, 0, sizeof(part));
+
+    for (int y = 0; y < height; y++) {
+        const unsigned char *pRow = pSrc + y * stride;
+        int x = 0;
+        for (; x + 4 <= width; x += 4) {
+            part[0][pRow[x]]++;
+            part[1][pRow[x + 1]]++;
+            part[2][pRow[x + 2]]++;
+            part[3][pRow[x + 3]]++;
+        }
+        for (; x < width; x++) part[0][pRow[x]]++;
+    }
+
+    for (int i = 0; i < 256; i++) pHist[i] = part[0][i] + part[1][i] + part[2][i] + part[3][i];
+}
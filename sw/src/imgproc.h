@@ -0,0 +1,36 @@
+#ifndef IMGPROC_H_
+#define IMGPROC_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+// swap first and third channel of packed 3-byte pixels in place (scalar)
+void SwapRBScalar(unsigned char *pData, size_t pixels);
+// swap first and third channel of packed 3-byte pixels in place (best SIMD)
+void SwapRB(unsigned char *pData, size_t pixels);
+// get name of SIMD implementation used by SwapRB()
+const char *SwapRBImplName();
+
+// get mean luma of packed 3-byte (or 1-byte luma) pixels sampled on grid with given step
+unsigned LumaGridMean(const unsigned char *pData, int width, int height, size_t stride, int gridStep,
+        int channels = 3);
+
+// downscale packed 3-byte (or 1-byte luma) pixels to luma by averaging factor x factor boxes
+void DownscaleLuma(const unsigned char *pSrc, int width, int height, size_t stride, int factor,
+        unsigned char *pDst, size_t dstStride, int channels = 3);
+// pick luma of every step-th pixel of every step-th row, keeps detail lost by box averaging
+void SubsampleLuma(const unsigned char *pSrc, int width, int height, size_t stride, int step,
+        unsigned char *pDst, size_t dstStride, int channels = 3);
+// sum of absolute differences of two 8-bit blocks
+unsigned BlockSAD(const unsigned char *pA, const unsigned char *pB, size_t stride, int width, int height);
+// add 8-bit values to 16-bit accumulators
+void AccumulateU8(const unsigned char *pSrc, uint16_t *pAcc, int len);
+// rounded average of 16-bit sums of count 8-bit values (1..16)
+void AverageU16(const uint16_t *pAcc, unsigned count, unsigned char *pDst, int len);
+// sum and sum of squares of 4-neighbour Laplacian over inner pixels of 8-bit image
+void LaplacianSums(const unsigned char *pSrc, int width, int height, size_t stride, int64_t &sum,
+        uint64_t &sumSq);
+// 256 bin histogram of 8-bit image, pHist is overwritten
+void Histogram(const unsigned char *pSrc, int width, int height, size_t stride, unsigned *pHist);
+
+#endif // IMGPROC_H_
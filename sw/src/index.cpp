@@ -0,0 +1,384 @@
+#include "common.h"
+#include "logger.h"
+#include <errno.h>
+#include <stddef.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <algorithm>
+
+#include "index.h"
+
+// file position of record
+static off_t RecordOffset(uint64_t pos) {
+    return sizeof(SIndexHeader) + pos * sizeof(SIndexRecord);
+}
+
+CPictureIndexWriter::CPictureIndexWriter() :
+    m_fd(-1),
+    m_count(0),
+    m_first(0),
+    m_compactRetry(0),
+    m_compacting(false) {
+    pthread_mutex_init(&m_lock, NULL);
+}
+
+CPictureIndexWriter::~CPictureIndexWriter() {
+    Close();
+    pthread_mutex_destroy(&m_lock);
+}
+
+bool CPictureIndexWriter::Open(const std::string &path) {
+    SIndexHeader header;
+    struct stat st;
+
+    Close();
+
+    // records are written by pwrite(), logical start is updated in place
+    if ((m_fd = open(path.c_str(), O_RDWR | O_CREAT, 0644)) < 0) {
+        LOG_ERROR("can not open picture index %s!", path.c_str());
+        return false;
+    }
+    m_path = path;
+    m_count = 0;
+    m_first = 0;
+    m_compactRetry = 0;
+
+    if (fstat(m_fd, &st) < 0) {
+        Close();
+        return false;
+    }
+
+    // new index
+    if (st.st_size == 0) {
+        memset(&header, 0, sizeof(header));
+        memcpy(header.magic, INDEX_MAGIC, INDEX_MAGIC_LEN);
+        header.recordSize = sizeof(SIndexRecord);
+
+        if (write(m_fd, &header, sizeof(header)) != (ssize_t)sizeof(header)) {
+            LOG_ERROR("can not write picture index header!");
+            Close();
+            return false;
+        }
+        return true;
+    }
+
+    // check header
+    if ((pread(m_fd, &header, sizeof(header), 0) != (ssize_t)sizeof(header)) ||
+            memcmp(header.magic, INDEX_MAGIC, INDEX_MAGIC_LEN) || (header.recordSize != sizeof(SIndexRecord))) {
+        LOG_ERROR("%s is not a picture index!", path.c_str());
+        Close();
+        return false;
+    }
+
+    // drop torn record written on power loss
+    off_t end = sizeof(header) + (st.st_size - sizeof(header)) / sizeof(SIndexRecord) * sizeof(SIndexRecord);
+    if ((st.st_size != end) && (ftruncate(m_fd, end) < 0)) {
+        LOG_ERROR("can not repair picture index %s!", path.c_str());
+        Close();
+        return false;
+    }
+    m_count = (end - sizeof(header)) / sizeof(SIndexRecord);
+    m_first = std::min(header.first, m_count);
+
+    return true;
+}
+
+void CPictureIndexWriter::Close() {
+    if (m_fd < 0) return;
+
+    // records of removed files are dropped when there are enough of them
+    pthread_mutex_lock(&m_lock);
+    bool compact = NeedCompact();
+    pthread_mutex_unlock(&m_lock);
+    if (compact) Compact();
+
+    pthread_mutex_lock(&m_lock);
+    close(m_fd);
+    m_fd = -1;
+    m_removed.clear();
+    pthread_mutex_unlock(&m_lock);
+}
+
+bool CPictureIndexWriter::Append(const SIndexRecord &record) {
+    // whole record by one write, readers never see it partially unless power is lost
+    pthread_mutex_lock(&m_lock);
+    bool open = (m_fd >= 0);
+    bool ok = open && (pwrite(m_fd, &record, sizeof(record), RecordOffset(m_count)) == (ssize_t)sizeof(record));
+    if (ok) m_count++;
+    pthread_mutex_unlock(&m_lock);
+
+    if (!open) {
+        LOG_ERROR("picture index is not open!");
+        return false;
+    }
+    if (!ok) {
+        LOG_ERROR("can not append to picture index!");
+        return false;
+    }
+
+    return true;
+}
+
+void CPictureIndexWriter::Remove(const std::string &name) {
+    pthread_mutex_lock(&m_lock);
+    if (m_fd < 0) {
+        pthread_mutex_unlock(&m_lock);
+        return;
+    }
+
+    // record keeps truncated name
+    m_removed[name.substr(0, INDEX_NAME_LEN)] = m_count;
+    Advance();
+    bool compact = NeedCompact();
+    pthread_mutex_unlock(&m_lock);
+
+    // rewrite runs in caller (storage thread), appends are not blocked by it
+    if (compact) Compact();
+}
+
+bool CPictureIndexWriter::IsRemoved(const std::map<std::string, uint64_t> &removed, const SIndexRecord &record,
+        uint64_t pos) {
+    std::map<std::string, uint64_t>::const_iterator it =
+            removed.find(std::string(record.name, strnlen(record.name, INDEX_NAME_LEN)));
+    return (it != removed.end()) && (pos < it->second);
+}
+
+void CPictureIndexWriter::Advance() {
+    SIndexRecord records[INDEX_COPY_RECORDS];
+    uint64_t first = m_first;
+
+    // the oldest files are evicted first, so their records are skipped by logical start without rewrite
+    while (first < m_count) {
+        size_t count = (size_t)std::min(m_count - first, (uint64_t)INDEX_COPY_RECORDS);
+        ssize_t size = count * sizeof(SIndexRecord);
+        if (pread(m_fd, records, size, RecordOffset(first)) != size) break;
+
+        size_t i = 0;
+        while ((i < count) && IsRemoved(m_removed, records[i], first + i)) i++;
+        first += i;
+        if (i < count) break;
+    }
+
+    if (first == m_first) return;
+
+    // not synced, stale start after power loss only shows records of removed files
+    m_first = first;
+    if (pwrite(m_fd, &m_first, sizeof(m_first), offsetof(SIndexHeader, first)) != (ssize_t)sizeof(m_first))
+        LOG_ERROR("can not update start of picture index!");
+}
+
+bool CPictureIndexWriter::NeedCompact() {
+    // records behind the start, or removed files when the start is held by an open container,
+    // a file has one record at least, names are kept until rewrite
+    uint64_t dead = std::max(m_first, (uint64_t)m_removed.size());
+    return (m_fd >= 0) && !m_compacting && (m_count >= m_compactRetry) && (dead >= INDEX_COMPACT_MIN) &&
+            (dead * INDEX_COMPACT_RATIO >= m_count);
+}
+
+bool CPictureIndexWriter::CopyRecords(int fd, const std::map<std::string, uint64_t> &removed, uint64_t from,
+        uint64_t to, uint64_t &kept) {
+    SIndexRecord records[INDEX_COPY_RECORDS];
+
+    for (uint64_t pos = from; pos < to; ) {
+        size_t count = (size_t)std::min(to - pos, (uint64_t)INDEX_COPY_RECORDS);
+        ssize_t size = count * sizeof(SIndexRecord);
+        if (pread(m_fd, records, size, RecordOffset(pos)) != size) return false;
+
+        size_t out = 0;
+        for (size_t i = 0; i < count; i++) {
+            if (!IsRemoved(removed, records[i], pos + i)) records[out++] = records[i];
+        }
+
+        size = out * sizeof(SIndexRecord);
+        if (out && (pwrite(fd, records, size, RecordOffset(kept)) != size)) return false;
+        kept += out;
+        pos += count;
+    }
+
+    return true;
+}
+
+bool CPictureIndexWriter::Compact() {
+    SIndexHeader header;
+    std::string tmpPath = m_path + ".tmp";
+    uint64_t kept = 0;
+
+    pthread_mutex_lock(&m_lock);
+    if ((m_fd < 0) || m_compacting) {
+        pthread_mutex_unlock(&m_lock);
+        return false;
+    }
+    m_compacting = true;
+    uint64_t first = m_first;
+    uint64_t end = m_count;
+    // names for copy without lock, files removed meanwhile are added to m_removed only
+    std::map<std::string, uint64_t> removed = m_removed;
+    pthread_mutex_unlock(&m_lock);
+
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, INDEX_MAGIC, INDEX_MAGIC_LEN);
+    header.recordSize = sizeof(SIndexRecord);
+
+    // the bulk is copied without lock, writer appends behind end meanwhile
+    int fd = open(tmpPath.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+    bool ok = (fd >= 0) && (write(fd, &header, sizeof(header)) == (ssize_t)sizeof(header)) &&
+            CopyRecords(fd, removed, first, end, kept) && (fdatasync(fd) == 0);
+
+    pthread_mutex_lock(&m_lock);
+
+    // records appended during copy, usually none or a few
+    bool tail = (m_count > end);
+    if (ok) ok = CopyRecords(fd, m_removed, end, m_count, kept) && (!tail || (fdatasync(fd) == 0)) &&
+            (rename(tmpPath.c_str(), m_path.c_str()) == 0);
+
+    uint64_t total = m_count;
+    if (ok) {
+        close(m_fd);
+        m_fd = fd;
+        m_count = kept;
+        m_first = 0;
+
+        // files removed during copy may have records in the new index, they are dropped by the next rewrite
+        for (std::map<std::string, uint64_t>::iterator it = m_removed.begin(); it != m_removed.end(); ) {
+            std::map<std::string, uint64_t>::iterator old = removed.find(it->first);
+            if ((old != removed.end()) && (old->second == it->second)) m_removed.erase(it++);
+            else (it++)->second = m_count;
+        }
+    } else m_compactRetry = m_count + INDEX_COMPACT_MIN;
+
+    m_compacting = false;
+    pthread_mutex_unlock(&m_lock);
+
+    if (!ok) {
+        LOG_ERROR("can not remove evicted pictures from index %s!", m_path.c_str());
+        if (fd >= 0) close(fd);
+        unlink(tmpPath.c_str());
+        return false;
+    }
+
+    // new name is durable after directory fsync
+    size_t slash = m_path.rfind('/');
+    std::string dir = (slash == std::string::npos) ? "." : m_path.substr(0, slash + 1);
+    int dirFd = open(dir.c_str(), O_RDONLY | O_DIRECTORY);
+    if ((dirFd < 0) || (fsync(dirFd) != 0)) LOG_WARNING("can not sync directory of %s", m_path.c_str());
+    if (dirFd >= 0) close(dirFd);
+
+    LOG_DEBUG("picture index was rewritten, %llu records of %llu were kept",
+            (unsigned long long)kept, (unsigned long long)total);
+    return true;
+}
+
+CPictureIndex::CPictureIndex() :
+    m_fd(-1),
+    m_pMap(NULL),
+    m_mapSize(0),
+    m_pRecords(NULL),
+    m_count(0) {
+}
+
+CPictureIndex::~CPictureIndex() {
+    Close();
+}
+
+bool CPictureIndex::Open(const std::string &path) {
+    SIndexHeader header;
+
+    Close();
+
+    if ((m_fd = open(path.c_str(), O_RDONLY)) < 0) {
+        LOG_ERROR("can not open picture index %s!", path.c_str());
+        return false;
+    }
+    m_path = path;
+
+    // check header
+    if ((pread(m_fd, &header, sizeof(header), 0) != (ssize_t)sizeof(header)) ||
+            memcmp(header.magic, INDEX_MAGIC, INDEX_MAGIC_LEN) || (header.recordSize != sizeof(SIndexRecord))) {
+        LOG_ERROR("%s is not a picture index!", path.c_str());
+        Close();
+        return false;
+    }
+
+    if (!Map()) {
+        Close();
+        return false;
+    }
+
+    return true;
+}
+
+void CPictureIndex::Close() {
+    Unmap();
+    if (m_fd >= 0) close(m_fd);
+    m_fd = -1;
+}
+
+bool CPictureIndex::Map() {
+    SIndexHeader header;
+    struct stat st;
+
+    if ((fstat(m_fd, &st) < 0) || (pread(m_fd, &header, sizeof(header), 0) != (ssize_t)sizeof(header))) return false;
+
+    size_t count = (st.st_size - sizeof(SIndexHeader)) / sizeof(SIndexRecord);
+    // records of evicted files before logical start are not visible
+    size_t first = (size_t)std::min((uint64_t)count, header.first);
+    if (count == first) {
+        Unmap();
+        return true;
+    }
+
+    // pages are loaded by binary search only where touched
+    size_t size = sizeof(SIndexHeader) + count * sizeof(SIndexRecord);
+    void *pMap = mmap(NULL, size, PROT_READ, MAP_SHARED, m_fd, 0);
+    if (pMap == MAP_FAILED) {
+        LOG_ERROR("can not map picture index: %s", strerror(errno));
+        return false;
+    }
+
+    Unmap();
+    m_pMap = pMap;
+    m_mapSize = size;
+    m_pRecords = (const SIndexRecord*)((const char*)pMap + sizeof(SIndexHeader)) + first;
+    m_count = count - first;
+
+    return true;
+}
+
+void CPictureIndex::Unmap() {
+    if (m_pMap != NULL) munmap(m_pMap, m_mapSize);
+    m_pMap = NULL;
+    m_mapSize = 0;
+    m_pRecords = NULL;
+    m_count = 0;
+}
+
+bool CPictureIndex::Refresh() {
+    struct stat st, act;
+
+    if (m_fd < 0) return false;
+
+    // writer replaced the index by rewritten one
+    if ((stat(m_path.c_str(), &st) == 0) && (fstat(m_fd, &act) == 0) && (st.st_ino != act.st_ino)) {
+        std::string path = m_path;
+        return Open(path);
+    }
+
+    return Map();
+}
+
+size_t CPictureIndex::LowerBound(uint64_t timeMs) {
+    size_t lo = 0, hi = m_count;
+
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (m_pRecords[mid].timeMs < timeMs) lo = mid + 1;
+        else hi = mid;
+    }
+
+    return lo;
+}
+
+void CPictureIndex::FindRange(uint64_t fromMs, uint64_t toMs, size_t &first, size_t &last) {
+    first = LowerBound(fromMs);
+    last = (toMs > fromMs) ? LowerBound(toMs) : first;
+}
@@ -0,0 +1,123 @@
+#ifndef INDEX_H_
+#define INDEX_H_
+
+#include <pthread.h>
+#include <stdint.h>
+#include <map>
+#include <string>
+
+// index file in picture directory
+#define INDEX_FILE ".index"
+#define INDEX_MAGIC "CAMIDX03"
+#define INDEX_MAGIC_LEN 8
+// max count of sensor readings in one record
+#define INDEX_SENSORS 4
+// max length of file or container name
+#define INDEX_NAME_LEN 47
+// motion score was not measured
+#define INDEX_NO_MOTION -1
+// quality scores were not measured
+#define INDEX_NO_QUALITY -1
+// index is rewritten without records of evicted files when there are at least this many of them
+// and they make 1/INDEX_COMPACT_RATIO of the index
+#define INDEX_COMPACT_MIN 64
+#define INDEX_COMPACT_RATIO 2
+// records copied at once by rewrite
+#define INDEX_COPY_RECORDS 64
+
+// file header, records follow
+struct SIndexHeader {
+    char magic[INDEX_MAGIC_LEN];
+    uint32_t recordSize;
+    uint32_t reserved;
+    uint64_t first;         // logical start, records before it belong to evicted files
+};
+
+// one stored output of a picture, records are appended in capture order
+struct SIndexRecord {
+    uint64_t timeMs;        // wall clock capture time [ms]
+    uint64_t offset;        // JPEG offset in container, 0 for picture file
+    uint32_t size;          // encoded size [B]
+    uint8_t output;         // 0 = full size
+    uint8_t sensorCount;
+    int16_t motion;         // changed blocks [per mille] or INDEX_NO_MOTION
+    float sensors[INDEX_SENSORS];   // e.g. DS18B20 temperatures [deg C]
+    float sharpness;        // Laplacian variance or INDEX_NO_QUALITY
+    int16_t luma;           // mean luma or INDEX_NO_QUALITY
+    uint16_t reserved;
+    char name[INDEX_NAME_LEN + 1];  // file or container relative to picture directory
+};
+
+// appends records, one write() per record
+class CPictureIndexWriter {
+public:
+    CPictureIndexWriter();
+    ~CPictureIndexWriter();
+
+    // torn record at the end is dropped
+    bool Open(const std::string &path);
+    // records of removed files are dropped first when there are enough of them
+    void Close();
+    inline bool IsOpen() { return m_fd >= 0; }
+
+    bool Append(const SIndexRecord &record);
+    // file was evicted, logical start skips its records when they are the oldest ones,
+    // others are dropped by rewrite done in calling thread, thread safe
+    void Remove(const std::string &name);
+
+private:
+    void Advance();
+    bool NeedCompact();
+    bool Compact();
+    bool CopyRecords(int fd, const std::map<std::string, uint64_t> &removed, uint64_t from, uint64_t to,
+            uint64_t &kept);
+    static bool IsRemoved(const std::map<std::string, uint64_t> &removed, const SIndexRecord &record, uint64_t pos);
+
+private:
+    int m_fd;
+    std::string m_path;
+    // records in file incl. skipped ones
+    uint64_t m_count;
+    uint64_t m_first;
+    // evicted file names, value is count of records when it was evicted, newer records of reused name are kept
+    std::map<std::string, uint64_t> m_removed;
+    // failed rewrite is retried after more records
+    uint64_t m_compactRetry;
+    bool m_compacting;
+    pthread_mutex_t m_lock;
+};
+
+// read-only memory mapped index, time range is found by binary search
+class CPictureIndex {
+public:
+    CPictureIndex();
+    ~CPictureIndex();
+
+    bool Open(const std::string &path);
+    void Close();
+    // map records appended since Open(), index is reopened when it was rewritten without evicted files
+    bool Refresh();
+
+    inline size_t GetCount() { return m_count; }
+    inline const SIndexRecord& GetRecord(size_t idx) { return m_pRecords[idx]; }
+
+    // the first record taken at or after given time, GetCount() if there is none
+    // capture order is assumed, records of a clock step back are found only by scan
+    size_t LowerBound(uint64_t timeMs);
+    // records in [fromMs, toMs)
+    void FindRange(uint64_t fromMs, uint64_t toMs, size_t &first, size_t &last);
+
+private:
+    bool Map();
+    void Unmap();
+
+private:
+    int m_fd;
+    std::string m_path;
+    void *m_pMap;
+    size_t m_mapSize;
+    const SIndexRecord *m_pRecords;
+    size_t m_count;
+};
+
+#endif // INDEX_H_
@@ -0,0 +1,242 @@
+#include "common.h"
+#include "logger.h"
+#include <algorithm>
+
+#include "jpegenc.h"
+
+CJpegEncoder::CJpegEncoder() :
+    m_pOut(NULL),
+    m_initialized(false) {
+    m_params.quality = JPEG_DEF_QUALITY;
+    m_params.subsampling = JSS_420;
+    m_params.optimize = false;
+}
+
+CJpegEncoder::~CJpegEncoder() {
+    if (m_initialized) jpeg_destroy_compress(&m_cinfo);
+    m_initialized = false;
+    m_pOut = NULL;
+}
+
+bool CJpegEncoder::Init() {
+    if (m_initialized) return true;
+
+    // errors jump back instead of exit()
+    m_cinfo.err = jpeg_std_error(&m_err.mgr);
+    m_err.mgr.error_exit = ErrorExit;
+
+    if (setjmp(m_err.jump)) {
+        LOG_ERROR("can not create JPEG compressor!");
+        jpeg_destroy_compress(&m_cinfo);
+        return false;
+    }
+
+    jpeg_create_compress(&m_cinfo);
+
+    // destination writes into caller's vector
+    m_dest.init_destination = InitDestination;
+    m_dest.empty_output_buffer = EmptyOutputBuffer;
+    m_dest.term_destination = TermDestination;
+    m_cinfo.dest = &m_dest;
+    m_cinfo.client_data = this;
+
+    m_initialized = true;
+    return true;
+}
+
+void CJpegEncoder::SetParams(const SJpegParams &params) {
+    m_params = params;
+
+    // check range
+    if (m_params.quality < 1) m_params.quality = 1;
+    if (m_params.quality > 100) m_params.quality = 100;
+    if ((m_params.subsampling < 0) || (m_params.subsampling >= JSS_COUNT)) m_params.subsampling = JSS_420;
+}
+
+void CJpegEncoder::SetSubsampling(int subsampling) {
+    if (subsampling == JSS_GRAY) {
+        jpeg_set_colorspace(&m_cinfo, JCS_GRAYSCALE);
+        return;
+    }
+
+    // chroma components stay 1x1, luma defines subsampling
+    if (m_cinfo.num_components < 3) return;
+    m_cinfo.comp_info[0].h_samp_factor = (subsampling == JSS_444) ? 1 : 2;
+    m_cinfo.comp_info[0].v_samp_factor = (subsampling == JSS_420) ? 2 : 1;
+    m_cinfo.comp_info[1].h_samp_factor = m_cinfo.comp_info[1].v_samp_factor = 1;
+    m_cinfo.comp_info[2].h_samp_factor = m_cinfo.comp_info[2].v_samp_factor = 1;
+}
+
+bool CJpegEncoder::Encode(const unsigned char *pData, int width, int height, size_t stride, int channels,
+        bool bgr, std::vector<unsigned char> &out) {
+    // check initialization
+    if (!m_initialized && !Init()) return false;
+
+    // check input image
+    if ((pData == NULL) || (width <= 0) || (height <= 0) || ((channels != 1) && (channels != 3))) {
+        LOG_ERROR("image for JPEG encoder is not valid!");
+        return false;
+    }
+
+    m_pOut = &out;
+
+    if (setjmp(m_err.jump)) {
+        LOG_ERROR("JPEG encoding failed!");
+        jpeg_abort_compress(&m_cinfo);
+        m_pOut = NULL;
+        m_app1.clear();
+        return false;
+    }
+
+    m_cinfo.image_width = width;
+    m_cinfo.image_height = height;
+    m_cinfo.input_components = channels;
+#ifdef JCS_EXTENSIONS
+    // libjpeg-turbo takes BGR directly
+    m_cinfo.in_color_space = (channels == 1) ? JCS_GRAYSCALE : (bgr ? JCS_EXT_BGR : JCS_RGB);
+#else
+    m_cinfo.in_color_space = (channels == 1) ? JCS_GRAYSCALE : JCS_RGB;
+    if (bgr && (channels == 3)) m_row.resize(width * 3);
+#endif
+
+    jpeg_set_defaults(&m_cinfo);
+    jpeg_set_quality(&m_cinfo, m_params.quality, TRUE);
+    SetSubsampling(m_params.subsampling);
+    m_cinfo.optimize_coding = m_params.optimize ? TRUE : FALSE;
+    m_cinfo.write_JFIF_header = m_app1.empty() ? TRUE : FALSE;
+
+    jpeg_start_compress(&m_cinfo, TRUE);
+    WriteMarkers();
+
+    while (m_cinfo.next_scanline < m_cinfo.image_height) {
+        JSAMPROW row = (JSAMPROW)(pData + m_cinfo.next_scanline * stride);
+#ifndef JCS_EXTENSIONS
+        // swap channels of one row for plain libjpeg
+        if (bgr && (channels == 3)) {
+            for (int x = 0; x < width * 3; x += 3) {
+                m_row[x] = row[x + 2];
+                m_row[x + 1] = row[x + 1];
+                m_row[x + 2] = row[x];
+            }
+            row = &m_row[0];
+        }
+#endif
+        jpeg_write_scanlines(&m_cinfo, &row, 1);
+    }
+
+    jpeg_finish_compress(&m_cinfo);
+    m_pOut = NULL;
+
+    return true;
+}
+
+bool CJpegEncoder::EncodeI420(const unsigned char *pY, const unsigned char *pU, const unsigned char *pV,
+        int width, int height, size_t strideY, size_t strideUV, std::vector<unsigned char> &out) {
+    // rows of one MCU row, luma is sampled 2x2
+    JSAMPROW rowsY[2 * DCTSIZE];
+    JSAMPROW rowsU[DCTSIZE];
+    JSAMPROW rowsV[DCTSIZE];
+    JSAMPARRAY planes[3] = { rowsY, rowsU, rowsV };
+
+    // check initialization
+    if (!m_initialized && !Init()) return false;
+
+    // check input planes
+    if ((pY == NULL) || (pU == NULL) || (pV == NULL) || (width <= 0) || (height <= 0) || ((width | height) & 1)) {
+        LOG_ERROR("YUV420 image for JPEG encoder is not valid!");
+        return false;
+    }
+
+    m_pOut = &out;
+
+    if (setjmp(m_err.jump)) {
+        LOG_ERROR("JPEG encoding failed!");
+        jpeg_abort_compress(&m_cinfo);
+        m_pOut = NULL;
+        m_app1.clear();
+        return false;
+    }
+
+    m_cinfo.image_width = width;
+    m_cinfo.image_height = height;
+    m_cinfo.input_components = 3;
+    m_cinfo.in_color_space = JCS_YCbCr;
+
+    jpeg_set_defaults(&m_cinfo);
+    jpeg_set_quality(&m_cinfo, m_params.quality, TRUE);
+    // planes are already subsampled
+    SetSubsampling(JSS_420);
+    m_cinfo.raw_data_in = TRUE;
+    m_cinfo.optimize_coding = m_params.optimize ? TRUE : FALSE;
+    m_cinfo.write_JFIF_header = m_app1.empty() ? TRUE : FALSE;
+
+    jpeg_start_compress(&m_cinfo, TRUE);
+    WriteMarkers();
+
+    while (m_cinfo.next_scanline < m_cinfo.image_height) {
+        int y = m_cinfo.next_scanline;
+
+        // rows below the image repeat the last one
+        for (int i = 0; i < 2 * DCTSIZE; i++)
+            rowsY[i] = (JSAMPROW)(pY + std::min(y + i, height - 1) * strideY);
+        for (int i = 0; i < DCTSIZE; i++) {
+            int yc = std::min(y / 2 + i, height / 2 - 1);
+            rowsU[i] = (JSAMPROW)(pU + yc * strideUV);
+            rowsV[i] = (JSAMPROW)(pV + yc * strideUV);
+        }
+
+        jpeg_write_raw_data(&m_cinfo, planes, 2 * DCTSIZE);
+    }
+
+    jpeg_finish_compress(&m_cinfo);
+    m_pOut = NULL;
+
+    return true;
+}
+
+void CJpegEncoder::WriteMarkers() {
+    if (m_app1.empty()) return;
+
+    // APP1 right after SOI, in the same pass as image data
+    jpeg_write_marker(&m_cinfo, JPEG_APP0 + 1, &m_app1[0], m_app1.size());
+    m_app1.clear();
+}
+
+void CJpegEncoder::ErrorExit(j_common_ptr cinfo) {
+    SErrorMgr *pErr = (SErrorMgr*)cinfo->err;
+    char msg[JMSG_LENGTH_MAX];
+
+    (*cinfo->err->format_message)(cinfo, msg);
+    LOG_ERROR("libjpeg: %s", msg);
+
+    longjmp(pErr->jump, 1);
+}
+
+void CJpegEncoder::InitDestination(j_compress_ptr cinfo) {
+    std::vector<unsigned char> &out = *((CJpegEncoder*)cinfo->client_data)->m_pOut;
+
+    // use whole already allocated capacity
+    out.resize(std::max(out.capacity(), (size_t)JPEG_INIT_BUFF_SIZE));
+
+    cinfo->dest->next_output_byte = &out[0];
+    cinfo->dest->free_in_buffer = out.size();
+}
+
+boolean CJpegEncoder::EmptyOutputBuffer(j_compress_ptr cinfo) {
+    std::vector<unsigned char> &out = *((CJpegEncoder*)cinfo->client_data)->m_pOut;
+    size_t used = out.size();
+
+    // buffer is full, double it
+    out.resize(used * 2);
+
+    cinfo->dest->next_output_byte = &out[used];
+    cinfo->dest->free_in_buffer = out.size() - used;
+    return TRUE;
+}
+
+void CJpegEncoder::TermDestination(j_compress_ptr cinfo) {
+    std::vector<unsigned char> &out = *((CJpegEncoder*)cinfo->client_data)->m_pOut;
+
+    // keep capacity for the next picture
+    out.resize(out.size() - cinfo->dest->free_in_buffer);
+}
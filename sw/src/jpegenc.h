@@ -0,0 +1,93 @@
+#ifndef JPEGENC_H_
+#define JPEGENC_H_
+
+#include <stdio.h>
+#include <setjmp.h>
+#include <vector>
+#include <jpeglib.h>
+#include <opencv2/core.hpp>
+
+// default encoder settings
+#define JPEG_DEF_QUALITY 85
+// initial size of output buffer
+#define JPEG_INIT_BUFF_SIZE (256 * 1024)
+
+// chroma subsampling
+typedef enum JpegSubsampling {
+    JSS_444 = 0,
+    JSS_422,
+    JSS_420,
+    JSS_GRAY,   // luma only
+    JSS_COUNT
+} JpegSubsampling;
+
+struct SJpegParams {
+    int quality;            // 1..100
+    int subsampling;        // JpegSubsampling
+    bool optimize;          // optimized (2-pass) instead of default Huffman tables
+};
+
+// libjpeg(-turbo) compressor kept for the encoder lifetime
+class CJpegEncoder {
+public:
+    CJpegEncoder();
+    ~CJpegEncoder();
+
+    bool Init();
+    inline bool IsInitialized() { return m_initialized; }
+
+    void SetParams(const SJpegParams &params);
+    inline const SJpegParams& GetParams() { return m_params; }
+
+    // APP1 payload (e.g. EXIF) written by the next encode only, it replaces JFIF header
+    inline void SetApp1(const std::vector<unsigned char> &app1) { m_app1 = app1; }
+
+    // encode packed 8-bit image, buffer is reused and grows as needed
+    bool Encode(const unsigned char *pData, int width, int height, size_t stride, int channels,
+            bool bgr, std::vector<unsigned char> &out);
+    // encode BGR or gray Mat
+    inline bool Encode(const cv::Mat &image, std::vector<unsigned char> &out) {
+        return Encode(image.data, image.cols, image.rows, image.step, image.channels(), true, out);
+    }
+
+    // encode YUV420 planes as raw data, without colour conversion and 4:2:0 always
+    bool EncodeI420(const unsigned char *pY, const unsigned char *pU, const unsigned char *pV, int width, int height,
+            size_t strideY, size_t strideUV, std::vector<unsigned char> &out);
+    // encode I420 Mat with height * 3 / 2 rows
+    inline bool EncodeI420(const cv::Mat &frame, std::vector<unsigned char> &out) {
+        int height = frame.rows * 2 / 3;
+        const unsigned char *pU = frame.data + frame.step * height;
+        return EncodeI420(frame.data, pU, pU + frame.step * height / 4, frame.cols, height,
+                frame.step, frame.step / 2, out);
+    }
+
+private:
+    CJpegEncoder(CJpegEncoder const& copy); // not implemented
+    CJpegEncoder& operator=(CJpegEncoder const& copy); // not implemented
+
+    void SetSubsampling(int subsampling);
+    void WriteMarkers();
+
+    static void ErrorExit(j_common_ptr cinfo);
+    static void InitDestination(j_compress_ptr cinfo);
+    static boolean EmptyOutputBuffer(j_compress_ptr cinfo);
+    static void TermDestination(j_compress_ptr cinfo);
+
+private:
+    // libjpeg error manager extended with jump buffer
+    struct SErrorMgr {
+        struct jpeg_error_mgr mgr;
+        jmp_buf jump;
+    };
+
+    struct jpeg_compress_struct m_cinfo;
+    struct jpeg_destination_mgr m_dest;
+    SErrorMgr m_err;
+    SJpegParams m_params;
+    std::vector<unsigned char> *m_pOut;
+    std::vector<unsigned char> m_row;
+    std::vector<unsigned char> m_app1;
+    bool m_initialized;
+};
+
+#endif // JPEGENC_H_
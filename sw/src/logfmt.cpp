@@ -0,0 +1,121 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "logfmt.h"
+
+const char *LevelStr[] = {
+    "",
+	"",
+	"",
+    "error",
+    "warning",
+    "info",
+	"debug"
+};
+
+uint32_t LogFormatId(const char *pFormat) {
+	uint32_t hash = 2166136261u;
+
+	for (; *pFormat; pFormat++) {
+		hash ^= (unsigned char)*pFormat;
+		hash *= 16777619u;
+	}
+
+	return (hash == LOG_BIN_TEXT_ID) ? 1 : hash;
+}
+
+LogArgType NextLogArg(const char **ppFormat, std::string *pSpec) {
+	const char *p = *ppFormat;
+
+	for (;;) {
+		// find conversion
+		while (*p && (*p != '%')) p++;
+		if (!*p) {
+			*ppFormat = p;
+			return LBA_NONE;
+		}
+		if (p[1] != '%') break;
+		p += 2;
+	}
+
+	const char *pStart = p++;
+	// flags, width and precision, '*' takes argument which is not recorded
+	while (*p && strchr("-+ #0'", *p)) p++;
+	while ((*p >= '0') && (*p <= '9')) p++;
+	if (*p == '.') {
+		p++;
+		while ((*p >= '0') && (*p <= '9')) p++;
+	}
+	const char *pLength = p;
+
+	// length modifier
+	int longs = 0, shorts = 0;
+	bool size = false, other = false;
+	for (;; p++) {
+		if (*p == 'l') longs++;
+		else if (*p == 'h') shorts++;
+		else if (*p == 'z') size = true;
+		else if (*p && strchr("Lqjt", *p)) other = true;
+		else break;
+	}
+
+	char conv = *p;
+	LogArgType type = LBA_INVALID;
+	if (conv) p++;
+	*ppFormat = p;
+
+	if (pSpec != NULL) {
+		// values are decoded as int32 or 64 bit, only narrowing 'h' is kept
+		pSpec->assign(pStart, pLength - pStart);
+		pSpec->append(shorts, 'h');
+		pSpec->push_back(conv);
+	}
+
+	if (!conv || other || (*pLength == '*')) return LBA_INVALID;
+	if (memchr(pStart, '*', pLength - pStart)) return LBA_INVALID;
+
+	switch (conv) {
+	case 'd': case 'i': case 'u': case 'o': case 'x': case 'X':
+		if (size) type = LBA_SIZE;
+		else if (longs == 1) type = LBA_LONG;
+		else if (longs == 2) type = LBA_LLONG;
+		else if (!longs) type = LBA_INT;
+		break;
+	case 'c':
+		if (!longs && !size) type = LBA_INT;
+		break;
+	case 'e': case 'E': case 'f': case 'F': case 'g': case 'G': case 'a': case 'A':
+		if (!size) type = LBA_DOUBLE;
+		break;
+	case 's':
+		if (!longs && !size) type = LBA_STRING;
+		break;
+	case 'p':
+		type = LBA_PTR;
+		break;
+	default:
+		break;
+	}
+
+	return type;
+}
+
+int FormatLogPrefix(char *pText, size_t len, const char *pPrefix, int level, const struct tm *pTime, int msec) {
+	if (pTime == NULL) return snprintf(pText, len, "[%s] %7s: ", pPrefix, LevelStr[level]);
+
+	int size = snprintf(pText, len, "[%s] %7s: ", pPrefix, LevelStr[level]);
+	if ((size < 0) || ((size_t)size >= len)) return size;
+	size += FormatLogTime(pText + size, len - size, pTime, msec);
+	return size;
+}
+
+int FormatLogTime(char *pText, size_t len, const struct tm *pTime, int msec) {
+	if (msec < 0) {
+		return snprintf(pText, len, "%02d.%02d.%04d %02d:%02d:%02d : ",
+				pTime->tm_mday, pTime->tm_mon + 1, pTime->tm_year + 1900,
+				pTime->tm_hour, pTime->tm_min, pTime->tm_sec);
+	}
+	return snprintf(pText, len, "%02d.%02d.%04d %02d:%02d:%02d.%03d : ",
+			pTime->tm_mday, pTime->tm_mon + 1, pTime->tm_year + 1900,
+			pTime->tm_hour, pTime->tm_min, pTime->tm_sec, msec);
+}
@@ -0,0 +1,75 @@
+#ifndef LOGFMT_H_
+#define LOGFMT_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+#include <string>
+
+// binary log stream, header is followed by records in native (little) endian
+#define LOG_BIN_MAGIC		"CAMBLOG1"
+#define LOG_BIN_MAGIC_LEN	8
+#define LOG_BIN_PREFIX_LEN	31
+// format ID of message recorded as formatted text, e.g. call without LOG_* macro
+#define LOG_BIN_TEXT_ID		0
+// max count of raw arguments of one call site
+#define LOG_BIN_MAX_ARGS	16
+// max size of one record with arguments
+#define LOG_BIN_MAX_RECORD	512
+// records buffered before they are written
+#define LOG_BIN_BUFFER_SIZE	8192
+
+// raw argument of binary record, stored as fixed size value or length prefixed string
+typedef enum LogArgType {
+	LBA_NONE = 0,	// end of format
+	LBA_INT,		// int, char, short, stored as int32
+	LBA_LONG,		// long, stored as int64
+	LBA_LLONG,		// long long, stored as int64
+	LBA_SIZE,		// size_t, stored as int64
+	LBA_DOUBLE,		// float, double
+	LBA_STRING,		// uint16 length and bytes
+	LBA_PTR,		// stored as uint64
+	LBA_INVALID,	// not supported conversion (e.g. '*' width), message is recorded as text
+	LBA_COUNT
+} LogArgType;
+
+struct SLogBinHeader {
+	char magic[LOG_BIN_MAGIC_LEN];
+	uint64_t wallUs;		// wall clock time at monoNs, converts record times
+	uint64_t monoNs;
+	char prefix[LOG_BIN_PREFIX_LEN + 1];
+};
+
+// record of one message, raw arguments follow
+struct SLogBinRecord {
+	uint32_t formatId;		// hash of format string or LOG_BIN_TEXT_ID
+	uint8_t level;
+	uint8_t reserved;
+	uint16_t argSize;		// [B]
+	uint64_t monoNs;		// CLOCK_MONOTONIC [ns]
+};
+
+// call site of LOG_* macro, argument types are parsed from format by its first call
+struct SLogSite {
+	volatile int ready;
+	const char *pFormat;	// format parsed, other format is recorded as text
+	uint32_t formatId;
+	unsigned char argCount;
+	unsigned char args[LOG_BIN_MAX_ARGS];
+};
+
+// FNV-1a hash of format string, never LOG_BIN_TEXT_ID
+uint32_t LogFormatId(const char *pFormat);
+// type of the next conversion of printf format, LBA_NONE at the end,
+// ppFormat is moved behind the conversion, pSpec gets conversion without 'l', 'z' length modifier
+LogArgType NextLogArg(const char **ppFormat, std::string *pSpec = NULL);
+
+// names of LogLevel values
+extern const char *LevelStr[];
+// "[prefix]   level: time : " text line prefix, returns its length,
+// time is left out without pTime, milliseconds without msec
+int FormatLogPrefix(char *pText, size_t len, const char *pPrefix, int level, const struct tm *pTime, int msec = -1);
+// "dd.mm.yyyy HH:MM:SS.mmm : " part of the prefix
+int FormatLogTime(char *pText, size_t len, const struct tm *pTime, int msec = -1);
+
+#endif // LOGFMT_H_
@@ -1,21 +1,50 @@
 #include "common.h"
+#include <errno.h>
+#include <signal.h>
 #include <stdarg.h>
 #include <sys/time.h>
+#include <time.h>
+#include <sched.h>
+#include <algorithm>
 
 #include "logger.h"
 
 CLogger* CLogger::m_pThis = NULL;
-char CLogger::m_logBuffer[MAX_MSG_LEN] = {};
-
-const char *LevelStr[] = {
-    "",
-	"",
-	"",
-    "error",
-    "warning",
-    "info",
-	"debug"
+// default system log level
+volatile LogLevel CLogger::m_enabledLevel = LL_DEBUG;
+
+// line of the calling thread, formatted before it is queued or written
+static __thread char t_logBuffer[MAX_MSG_LEN + 2];
+
+// time part of line prefix, rendered by each thread once per second
+struct SLogTimeCache {
+	time_t sec;
+	int len;
+	char text[LOG_TIME_LEN];
 };
+static __thread SLogTimeCache t_timeCache;
+
+// signals after which queued messages are written before the process dies
+static const int c_fatalSignals[] = { SIGSEGV, SIGBUS, SIGILL, SIGFPE, SIGABRT };
+
+static uint64_t GetMonoTimeNSec() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+// write whole buffer, interrupted or partial writes are repeated
+static void WriteAll(int fd, const char *pData, size_t len) {
+	while (len > 0) {
+		ssize_t n = write(fd, pData, len);
+		if (n < 0) {
+			if (errno == EINTR) continue;
+			return;
+		}
+		pData += n;
+		len -= n;
+	}
+}
 
 CLogger::CLogger() :
 	m_systemLogLevel(LL_DEBUG),
@@ -23,11 +52,71 @@ CLogger::CLogger() :
 	m_logFile(NULL),
 	m_logTime(true),
 	m_appendNewLine(true),
-	m_pLogPrefix("cam-system") {
+	m_pLogPrefix("cam-system"),
+	m_async(false),
+	m_stop(false),
+	m_overflow(LO_DROP),
+	m_pRing(NULL),
+	m_ringSize(0),
+	m_head(0),
+	m_tail(0),
+	m_dropped(0),
+	m_droppedReported(0),
+	m_draining(0),
+	m_handlers(false),
+	m_binLogLevel(LL_DEBUG),
+	m_binFd(-1),
+	m_pBinBuffer(NULL),
+	m_binLen(0),
+	m_binWrittenNs(0),
+	m_rotateSize(0),
+	m_rotateAgeMs(0),
+	m_generations(LOG_DEF_GENERATIONS),
+	m_fileSize(0),
+	m_fileOpenedMs(0),
+	m_binSize(0),
+	m_binOpenedMs(0),
+	m_rotateRequested(0),
+	m_rotateStop(false),
+	m_rotating(false),
+	m_recorder(false),
+	m_pRecRing(NULL),
+	m_recSize(0),
+	m_recHead(0),
+	m_recTail(0),
+	m_recDumped(0),
+	m_recLock(0),
+	m_dumpRequested(0),
+	m_dumpFd(-1),
+	m_dumpHandler(false) {
+	pthread_mutex_init(&m_lock, NULL);
+	pthread_cond_init(&m_wake, NULL);
+	pthread_mutex_init(&m_binLock, NULL);
+	pthread_mutex_init(&m_fileLock, NULL);
+	pthread_mutex_init(&m_rotateLock, NULL);
+	pthread_cond_init(&m_rotateWake, NULL);
+	m_logFileName[0] = '\0';
+	m_binFileName[0] = '\0';
+	RenderPrefixes();
+	UpdateEnabledLevel();
 }
 
 CLogger::~CLogger() {
+	StopRotation();
+	StopAsync();
 	CloseLogFile();
+	CloseBinaryLog();
+	StopFlightRecorder();
+	delete[] m_pRing;
+	m_pRing = NULL;
+	delete[] m_pBinBuffer;
+	m_pBinBuffer = NULL;
+	pthread_mutex_destroy(&m_lock);
+	pthread_cond_destroy(&m_wake);
+	pthread_mutex_destroy(&m_binLock);
+	pthread_mutex_destroy(&m_fileLock);
+	pthread_mutex_destroy(&m_rotateLock);
+	pthread_cond_destroy(&m_rotateWake);
 	m_pLogPrefix = NULL;
 	m_pThis = NULL;
 }
@@ -48,109 +137,933 @@ bool CLogger::OpenLogFile(const LogLevel loglvl, const char *fileName) {
 	}
 
 	// open file
-	if ((m_logFile = fopen(fileName, "w+")) == NULL) {
+	FILE *pFile;
+	if ((pFile = fopen(fileName, "w+")) == NULL) {
 		std::cerr << "Error: can not open file " << fileName << " for writing!" << std::endl;
 		return false;
 	}
 
+	// writer thread takes the file with the next batch
+	pthread_mutex_lock(&m_rotateLock);
+	strcpy(m_logFileName, fileName);
+	m_fileSize = 0;
+	m_fileOpenedMs = GetMonoTimeMSec();
+	LockDrain(0);
+	m_fileLogLevel = loglvl;
+	m_logFile = pFile;
+	UnlockDrain();
+	pthread_mutex_unlock(&m_rotateLock);
+	UpdateEnabledLevel();
+
 	return true;
 }
 
 bool CLogger::CloseLogFile() {
 	if (m_logFile == NULL) return false;
 
+	// queued messages go to the file first
+	Flush();
+
+	pthread_mutex_lock(&m_rotateLock);
+	LockDrain(0);
+	pthread_mutex_lock(&m_fileLock);
 	fclose(m_logFile);
 	m_logFile = NULL;
+	pthread_mutex_unlock(&m_fileLock);
+	UnlockDrain();
+	pthread_mutex_unlock(&m_rotateLock);
+	UpdateEnabledLevel();
 	return true;
 }
 
+void CLogger::SetSystemLogLevel(const LogLevel loglvl) {
+	m_systemLogLevel = loglvl;
+	UpdateEnabledLevel();
+}
+
+void CLogger::UpdateEnabledLevel() {
+	LogLevel level = m_systemLogLevel;
+	if ((m_logFile != NULL) && (m_fileLogLevel > level)) level = m_fileLogLevel;
+	if ((m_binFd >= 0) && (m_binLogLevel > level)) level = m_binLogLevel;
+	if (m_recorder) level = LL_DEBUG;
+	m_enabledLevel = level;
+}
+
 void CLogger::SetLogPrefix(const char *prefix) {
 	if (prefix != NULL) m_pLogPrefix = prefix;
+	RenderPrefixes();
+}
+
+void CLogger::RenderPrefixes() {
+	for (int level = 0; level < LL_COUNT; level++) {
+		int len = FormatLogPrefix(m_levelPrefix[level], LOG_PREFIX_LEN, m_pLogPrefix, level, NULL);
+		m_levelPrefixLen[level] = (len < 0) ? 0 : ((len >= LOG_PREFIX_LEN) ? LOG_PREFIX_LEN - 1 : len);
+	}
 }
 
 int CLogger::PrependPrefix(const LogLevel loglvl, char *pMsg) {
 	// check if pMsg is not null
 	if (pMsg == NULL) return 0;
 
-	struct tm timeinfo;
+	// prefix and level are rendered by SetLogPrefix()
+	int len = m_levelPrefixLen[loglvl];
+	memcpy(pMsg, m_levelPrefix[loglvl], len);
 
 	// check if time needs to be logged
-	if (m_logTime) {
-		// get actual time
-		time_t now = time(NULL);
-		// get localtime
-		localtime_r(&now, &timeinfo);
+	if (!m_logTime) return len;
 
-		return snprintf(pMsg, MAX_MSG_LEN, "[%s] %7s: %02d.%02d.%04d %02d:%02d:%02d : ",
-				m_pLogPrefix, LevelStr[loglvl],
-				timeinfo.tm_mday, timeinfo.tm_mon, timeinfo.tm_year + 1900,
-				timeinfo.tm_hour, timeinfo.tm_min, timeinfo.tm_sec);
+	// date and time are formatted only when the second changes
+	struct timespec now;
+	clock_gettime(CLOCK_REALTIME, &now);
+	SLogTimeCache &cache = t_timeCache;
+	if ((now.tv_sec != cache.sec) || !cache.len) {
+		struct tm timeinfo;
+		localtime_r(&now.tv_sec, &timeinfo);
+		cache.len = FormatLogTime(cache.text, sizeof(cache.text), &timeinfo, 0);
+		if ((cache.len < 6) || (cache.len >= (int)sizeof(cache.text))) {
+			cache.len = 0;
+			return len;
+		}
+		cache.sec = now.tv_sec;
 	}
-	return snprintf(pMsg, MAX_MSG_LEN, "[%s] %7s: ", m_pLogPrefix, LevelStr[loglvl]);
+	memcpy(pMsg + len, cache.text, cache.len);
+	len += cache.len;
 
+	// milliseconds are patched into "mmm : " at the end
+	unsigned msec = now.tv_nsec / 1000000;
+	pMsg[len - 6] = '0' + msec / 100;
+	pMsg[len - 5] = '0' + (msec / 10) % 10;
+	pMsg[len - 4] = '0' + msec % 10;
+	return len;
 }
 
-void CLogger::LogPuts(char *pOutput, size_t len) {
-	// append new line if enabled
-	if (m_appendNewLine) {
-		*(pOutput + len -1) = '\n';
-		*(pOutput + len) = '\0';
-	}
-
+void CLogger::LogPuts(const LogLevel loglvl, char *pOutput, size_t len) {
     // log message to file
-    if (m_logFile != NULL) {
-    	if (fwrite(pOutput, len, 1, m_logFile) == 1) {
-    		fflush(m_logFile);
-    	} else fprintf(stderr, "Error: failed to write to logfile!\n");
+    if ((m_logFile != NULL) && (loglvl <= m_fileLogLevel)) {
+    	// rotator thread swaps the file
+    	pthread_mutex_lock(&m_fileLock);
+    	if (m_logFile != NULL) {
+    		if (fwrite(pOutput, len, 1, m_logFile) == 1) {
+    			fflush(m_logFile);
+    			AddWritten(m_fileSize, len);
+    		} else fprintf(stderr, "Error: failed to write to logfile!\n");
+    	}
+    	pthread_mutex_unlock(&m_fileLock);
     }
 
     // log message to output
-    if (m_systemLogLevel != 0) {
-    	fprintf(stdout, "%s", pOutput);
+    if (loglvl <= m_systemLogLevel) {
+    	fwrite(pOutput, len, 1, stdout);
     	fflush(stdout);
     }
 }
 
 bool CLogger::LogPrintf(const LogLevel loglvl, const char *message, ...) {
-	if ((loglvl) && ((loglvl <= m_fileLogLevel) || (loglvl <= m_systemLogLevel))) {
-		int size;
-		int prefLen;
-		char *msg = NULL;
-
-		va_list args;
-		// format string with message
-		va_start(args, message);
-
-		// prepend time and prefix
-		if ((prefLen = PrependPrefix(loglvl, m_logBuffer)) == 0) {
-			std::cerr << "Error: can not prepend prefix to file!" << std::endl;
-			return false;
+	va_list args;
+	va_start(args, message);
+	bool result = LogVPrintf(NULL, loglvl, message, args);
+	va_end(args);
+	return result;
+}
+
+bool CLogger::LogPrintf(SLogSite &site, const LogLevel loglvl, const char *message, ...) {
+	va_list args;
+	va_start(args, message);
+	bool result = LogVPrintf(&site, loglvl, message, args);
+	va_end(args);
+	return result;
+}
+
+bool CLogger::LogVPrintf(SLogSite *pSite, const LogLevel loglvl, const char *message, va_list args) {
+	if (!loglvl || !IsEnabled(loglvl)) return true;
+
+	bool result = true;
+
+	// binary record reads its own copy of arguments, it is shared by binary log and flight recorder
+	bool binary = (m_binFd >= 0) && (loglvl <= m_binLogLevel);
+	if (binary || m_recorder) {
+		// aligned for record header
+		uint64_t record[LOG_BIN_MAX_RECORD / sizeof(uint64_t)];
+		va_list binArgs;
+		va_copy(binArgs, args);
+		size_t size = EncodeRecord(pSite, loglvl, message, binArgs, (char*)record);
+		va_end(binArgs);
+
+		if (!size) result = false;
+		else {
+			if (m_recorder) Record(loglvl, (const char*)record, size);
+			if (binary) result = AppendBinary(loglvl, (const char*)record, size);
+		}
+	}
+
+	// text is formatted only for sinks which log the level
+	if ((loglvl > m_systemLogLevel) && ((m_logFile == NULL) || (loglvl > m_fileLogLevel))) return result;
+
+	int size;
+	int prefLen;
+	char *pBuffer = t_logBuffer;
+
+	// prepend time and prefix
+	if ((prefLen = PrependPrefix(loglvl, pBuffer)) <= 0) {
+		std::cerr << "Error: can not prepend prefix to file!" << std::endl;
+		return false;
+	}
+
+	// format message behind prefix, arguments are read once
+	size = vsnprintf(pBuffer + prefLen, MAX_MSG_LEN - prefLen, message, args);
+
+	// check max size
+	if ((size < 0) || (size >= MAX_MSG_LEN - prefLen)) {
+		std::cerr << "Error: message is too long!" << std::endl;
+		return false;
+	}
+
+	// append new line if enabled
+	size_t len = prefLen + size;
+	if (m_appendNewLine) pBuffer[len++] = '\n';
+	pBuffer[len] = '\0';
+
+	// queue message for writer thread
+	if (m_async) return Enqueue(loglvl, pBuffer, len) && result;
+
+	// log message
+	LogPuts(loglvl, pBuffer, len);
+	return result;
+}
+
+bool CLogger::OpenBinaryLog(const LogLevel loglvl, const char *fileName) {
+	if (m_binFd >= 0) return false;
+
+	if (fileName == NULL || (strlen(fileName) >= MAX_FILE_PATH_LEN - 1)) {
+		std::cerr << "Error: binary log file path is missing or is too long!" << std::endl;
+		return false;
+	}
+
+	int fd = open(fileName, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (fd < 0) {
+		std::cerr << "Error: can not open file " << fileName << " for writing!" << std::endl;
+		return false;
+	}
+
+	WriteBinaryHeader(fd);
+
+	pthread_mutex_lock(&m_rotateLock);
+	strcpy(m_binFileName, fileName);
+	m_binSize = sizeof(SLogBinHeader);
+	m_binOpenedMs = GetMonoTimeMSec();
+	pthread_mutex_lock(&m_binLock);
+	if (m_pBinBuffer == NULL) m_pBinBuffer = new char[LOG_BIN_BUFFER_SIZE];
+	m_binLen = 0;
+	m_binWrittenNs = GetMonoTimeNSec();
+	m_binLogLevel = loglvl;
+	m_binFd = fd;
+	pthread_mutex_unlock(&m_binLock);
+	pthread_mutex_unlock(&m_rotateLock);
+
+	InstallHandlers();
+	UpdateEnabledLevel();
+	return true;
+}
+
+bool CLogger::CloseBinaryLog() {
+	if (m_binFd < 0) return false;
+
+	pthread_mutex_lock(&m_rotateLock);
+	pthread_mutex_lock(&m_binLock);
+	FlushBinary(true);
+	close(m_binFd);
+	m_binFd = -1;
+	pthread_mutex_unlock(&m_binLock);
+	pthread_mutex_unlock(&m_rotateLock);
+	UpdateEnabledLevel();
+	return true;
+}
+
+bool CLogger::WriteBinaryHeader(int fd) {
+	// header pairs monotonic time of records with wall clock
+	SLogBinHeader header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, LOG_BIN_MAGIC, LOG_BIN_MAGIC_LEN);
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	header.monoNs = GetMonoTimeNSec();
+	header.wallUs = (uint64_t)tv.tv_sec * 1000000ULL + tv.tv_usec;
+	strncpy(header.prefix, m_pLogPrefix, LOG_BIN_PREFIX_LEN);
+	return write(fd, &header, sizeof(header)) == sizeof(header);
+}
+
+// raw argument is appended when it fits into record
+template <typename T>
+static inline bool PutLogArg(char *&pArg, const char *pEnd, T value) {
+	if (pArg + sizeof(value) > pEnd) return false;
+	memcpy(pArg, &value, sizeof(value));
+	pArg += sizeof(value);
+	return true;
+}
+
+size_t CLogger::EncodeRecord(SLogSite *pSite, const LogLevel loglvl, const char *message, va_list args,
+		char *record) {
+	SLogBinRecord *pRecord = (SLogBinRecord*)record;
+	char *pArg = record + sizeof(SLogBinRecord);
+	const char *pEnd = record + LOG_BIN_MAX_RECORD;
+	bool raw = false;
+
+	// argument types are parsed by the first call of the site
+	if ((pSite != NULL) && !pSite->ready) {
+		const char *pFormat = message;
+		unsigned count = 0;
+		LogArgType type;
+		uint32_t id = LogFormatId(message);
+		while ((type = NextLogArg(&pFormat)) != LBA_NONE) {
+			if ((type == LBA_INVALID) || (count >= LOG_BIN_MAX_ARGS)) {
+				id = LOG_BIN_TEXT_ID;
+				break;
+			}
+			pSite->args[count++] = type;
+		}
+		pSite->argCount = count;
+		pSite->formatId = id;
+		pSite->pFormat = message;
+		__sync_synchronize();
+		pSite->ready = 1;
+	}
+
+	if ((pSite != NULL) && (pSite->formatId != LOG_BIN_TEXT_ID) && (pSite->pFormat == message)) {
+		va_list rawArgs;
+		va_copy(rawArgs, args);
+		raw = true;
+		for (unsigned i = 0; raw && (i < pSite->argCount); i++) {
+			switch (pSite->args[i]) {
+			case LBA_INT:
+				raw = PutLogArg(pArg, pEnd, (int32_t)va_arg(rawArgs, int));
+				break;
+			case LBA_LONG:
+				raw = PutLogArg(pArg, pEnd, (int64_t)va_arg(rawArgs, long));
+				break;
+			case LBA_LLONG:
+				raw = PutLogArg(pArg, pEnd, (int64_t)va_arg(rawArgs, long long));
+				break;
+			case LBA_SIZE:
+				raw = PutLogArg(pArg, pEnd, (uint64_t)va_arg(rawArgs, size_t));
+				break;
+			case LBA_DOUBLE:
+				raw = PutLogArg(pArg, pEnd, va_arg(rawArgs, double));
+				break;
+			case LBA_PTR:
+				raw = PutLogArg(pArg, pEnd, (uint64_t)(uintptr_t)va_arg(rawArgs, void*));
+				break;
+			case LBA_STRING: {
+				const char *pText = va_arg(rawArgs, const char*);
+				if (pText == NULL) pText = "(null)";
+				size_t len = strlen(pText);
+				raw = PutLogArg(pArg, pEnd, (uint16_t)len) && (pArg + len <= pEnd);
+				if (raw) {
+					memcpy(pArg, pText, len);
+					pArg += len;
+				}
+				break;
+			}
+			default:
+				raw = false;
+				break;
+			}
+		}
+		va_end(rawArgs);
+	}
+
+	if (raw) {
+		pRecord->formatId = pSite->formatId;
+	} else {
+		// not parsed format or too long arguments, message is recorded as formatted text
+		pArg = record + sizeof(SLogBinRecord);
+		int len = vsnprintf(pArg + sizeof(uint16_t), pEnd - pArg - sizeof(uint16_t), message, args);
+		if (len < 0) return 0;
+		if (len >= pEnd - pArg - (int)sizeof(uint16_t)) len = pEnd - pArg - sizeof(uint16_t) - 1;
+		PutLogArg(pArg, pEnd, (uint16_t)len);
+		pArg += len;
+		pRecord->formatId = LOG_BIN_TEXT_ID;
+	}
+
+	pRecord->level = loglvl;
+	pRecord->reserved = 0;
+	pRecord->argSize = pArg - record - sizeof(SLogBinRecord);
+	pRecord->monoNs = GetMonoTimeNSec();
+	return pArg - record;
+}
+
+bool CLogger::AppendBinary(const LogLevel loglvl, const char *record, size_t size) {
+	pthread_mutex_lock(&m_binLock);
+	if (m_binFd < 0) {
+		pthread_mutex_unlock(&m_binLock);
+		return false;
+	}
+	if (m_binLen + size > LOG_BIN_BUFFER_SIZE) FlushBinary(true);
+	memcpy(m_pBinBuffer + m_binLen, record, size);
+	m_binLen = m_binLen + size;
+	// errors are written at once, others at least every period
+	uint64_t monoNs = ((const SLogBinRecord*)record)->monoNs;
+	if ((loglvl <= LL_ERROR) || (monoNs - m_binWrittenNs >= LOG_FLUSH_PERIOD * 1000000ULL))
+		FlushBinary(true);
+	pthread_mutex_unlock(&m_binLock);
+	return true;
+}
+
+void CLogger::FlushBinary(bool locked) {
+	if (!locked) pthread_mutex_lock(&m_binLock);
+	if ((m_binFd >= 0) && m_binLen) {
+		WriteAll(m_binFd, m_pBinBuffer, m_binLen);
+		AddWritten(m_binSize, m_binLen);
+		m_binLen = 0;
+	}
+	m_binWrittenNs = GetMonoTimeNSec();
+	if (!locked) pthread_mutex_unlock(&m_binLock);
+}
+
+bool CLogger::StartAsync(unsigned ringSize, LogOverflow overflow) {
+	if (m_async) return false;
+
+	// ring size is rounded up to power of 2
+	unsigned size = 2;
+	while (size < ringSize) size <<= 1;
+
+	// ring is kept until the logger is destroyed, late producers can still hold a slot
+	if (size != m_ringSize) {
+		delete[] m_pRing;
+		m_pRing = new SLogSlot[size];
+		m_ringSize = size;
+	}
+	for (unsigned i = 0; i < size; i++) m_pRing[i].seq = i;
+	m_head = 0;
+	m_tail = 0;
+	m_overflow = overflow;
+	m_stop = false;
+
+	// synchronous output written so far goes before the batches
+	if (m_logFile != NULL) fflush(m_logFile);
+	fflush(stdout);
+
+	if (pthread_create(&m_writer, NULL, RunWriter, this) != 0) {
+		std::cerr << "Error: can not start log writer!" << std::endl;
+		return false;
+	}
+
+	InstallHandlers();
+	m_async = true;
+	return true;
+}
+
+void CLogger::InstallHandlers() {
+	if (m_handlers) return;
+
+	// queued messages survive exit() and fatal signals
+	atexit(AtExit);
+
+	struct sigaction action;
+	memset(&action, 0, sizeof(action));
+	action.sa_handler = FatalHandler;
+	action.sa_flags = SA_RESETHAND;
+	sigemptyset(&action.sa_mask);
+	for (size_t i = 0; i < sizeof(c_fatalSignals) / sizeof(c_fatalSignals[0]); i++)
+		sigaction(c_fatalSignals[i], &action, NULL);
+
+	m_handlers = true;
+}
+
+void CLogger::StopAsync() {
+	if (!m_async) return;
+
+	// new messages are written synchronously, writer drains the ring before it exits
+	m_async = false;
+	m_stop = true;
+	pthread_cond_signal(&m_wake);
+	pthread_join(m_writer, NULL);
+
+	// producers which have claimed a slot meanwhile
+	while (m_tail != m_head) {
+		if (!Drain(false)) usleep(LOG_BLOCK_WAIT);
+	}
+}
+
+void CLogger::Flush() {
+	if (m_binFd >= 0) FlushBinary(false);
+
+	if (!m_async) {
+		if (m_logFile != NULL) fflush(m_logFile);
+		fflush(stdout);
+		return;
+	}
+
+	// wait for writer thread
+	unsigned head = m_head;
+	while (m_async && ((int)(head - m_tail) > 0)) {
+		pthread_cond_signal(&m_wake);
+		usleep(LOG_BLOCK_WAIT);
+	}
+}
+
+bool CLogger::Enqueue(const LogLevel loglvl, const char *pText, size_t len) {
+	unsigned pos = m_head;
+	SLogSlot *pSlot;
+
+	// claim the next free slot
+	for (;;) {
+		pSlot = &m_pRing[pos & (m_ringSize - 1)];
+		unsigned seq = pSlot->seq;
+		__sync_synchronize();
+
+		int diff = (int)(seq - pos);
+		if (diff == 0) {
+			unsigned prev = __sync_val_compare_and_swap(&m_head, pos, pos + 1);
+			if (prev == pos) break;
+			pos = prev;
+		} else if (diff < 0) {
+			// ring is full
+			if ((m_overflow == LO_DROP) || m_stop) {
+				__sync_fetch_and_add(&m_dropped, 1);
+				return false;
+			}
+			pthread_cond_signal(&m_wake);
+			usleep(LOG_BLOCK_WAIT);
+			pos = m_head;
+		} else {
+			// slot was taken by other producer
+			pos = m_head;
 		}
+	}
+
+	memcpy(pSlot->text, pText, len);
+	pSlot->len = len;
+	pSlot->level = loglvl;
+	// publish message
+	__sync_synchronize();
+	pSlot->seq = pos + 1;
+
+	// errors and half full ring are written without waiting for period
+	if ((loglvl <= LL_ERROR) || (pos - m_tail >= m_ringSize / 2)) pthread_cond_signal(&m_wake);
+	return true;
+}
+
+bool CLogger::LockDrain(unsigned spins) {
+	// fatal handler can not wait for crashed writer, 0 = wait
+	for (unsigned i = 0; __sync_lock_test_and_set(&m_draining, 1); i++) {
+		if (spins && (i >= spins)) return false;
+		if (!spins) usleep(LOG_BLOCK_WAIT);
+	}
+	return true;
+}
+
+void CLogger::UnlockDrain() {
+	__sync_lock_release(&m_draining);
+}
+
+size_t CLogger::Drain(bool fatal) {
+	char fileBatch[LOG_BATCH_SIZE];
+	char outBatch[LOG_BATCH_SIZE];
+	size_t fileLen = 0, outLen = 0;
+	size_t count = 0;
+
+	if (m_pRing == NULL) return 0;
+
+	// single consumer, fatal handler does not wait long for crashed writer
+	bool locked = LockDrain(fatal ? 100000 : 0);
+	int fileFd = (m_logFile != NULL) ? fileno(m_logFile) : -1;
+
+	for (;;) {
+		SLogSlot &slot = m_pRing[m_tail & (m_ringSize - 1)];
+		// empty or still being written
+		if (slot.seq != m_tail + 1) break;
+		__sync_synchronize();
+
+		// batches are written when the next message does not fit
+		if ((fileFd >= 0) && (slot.level <= m_fileLogLevel)) {
+			if (fileLen + slot.len > sizeof(fileBatch)) {
+				WriteAll(fileFd, fileBatch, fileLen);
+				AddWritten(m_fileSize, fileLen);
+				fileLen = 0;
+			}
+			memcpy(fileBatch + fileLen, slot.text, slot.len);
+			fileLen += slot.len;
+		}
+		if (slot.level <= m_systemLogLevel) {
+			if (outLen + slot.len > sizeof(outBatch)) {
+				WriteAll(STDOUT_FILENO, outBatch, outLen);
+				outLen = 0;
+			}
+			memcpy(outBatch + outLen, slot.text, slot.len);
+			outLen += slot.len;
+		}
+
+		// release slot for the next round
+		__sync_synchronize();
+		slot.seq = m_tail + m_ringSize;
+		m_tail = m_tail + 1;
+		count++;
+	}
+
+	// report drops once per batch
+	unsigned dropped = m_dropped;
+	if (!fatal && (dropped != m_droppedReported)) {
+		char text[MAX_MSG_LEN];
+		int len = snprintf(text, sizeof(text), "[%s] %7s: %u log messages were dropped\n", m_pLogPrefix,
+				LevelStr[LL_WARNING], dropped - m_droppedReported);
+		m_droppedReported = dropped;
+		if (fileFd >= 0) WriteAll(fileFd, text, len);
+		WriteAll(STDOUT_FILENO, text, len);
+	}
+
+	if (fileLen) {
+		WriteAll(fileFd, fileBatch, fileLen);
+		AddWritten(m_fileSize, fileLen);
+	}
+	if (outLen) WriteAll(STDOUT_FILENO, outBatch, outLen);
+
+	if (locked) UnlockDrain();
+	return count;
+}
+
+void* CLogger::RunWriter(void *pArg) {
+	((CLogger*)pArg)->WriterLoop();
+	return NULL;
+}
+
+void CLogger::WriterLoop() {
+	while (!m_stop) {
+		if (Drain(false)) continue;
+
+		// quiet binary log is not left in buffer
+		if ((m_binFd >= 0) && m_binLen) FlushBinary(false);
+		// dump requested by error message or signal
+		if (m_dumpRequested) DumpFlightRecorder();
+
+		// wait for period, producers wake writer for errors and half full ring
+		struct timespec deadline;
+		clock_gettime(CLOCK_REALTIME, &deadline);
+		deadline.tv_nsec += LOG_FLUSH_PERIOD * 1000000L;
+		deadline.tv_sec += deadline.tv_nsec / 1000000000L;
+		deadline.tv_nsec %= 1000000000L;
+
+		pthread_mutex_lock(&m_lock);
+		if (!m_stop) pthread_cond_timedwait(&m_wake, &m_lock, &deadline);
+		pthread_mutex_unlock(&m_lock);
+	}
+
+	// flush on shutdown
+	while (Drain(false)) ;
+}
+
+void CLogger::AtExit() {
+	if (m_pThis == NULL) return;
+	m_pThis->StopAsync();
+	if (m_pThis->m_binFd >= 0) m_pThis->FlushBinary(false);
+}
+
+void CLogger::FatalHandler(int sig) {
+	// only write(), no locks, handler was reset to default action
+	if (m_pThis != NULL) {
+		if (m_pThis->m_recorder) {
+			// crashed thread may hold the ring, it is dumped anyway
+			bool locked = m_pThis->LockRecorder(LOG_RECORDER_SPINS);
+			m_pThis->DumpRecorder();
+			if (locked) m_pThis->UnlockRecorder();
+		}
+		if (m_pThis->m_async) m_pThis->Drain(true);
+		if ((m_pThis->m_binFd >= 0) && m_pThis->m_binLen)
+			WriteAll(m_pThis->m_binFd, m_pThis->m_pBinBuffer, m_pThis->m_binLen);
+	}
+	raise(sig);
+}
+
+bool CLogger::SetLogRotation(size_t maxSize, unsigned maxAge, unsigned generations) {
+	if (generations > LOG_MAX_GENERATIONS) return false;
+
+	pthread_mutex_lock(&m_rotateLock);
+	m_rotateSize = maxSize;
+	m_rotateAgeMs = (uint64_t)maxAge * 1000;
+	m_generations = generations;
+	pthread_mutex_unlock(&m_rotateLock);
+
+	if (!maxSize && !maxAge) {
+		StopRotation();
+		return true;
+	}
+	if (m_rotating) {
+		pthread_cond_signal(&m_rotateWake);
+		return true;
+	}
+
+	m_rotateStop = false;
+	if (pthread_create(&m_rotator, NULL, RunRotator, this) != 0) {
+		std::cerr << "Error: can not start log rotator!" << std::endl;
+		return false;
+	}
+	m_rotating = true;
+	return true;
+}
+
+void CLogger::StopRotation() {
+	if (!m_rotating) return;
+
+	pthread_mutex_lock(&m_rotateLock);
+	m_rotateStop = true;
+	pthread_cond_signal(&m_rotateWake);
+	pthread_mutex_unlock(&m_rotateLock);
+	pthread_join(m_rotator, NULL);
+	m_rotating = false;
+}
+
+void CLogger::AddWritten(volatile size_t &written, size_t len) {
+	// rotation is requested once, rotator thread renames the file
+	size_t size = __sync_add_and_fetch(&written, len);
+	if (m_rotateSize && (size >= m_rotateSize) && __sync_bool_compare_and_swap(&m_rotateRequested, 0, 1))
+		pthread_cond_signal(&m_rotateWake);
+}
+
+void CLogger::RotateGenerations(const char *fileName) {
+	char from[MAX_FILE_PATH_LEN + 4];
+	char to[MAX_FILE_PATH_LEN + 4];
+
+	// the oldest generation is removed, others are shifted by one
+	if (!m_generations) {
+		unlink(fileName);
+		return;
+	}
+	snprintf(to, sizeof(to), "%s.%u", fileName, m_generations);
+	unlink(to);
+	for (unsigned i = m_generations - 1; i > 0; i--) {
+		snprintf(from, sizeof(from), "%s.%u", fileName, i);
+		rename(from, to);
+		strcpy(to, from);
+	}
+	if (rename(fileName, to) != 0) fprintf(stderr, "Error: can not rename log file %s!\n", fileName);
+}
+
+void CLogger::RotateLogFile() {
+	// messages keep going to renamed file until the new one is swapped in
+	RotateGenerations(m_logFileName);
+	FILE *pFile = fopen(m_logFileName, "w+");
+	if (pFile == NULL) {
+		fprintf(stderr, "Error: can not open file %s for writing!\n", m_logFileName);
+		m_fileSize = 0;
+		m_fileOpenedMs = GetMonoTimeMSec();
+		return;
+	}
 
-		// get formated string length
-		size = vsnprintf(NULL, 0, message, args) + 1;
-		// check max size
-		if (size > (MAX_MSG_LEN - prefLen + 1)) {
-			std::cerr << "Error: message is too long!" << std::endl;
-			return false;
+	LockDrain(0);
+	pthread_mutex_lock(&m_fileLock);
+	FILE *pOld = m_logFile;
+	m_logFile = pFile;
+	m_fileSize = 0;
+	m_fileOpenedMs = GetMonoTimeMSec();
+	pthread_mutex_unlock(&m_fileLock);
+	UnlockDrain();
+	fclose(pOld);
+}
+
+void CLogger::RotateBinaryLog() {
+	RotateGenerations(m_binFileName);
+	int fd = open(m_binFileName, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if ((fd < 0) || !WriteBinaryHeader(fd)) {
+		fprintf(stderr, "Error: can not open file %s for writing!\n", m_binFileName);
+		if (fd >= 0) close(fd);
+		m_binSize = 0;
+		m_binOpenedMs = GetMonoTimeMSec();
+		return;
+	}
+
+	// buffered records belong to the old file
+	pthread_mutex_lock(&m_binLock);
+	FlushBinary(true);
+	int oldFd = m_binFd;
+	m_binFd = fd;
+	m_binSize = sizeof(SLogBinHeader);
+	m_binOpenedMs = GetMonoTimeMSec();
+	pthread_mutex_unlock(&m_binLock);
+	close(oldFd);
+}
+
+void* CLogger::RunRotator(void *pArg) {
+	((CLogger*)pArg)->RotatorLoop();
+	return NULL;
+}
+
+void CLogger::RotatorLoop() {
+	pthread_mutex_lock(&m_rotateLock);
+	while (!m_rotateStop) {
+		uint64_t now = GetMonoTimeMSec();
+		bool rotated = false;
+
+		// producers only signal, renames and opens are done here
+		if ((m_logFile != NULL) && ((m_rotateSize && (m_fileSize >= m_rotateSize)) ||
+				(m_rotateAgeMs && (now - m_fileOpenedMs >= m_rotateAgeMs)))) {
+			RotateLogFile();
+			rotated = true;
 		}
+		if ((m_binFd >= 0) && ((m_rotateSize && (m_binSize >= m_rotateSize)) ||
+				(m_rotateAgeMs && (now - m_binOpenedMs >= m_rotateAgeMs)))) {
+			RotateBinaryLog();
+			rotated = true;
+		}
+		m_rotateRequested = 0;
+		if (rotated) continue;
+
+		// missed signal is caught by the next check
+		struct timespec deadline;
+		clock_gettime(CLOCK_REALTIME, &deadline);
+		deadline.tv_nsec += LOG_ROTATE_CHECK * 1000000L;
+		deadline.tv_sec += deadline.tv_nsec / 1000000000L;
+		deadline.tv_nsec %= 1000000000L;
+		pthread_cond_timedwait(&m_rotateWake, &m_rotateLock, &deadline);
+	}
+	pthread_mutex_unlock(&m_rotateLock);
+}
+
+bool CLogger::StartFlightRecorder(const char *dumpFile, size_t ringSize) {
+	if (m_recorder) return false;
 
-		// allocate new size
-		msg = new char[size];
+	if (dumpFile == NULL || (strlen(dumpFile) >= MAX_FILE_PATH_LEN - 1)) {
+		std::cerr << "Error: flight recorder dump path is missing or is too long!" << std::endl;
+		return false;
+	}
 
-		// format message
-		size = vsnprintf(msg, size, message, args);
-		va_end(args);
+	// ring size is rounded up to power of 2, it holds at least two records
+	size_t size = 2 * LOG_BIN_MAX_RECORD;
+	while (size < ringSize) size <<= 1;
 
-		// append message to output buffer
-		strcat(m_logBuffer, msg);
+	// file is rotated and opened here, rotation uses snprintf() and stdio which signal handlers must not call
+	if (access(dumpFile, F_OK) == 0) RotateGenerations(dumpFile);
+	int fd = open(dumpFile, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if ((fd < 0) || !WriteBinaryHeader(fd)) {
+		std::cerr << "Error: can not create flight recorder dump " << dumpFile << "!" << std::endl;
+		if (fd >= 0) close(fd);
+		return false;
+	}
 
-		// clean new buffer
-		free(msg);
-		msg = NULL;
+	LockRecorder(0);
+	if (size != m_recSize) {
+		delete[] m_pRecRing;
+		m_pRecRing = new char[size];
+		m_recSize = size;
+	}
+	m_recHead = 0;
+	m_recTail = 0;
+	m_recDumped = 0;
+	m_dumpRequested = 0;
+	if (m_dumpFd >= 0) close(m_dumpFd);
+	m_dumpFd = fd;
+	UnlockRecorder();
 
-		// log message
-		LogPuts(m_logBuffer, prefLen + size + 1);
+	InstallHandlers();
+	if (!m_dumpHandler) {
+		struct sigaction action;
+		memset(&action, 0, sizeof(action));
+		action.sa_handler = DumpHandler;
+		action.sa_flags = SA_RESTART;
+		sigemptyset(&action.sa_mask);
+		sigaction(SIGUSR1, &action, NULL);
+		m_dumpHandler = true;
 	}
+
+	m_recorder = true;
+	UpdateEnabledLevel();
 	return true;
 }
+
+void CLogger::StopFlightRecorder() {
+	if (!m_recorder) return;
+
+	m_recorder = false;
+	UpdateEnabledLevel();
+
+	// ring is kept for the next start, late producers can still hold it
+	LockRecorder(0);
+	if (m_dumpFd >= 0) close(m_dumpFd);
+	m_dumpFd = -1;
+	UnlockRecorder();
+}
+
+void CLogger::DumpFlightRecorder() {
+	LockRecorder(0);
+	m_dumpRequested = 0;
+	DumpRecorder();
+	UnlockRecorder();
+}
+
+bool CLogger::LockRecorder(unsigned spins) {
+	// signal handlers do not wait long for interrupted thread, 0 = wait
+	for (unsigned i = 0; __sync_lock_test_and_set(&m_recLock, 1); i++) {
+		if (spins && (i >= spins)) return false;
+		if (!spins) sched_yield();
+	}
+	return true;
+}
+
+void CLogger::UnlockRecorder() {
+	__sync_lock_release(&m_recLock);
+}
+
+void CLogger::Record(const LogLevel loglvl, const char *record, size_t size) {
+	LockRecorder(0);
+	if (!m_recorder || (m_pRecRing == NULL)) {
+		UnlockRecorder();
+		return;
+	}
+
+	// the oldest records are overwritten
+	size_t mask = m_recSize - 1;
+	while (m_recHead + size - m_recTail > m_recSize) {
+		SLogBinRecord oldest;
+		size_t pos = m_recTail & mask;
+		size_t first = std::min(sizeof(oldest), m_recSize - pos);
+		memcpy(&oldest, m_pRecRing + pos, first);
+		memcpy((char*)&oldest + first, m_pRecRing, sizeof(oldest) - first);
+		m_recTail += sizeof(oldest) + oldest.argSize;
+	}
+
+	size_t pos = m_recHead & mask;
+	size_t first = std::min(size, m_recSize - pos);
+	memcpy(m_pRecRing + pos, record, first);
+	memcpy(m_pRecRing, record + first, size - first);
+	m_recHead += size;
+
+	// errors are dumped at once, by writer thread in asynchronous mode
+	if (loglvl <= LL_ERROR) m_dumpRequested = 1;
+	bool wake = false;
+	if (m_dumpRequested) {
+		if (m_async) wake = true;
+		else {
+			m_dumpRequested = 0;
+			DumpRecorder();
+		}
+	}
+	UnlockRecorder();
+
+	if (wake) pthread_cond_signal(&m_wake);
+}
+
+void CLogger::DumpRecorder() {
+	// only write() into file opened by StartFlightRecorder(), called from signal handlers
+	if ((m_pRecRing == NULL) || (m_dumpFd < 0)) return;
+
+	// records of previous dumps are not repeated
+	uint64_t from = (m_recDumped > m_recTail) ? m_recDumped : m_recTail;
+	size_t len = m_recHead - from;
+	size_t pos = from & (m_recSize - 1);
+	size_t first = std::min(len, m_recSize - pos);
+	WriteAll(m_dumpFd, m_pRecRing + pos, first);
+	if (len > first) WriteAll(m_dumpFd, m_pRecRing, len - first);
+	m_recDumped = m_recHead;
+}
+
+void CLogger::DumpHandler(int) {
+	if ((m_pThis == NULL) || !m_pThis->m_recorder) return;
+
+	// interrupted thread may hold the ring, writer thread or the next message dumps then
+	int err = errno;
+	m_pThis->m_dumpRequested = 1;
+	if (!m_pThis->m_async && m_pThis->LockRecorder(1)) {
+		m_pThis->m_dumpRequested = 0;
+		m_pThis->DumpRecorder();
+		m_pThis->UnlockRecorder();
+	}
+	errno = err;
+}
@@ -2,6 +2,10 @@
 #define LOGGER_H_
 
 #include <stdio.h>
+#include <stdarg.h>
+#include <pthread.h>
+
+#include "logfmt.h"
 
 typedef enum LogLevel {
 	LL_OFF = 0, // turn off logging
@@ -13,13 +17,71 @@ typedef enum LogLevel {
 	LL_COUNT
 } LogLevel;
 
+// handling of full message ring in asynchronous mode
+typedef enum LogOverflow {
+	LO_DROP = 0,	// message is dropped and counted
+	LO_BLOCK,		// producer waits for free slot
+	LO_COUNT
+} LogOverflow;
+
 // max length of logged massage
 #define MAX_MSG_LEN 		200
 // max length of logged file path
 #define MAX_FILE_PATH_LEN 	250
 
+// default count of queued messages in asynchronous mode, power of 2
+#define LOG_DEF_RING_SIZE	256
+// max delay of queued message [ms]
+#define LOG_FLUSH_PERIOD	100
+// bytes written to sink by one call
+#define LOG_BATCH_SIZE		4096
+// sleep of blocked producer [us]
+#define LOG_BLOCK_WAIT		500
+// max length of "[prefix]   level: " part of line
+#define LOG_PREFIX_LEN		64
+// max length of time part of line
+#define LOG_TIME_LEN		32
+
+// default count of rotated log files, log.1 is the newest
+#define LOG_DEF_GENERATIONS	5
+#define LOG_MAX_GENERATIONS	99
+// period of log age check [ms]
+#define LOG_ROTATE_CHECK	1000
+
+// default size of flight recorder ring [B], power of 2
+#define LOG_DEF_RECORDER_SIZE	(256 * 1024)
+// attempts of signal handler to take flight recorder from interrupted thread
+#define LOG_RECORDER_SPINS	100000
+
 #define LOGGER CLogger::GetLogger()
 
+// calls above this level compile to nothing, e.g. -DLOG_COMPILE_LEVEL=LL_INFO
+#ifndef LOG_COMPILE_LEVEL
+#define LOG_COMPILE_LEVEL LL_DEBUG
+#endif
+
+// arguments are evaluated only when the level is logged,
+// format must be string literal, its ID is recorded by binary log
+#define LOG_PRINTF(loglvl, ...) \
+	do { \
+		if (((loglvl) <= LOG_COMPILE_LEVEL) && CLogger::IsEnabled(loglvl)) { \
+			static SLogSite s_logSite; \
+			CLogger::GetLogger()->LogPrintf(s_logSite, (loglvl), __VA_ARGS__); \
+		} \
+	} while (0)
+#define LOG_ERROR(...)		LOG_PRINTF(LL_ERROR, __VA_ARGS__)
+#define LOG_WARNING(...)	LOG_PRINTF(LL_WARNING, __VA_ARGS__)
+#define LOG_INFO(...)		LOG_PRINTF(LL_INFO, __VA_ARGS__)
+#define LOG_DEBUG(...)		LOG_PRINTF(LL_DEBUG, __VA_ARGS__)
+
+// formatted message waiting for writer thread
+struct SLogSlot {
+	volatile unsigned seq;	// position + 1 when ready, position + ring size when free
+	LogLevel level;
+	unsigned len;
+	char text[MAX_MSG_LEN + 2];
+};
+
 class CLogger {
 public:
 	static CLogger* GetLogger();
@@ -29,29 +91,149 @@ public:
 	bool CloseLogFile();
 
 	bool LogPrintf(const LogLevel loglvl, const char *message, ...);
+	bool LogPrintf(SLogSite &site, const LogLevel loglvl, const char *message, ...);
+	// the most verbose level logged by any sink, checked before arguments are evaluated
+	static inline bool IsEnabled(const LogLevel loglvl) { return loglvl <= m_enabledLevel; }
+	void SetSystemLogLevel(const LogLevel loglvl);
 
 	void SetLogPrefix(const char *prefix);
 	inline void SetNewLineAppend(bool enable) { m_appendNewLine = enable; }
 
+	// messages are queued into lock-free ring and written in batches by background thread,
+	// queued messages are written on StopAsync(), exit and fatal signal
+	bool StartAsync(unsigned ringSize = LOG_DEF_RING_SIZE, LogOverflow overflow = LO_DROP);
+	void StopAsync();
+	inline bool IsAsync() { return m_async; }
+	// wait until all queued messages are written
+	void Flush();
+
+	// format ID, monotonic time and raw arguments are recorded without formatting,
+	// the stream is converted to text by log-decode tool
+	bool OpenBinaryLog(const LogLevel loglvl, const char *fileName);
+	bool CloseBinaryLog();
+
+	// log file and binary log are renamed to <name>.1 .. <name>.<generations> when they
+	// reach maxSize [B] or maxAge [s], 0 = no limit, files are renamed by background thread
+	bool SetLogRotation(size_t maxSize, unsigned maxAge, unsigned generations = LOG_DEF_GENERATIONS);
+
+	// flight recorder keeps binary records of all messages down to LL_DEBUG in memory ring,
+	// records not dumped yet are appended to dumpFile on error message, fatal signal, SIGUSR1
+	// or DumpFlightRecorder(), dumpFile is created here and dump of previous run is kept as rotated generation
+	bool StartFlightRecorder(const char *dumpFile, size_t ringSize = LOG_DEF_RECORDER_SIZE);
+	void StopFlightRecorder();
+	inline bool IsRecording() { return m_recorder; }
+	void DumpFlightRecorder();
+	// messages dropped on full ring
+	inline unsigned GetDropped() { return m_dropped; }
+
 private:
 	CLogger();
 	CLogger(CLogger const& copy); // not implemented
 	CLogger& operator=(CLogger const& copy); // not implemented
 
 	int PrependPrefix(const LogLevel loglvl, char *pMsg);
+	void RenderPrefixes();
+	void UpdateEnabledLevel();
+	void InstallHandlers();
+
+	bool LogVPrintf(SLogSite *pSite, const LogLevel loglvl, const char *message, va_list args);
+	size_t EncodeRecord(SLogSite *pSite, const LogLevel loglvl, const char *message, va_list args, char *record);
+	bool AppendBinary(const LogLevel loglvl, const char *record, size_t size);
+	void FlushBinary(bool locked);
+	bool WriteBinaryHeader(int fd);
+
+	void AddWritten(volatile size_t &written, size_t len);
+	void RotateGenerations(const char *fileName);
+	void RotateLogFile();
+	void RotateBinaryLog();
+	void StopRotation();
+	static void* RunRotator(void *pArg);
+	void RotatorLoop();
+
+	void Record(const LogLevel loglvl, const char *record, size_t size);
+	bool LockRecorder(unsigned spins);
+	void UnlockRecorder();
+	void DumpRecorder();
+	static void DumpHandler(int sig);
+
+	bool Enqueue(const LogLevel loglvl, const char *pText, size_t len);
+	size_t Drain(bool fatal);
+	bool LockDrain(unsigned spins);
+	void UnlockDrain();
+	static void* RunWriter(void *pArg);
+	void WriterLoop();
+	static void AtExit();
+	static void FatalHandler(int sig);
 
 protected:
-	void LogPuts(char *pOutput, size_t len);
+	void LogPuts(const LogLevel loglvl, char *pOutput, size_t len);
 
 private:
 	static CLogger* m_pThis;
+	static volatile LogLevel m_enabledLevel;
 	enum LogLevel m_systemLogLevel;
 	enum LogLevel m_fileLogLevel;
 	FILE *m_logFile;
 	bool m_logTime;
 	bool m_appendNewLine;
 	const char *m_pLogPrefix;
-	static char m_logBuffer[MAX_MSG_LEN];
+	char m_levelPrefix[LL_COUNT][LOG_PREFIX_LEN];
+	int m_levelPrefixLen[LL_COUNT];
+	char m_logFileName[MAX_FILE_PATH_LEN];
+	pthread_mutex_t m_fileLock;
+
+	// asynchronous mode
+	volatile bool m_async;
+	volatile bool m_stop;
+	LogOverflow m_overflow;
+	SLogSlot *m_pRing;
+	unsigned m_ringSize;
+	volatile unsigned m_head;
+	volatile unsigned m_tail;
+	volatile unsigned m_dropped;
+	unsigned m_droppedReported;
+	volatile int m_draining;
+	bool m_handlers;
+	pthread_t m_writer;
+	pthread_mutex_t m_lock;
+	pthread_cond_t m_wake;
+
+	// binary log
+	enum LogLevel m_binLogLevel;
+	int m_binFd;
+	char *m_pBinBuffer;
+	volatile size_t m_binLen;
+	uint64_t m_binWrittenNs;
+	pthread_mutex_t m_binLock;
+	char m_binFileName[MAX_FILE_PATH_LEN];
+
+	// rotation
+	size_t m_rotateSize;
+	uint64_t m_rotateAgeMs;
+	unsigned m_generations;
+	volatile size_t m_fileSize;
+	uint64_t m_fileOpenedMs;
+	volatile size_t m_binSize;
+	uint64_t m_binOpenedMs;
+	volatile int m_rotateRequested;
+	volatile bool m_rotateStop;
+	bool m_rotating;
+	pthread_t m_rotator;
+	pthread_mutex_t m_rotateLock;
+	pthread_cond_t m_rotateWake;
+
+	// flight recorder
+	volatile bool m_recorder;
+	char *m_pRecRing;
+	size_t m_recSize;
+	uint64_t m_recHead;
+	uint64_t m_recTail;
+	uint64_t m_recDumped;
+	volatile int m_recLock;
+	volatile int m_dumpRequested;
+	// open while recording, signal handlers only write into it
+	int m_dumpFd;
+	bool m_dumpHandler;
 };
 
 #endif // LOGGER_H_
@@ -0,0 +1,241 @@
+#include "common.h"
+#include "logger.h"
+#include <sys/types.h>
+
+#include "storage.h"
+#include "mjpeg.h"
+
+// padding of frame chunks
+static const unsigned char c_pad[MJPEG_ALIGN] = { 0 };
+
+static size_t PadSize(size_t size) {
+    return (MJPEG_ALIGN - size % MJPEG_ALIGN) % MJPEG_ALIGN;
+}
+
+CMjpegWriter::CMjpegWriter() :
+    m_pFile(NULL),
+    m_size(0) {
+}
+
+CMjpegWriter::~CMjpegWriter() {
+    Close();
+}
+
+bool CMjpegWriter::Open(const std::string &path, uint64_t preallocate) {
+    Close();
+
+    // never append into an existing container
+    if ((m_pFile = fopen(path.c_str(), "wbx")) == NULL) {
+        LOG_ERROR("can not create container %s!", path.c_str());
+        return false;
+    }
+
+    if (fwrite(MJPEG_MAGIC, MJPEG_MAGIC_LEN, 1, m_pFile) != 1) {
+        LOG_ERROR("can not write container header!");
+        fclose(m_pFile);
+        m_pFile = NULL;
+        return false;
+    }
+
+    // container grows in continuous blocks, file size is kept
+    CStorageManager::Preallocate(fileno(m_pFile), preallocate, true);
+
+    m_path = path;
+    m_size = MJPEG_MAGIC_LEN;
+    m_index.clear();
+
+    LOG_DEBUG("container %s was created", path.c_str());
+    return true;
+}
+
+bool CMjpegWriter::Write(const unsigned char *pData, size_t size, uint64_t timeMs) {
+    if (m_pFile == NULL) {
+        LOG_ERROR("container is not open!");
+        return false;
+    }
+
+    SMjpegChunk chunk;
+    chunk.tag = MJPEG_FRAME_TAG;
+    chunk.size = size;
+    chunk.timeMs = timeMs;
+
+    size_t pad = PadSize(size);
+    bool ok = (fwrite(&chunk, sizeof(chunk), 1, m_pFile) == 1) && (!size || (fwrite(pData, size, 1, m_pFile) == 1)) &&
+            (!pad || (fwrite(c_pad, pad, 1, m_pFile) == 1));
+
+    // chunk is visible to readers, fsync is left to Close()
+    if (fflush(m_pFile) != 0) ok = false;
+
+    if (!ok) {
+        LOG_ERROR("can not append frame to %s!", m_path.c_str());
+        // drop partial chunk, next write continues on the chunk boundary
+        if (fseeko(m_pFile, m_size, SEEK_SET) == 0) (void)ftruncate(fileno(m_pFile), m_size);
+        return false;
+    }
+
+    SMjpegIndex entry;
+    entry.timeMs = timeMs;
+    entry.offset = m_size + sizeof(chunk);
+    entry.size = size;
+    entry.reserved = 0;
+    m_index.push_back(entry);
+
+    m_size += sizeof(chunk) + size + pad;
+    return true;
+}
+
+bool CMjpegWriter::Close() {
+    if (m_pFile == NULL) return true;
+
+    SMjpegFooter footer;
+    footer.indexOffset = m_size;
+    footer.count = m_index.size();
+    footer.tag = MJPEG_INDEX_TAG;
+
+    // index trailer, unused preallocated blocks and the only fsync of the container
+    bool ok = (m_index.empty() || (fwrite(&m_index[0], sizeof(SMjpegIndex) * m_index.size(), 1, m_pFile) == 1)) &&
+            (fwrite(&footer, sizeof(footer), 1, m_pFile) == 1) && (fflush(m_pFile) == 0) &&
+            (ftruncate(fileno(m_pFile), ftello(m_pFile)) == 0) && (fsync(fileno(m_pFile)) == 0);
+    if (fclose(m_pFile) != 0) ok = false;
+    m_pFile = NULL;
+
+    if (!ok) {
+        LOG_ERROR("can not write index of %s!", m_path.c_str());
+        return false;
+    }
+    m_size = footer.indexOffset + sizeof(SMjpegIndex) * m_index.size() + sizeof(footer);
+
+    LOG_DEBUG("container %s was closed with %u frames", m_path.c_str(),
+            (unsigned)m_index.size());
+    m_index.clear();
+    return true;
+}
+
+CMjpegReader::CMjpegReader() :
+    m_pFile(NULL),
+    m_recovered(false) {
+}
+
+CMjpegReader::~CMjpegReader() {
+    Close();
+}
+
+bool CMjpegReader::Open(const std::string &path) {
+    char magic[MJPEG_MAGIC_LEN];
+
+    Close();
+
+    if ((m_pFile = fopen(path.c_str(), "rb")) == NULL) {
+        LOG_ERROR("can not open container %s!", path.c_str());
+        return false;
+    }
+
+    // check header
+    if ((fread(magic, sizeof(magic), 1, m_pFile) != 1) || memcmp(magic, MJPEG_MAGIC, MJPEG_MAGIC_LEN)) {
+        LOG_ERROR("%s is not a picture container!", path.c_str());
+        Close();
+        return false;
+    }
+
+    fseeko(m_pFile, 0, SEEK_END);
+    uint64_t fileSize = ftello(m_pFile);
+
+    // trailer is missing when writer was not closed
+    if (!LoadIndex(fileSize)) {
+        LOG_WARNING("container %s has no index, scanning frames", path.c_str());
+        if (!ScanChunks(fileSize)) {
+            Close();
+            return false;
+        }
+        m_recovered = true;
+    }
+
+    return true;
+}
+
+void CMjpegReader::Close() {
+    if (m_pFile != NULL) fclose(m_pFile);
+    m_pFile = NULL;
+    m_recovered = false;
+    m_index.clear();
+}
+
+bool CMjpegReader::LoadIndex(uint64_t fileSize) {
+    SMjpegFooter footer;
+
+    if (fileSize < MJPEG_MAGIC_LEN + sizeof(footer)) return false;
+
+    if ((fseeko(m_pFile, fileSize - sizeof(footer), SEEK_SET) != 0) || (fread(&footer, sizeof(footer), 1, m_pFile) != 1))
+        return false;
+
+    // footer has to point exactly in front of itself
+    if ((footer.tag != MJPEG_INDEX_TAG) ||
+            (footer.indexOffset + (uint64_t)footer.count * sizeof(SMjpegIndex) + sizeof(footer) != fileSize))
+        return false;
+
+    m_index.resize(footer.count);
+    if (!footer.count) return true;
+
+    if ((fseeko(m_pFile, footer.indexOffset, SEEK_SET) != 0) ||
+            (fread(&m_index[0], sizeof(SMjpegIndex) * footer.count, 1, m_pFile) != 1)) {
+        m_index.clear();
+        return false;
+    }
+
+    return true;
+}
+
+bool CMjpegReader::ScanChunks(uint64_t fileSize) {
+    SMjpegChunk chunk;
+    uint64_t offset = MJPEG_MAGIC_LEN;
+
+    m_index.clear();
+
+    // walk chunks until the first torn one
+    while (offset + sizeof(chunk) <= fileSize) {
+        if ((fseeko(m_pFile, offset, SEEK_SET) != 0) || (fread(&chunk, sizeof(chunk), 1, m_pFile) != 1)) break;
+        if ((chunk.tag != MJPEG_FRAME_TAG) || (offset + sizeof(chunk) + chunk.size > fileSize)) break;
+
+        SMjpegIndex entry;
+        entry.timeMs = chunk.timeMs;
+        entry.offset = offset + sizeof(chunk);
+        entry.size = chunk.size;
+        entry.reserved = 0;
+        m_index.push_back(entry);
+
+        offset += sizeof(chunk) + chunk.size + PadSize(chunk.size);
+    }
+
+    return true;
+}
+
+size_t CMjpegReader::Find(uint64_t timeMs) {
+    size_t lo = 0, hi = m_index.size();
+
+    // binary search, frames are appended in time order
+    while (lo < hi) {
+        size_t mid = (lo + hi) / 2;
+        if (m_index[mid].timeMs <= timeMs) lo = mid + 1;
+        else hi = mid;
+    }
+
+    return lo ? lo - 1 : 0;
+}
+
+bool CMjpegReader::Read(size_t idx, std::vector<unsigned char> &data) {
+    if ((m_pFile == NULL) || (idx >= m_index.size())) {
+        LOG_ERROR("frame %u does not exist!", (unsigned)idx);
+        return false;
+    }
+
+    const SMjpegIndex &entry = m_index[idx];
+    data.resize(entry.size);
+
+    if ((fseeko(m_pFile, entry.offset, SEEK_SET) != 0) ||
+            (entry.size && (fread(&data[0], entry.size, 1, m_pFile) != 1))) {
+        LOG_ERROR("can not read frame %u!", (unsigned)idx);
+        return false;
+    }
+
+    return true;
+}
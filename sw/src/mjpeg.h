@@ -0,0 +1,99 @@
+#ifndef MJPEG_H_
+#define MJPEG_H_
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+// Timelapse container of JPEG frames. AVI is not written directly because it keeps
+// no capture time of frames (only a fixed rate), its idx1 and RIFF sizes are known
+// only after the last frame and 32 bit sizes limit the rotation size. Every chunk
+// here carries its wall clock time and the index of a torn container is rebuilt by
+// scanning chunks. "mjpeg-tool avi" converts a container into MJPEG AVI for players.
+
+// file header of timelapse container
+#define MJPEG_MAGIC "CAMMJPG1"
+#define MJPEG_MAGIC_LEN 8
+// tag of frame chunk, "FRAM"
+#define MJPEG_FRAME_TAG 0x4d415246
+// tag of index footer, "MIDX"
+#define MJPEG_INDEX_TAG 0x5844494d
+// frame chunks are aligned in the file
+#define MJPEG_ALIGN 8
+
+// header of every frame chunk, followed by JPEG data
+struct SMjpegChunk {
+    uint32_t tag;
+    uint32_t size;      // JPEG size without padding
+    uint64_t timeMs;    // wall clock capture time [ms]
+};
+
+// index trailer entry
+struct SMjpegIndex {
+    uint64_t timeMs;
+    uint64_t offset;    // offset of JPEG data in the file
+    uint32_t size;
+    uint32_t reserved;
+};
+
+// last bytes of closed container
+struct SMjpegFooter {
+    uint64_t indexOffset;
+    uint32_t count;
+    uint32_t tag;
+};
+
+// appends frames into one container, index trailer is written by Close()
+class CMjpegWriter {
+public:
+    CMjpegWriter();
+    ~CMjpegWriter();
+
+    // preallocated blocks (e.g. rotation size) are released by Close()
+    bool Open(const std::string &path, uint64_t preallocate = 0);
+    bool Write(const unsigned char *pData, size_t size, uint64_t timeMs);
+    bool Close();
+
+    inline bool IsOpen() { return m_pFile != NULL; }
+    // size of written frames, whole file size after Close()
+    inline uint64_t GetSize() { return m_size; }
+    inline size_t GetCount() { return m_index.size(); }
+    inline uint64_t GetStartTime() { return m_index.empty() ? 0 : m_index[0].timeMs; }
+
+private:
+    FILE *m_pFile;
+    std::string m_path;
+    uint64_t m_size;
+    std::vector<SMjpegIndex> m_index;
+};
+
+// random access to frames through the index
+class CMjpegReader {
+public:
+    CMjpegReader();
+    ~CMjpegReader();
+
+    // container without trailer (e.g. after power loss) is indexed by scanning chunks
+    bool Open(const std::string &path);
+    void Close();
+
+    inline size_t GetCount() { return m_index.size(); }
+    inline const SMjpegIndex& GetEntry(size_t idx) { return m_index[idx]; }
+    inline bool IsRecovered() { return m_recovered; }
+
+    // the last frame taken at or before given time, the first one if all are newer
+    size_t Find(uint64_t timeMs);
+    bool Read(size_t idx, std::vector<unsigned char> &data);
+
+private:
+    bool LoadIndex(uint64_t fileSize);
+    bool ScanChunks(uint64_t fileSize);
+
+private:
+    FILE *m_pFile;
+    bool m_recovered;
+    std::vector<SMjpegIndex> m_index;
+};
+
+#endif // MJPEG_H_
@@ -0,0 +1,72 @@
+#include "common.h"
+#include "logger.h"
+#include <algorithm>
+
+#include "framesource.h"
+#include "imgproc.h"
+#include "motion.h"
+
+CMotionDetector::CMotionDetector() :
+    m_pixelDiff(MOTION_DEF_PIXEL_DIFF),
+    m_minBlocks(MOTION_DEF_BLOCKS),
+    m_changed(0),
+    m_blocks(0) {
+}
+
+CMotionDetector::~CMotionDetector() {
+    m_ref.release();
+    m_act.release();
+}
+
+void CMotionDetector::SetThresholds(unsigned pixelDiff, unsigned blocks) {
+    m_pixelDiff = pixelDiff;
+    m_minBlocks = blocks ? blocks : 1;
+}
+
+void CMotionDetector::Reset() {
+    m_ref.release();
+    m_changed = 0;
+    m_blocks = 0;
+}
+
+bool CMotionDetector::Process(const cv::Mat &frame, PixelFormat format) {
+    // only BGR and I420 frames are supported
+    if (!CheckFrame(frame, format)) {
+        LOG_ERROR("motion detector needs BGR or YUV420 frame!");
+        return true;
+    }
+
+    // downscale into reused buffer, Y plane of I420 is used as it is
+    cv::Size size = GetFrameSize(frame, format);
+    m_act.create(size.height / MOTION_SCALE, size.width / MOTION_SCALE, CV_8UC1);
+    DownscaleLuma(frame.data, size.width, size.height, frame.step, MOTION_SCALE, m_act.data, m_act.step,
+            frame.channels());
+
+    // the first frame or changed resolution is always accepted
+    if ((m_ref.rows != m_act.rows) || (m_ref.cols != m_act.cols)) {
+        m_act.copyTo(m_ref);
+        m_blocks = (m_act.rows / MOTION_BLOCK) * (m_act.cols / MOTION_BLOCK);
+        m_changed = m_blocks;
+        return true;
+    }
+
+    unsigned limit = m_pixelDiff * MOTION_BLOCK * MOTION_BLOCK;
+    m_changed = 0;
+    m_blocks = 0;
+
+    // count blocks with mean difference over threshold
+    for (int y = 0; y + MOTION_BLOCK <= m_act.rows; y += MOTION_BLOCK) {
+        for (int x = 0; x + MOTION_BLOCK <= m_act.cols; x += MOTION_BLOCK) {
+            unsigned sad = BlockSAD(m_act.ptr<unsigned char>(y) + x, m_ref.ptr<unsigned char>(y) + x,
+                    m_act.step, MOTION_BLOCK, MOTION_BLOCK);
+            if (sad > limit) m_changed++;
+            m_blocks++;
+        }
+    }
+
+    if (m_changed < m_minBlocks) return false;
+
+    // accepted frame becomes the new reference
+    std::swap(m_ref, m_act);
+    return true;
+}
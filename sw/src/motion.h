@@ -0,0 +1,43 @@
+#ifndef MOTION_H_
+#define MOTION_H_
+
+#include <opencv2/core.hpp>
+
+#include "framesource.h"
+
+// downscale factor of analysed luma image
+#define MOTION_SCALE 4
+// block size in downscaled image
+#define MOTION_BLOCK 16
+// default mean absolute difference of changed block
+#define MOTION_DEF_PIXEL_DIFF 12
+// default count of changed blocks for motion
+#define MOTION_DEF_BLOCKS 2
+
+// frame difference detector on downscaled greyscale image
+class CMotionDetector {
+public:
+    CMotionDetector();
+    ~CMotionDetector();
+
+    void SetThresholds(unsigned pixelDiff, unsigned blocks);
+
+    // compare frame with reference, reference follows accepted frames
+    bool Process(const cv::Mat &frame, PixelFormat format);
+    void Reset();
+
+    inline unsigned GetChangedBlocks() { return m_changed; }
+    inline unsigned GetBlockCount() { return m_blocks; }
+    // changed blocks ratio of the last processed frame
+    inline float GetScore() { return m_blocks ? (float)m_changed / m_blocks : 0; }
+
+private:
+    cv::Mat m_ref;
+    cv::Mat m_act;
+    unsigned m_pixelDiff;
+    unsigned m_minBlocks;
+    unsigned m_changed;
+    unsigned m_blocks;
+};
+
+#endif // MOTION_H_
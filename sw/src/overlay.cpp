@@ -0,0 +1,114 @@
+#include "common.h"
+#include "logger.h"
+#include <algorithm>
+
+#include <opencv2/imgproc.hpp>
+
+#include "overlay.h"
+
+COverlay::COverlay() :
+    m_ascent(0),
+    m_height(0),
+    m_initialized(false) {
+    memset(m_advance, 0, sizeof(m_advance));
+}
+
+COverlay::~COverlay() {
+    for (int i = 0; i < OVERLAY_CHAR_COUNT; i++) m_glyphs[i].release();
+}
+
+bool COverlay::Init(int font, double scale, int thickness) {
+    int baseline = 0;
+    char str[2] = { 0, 0 };
+
+    // common line metrics, all glyphs share one ascent
+    cv::Size line = cv::getTextSize("Ag|", font, scale, thickness, &baseline);
+    m_ascent = line.height + thickness;
+    m_height = m_ascent + baseline + thickness;
+
+    // rasterise every glyph with antialiasing into its own alpha mask
+    for (int i = 0; i < OVERLAY_CHAR_COUNT; i++) {
+        str[0] = (char)(OVERLAY_FIRST_CHAR + i);
+
+        cv::Size size = cv::getTextSize(str, font, scale, thickness, &baseline);
+        m_advance[i] = size.width;
+
+        m_glyphs[i].create(m_height, size.width + thickness * 2, CV_8UC1);
+        m_glyphs[i].setTo(cv::Scalar::all(0));
+        cv::putText(m_glyphs[i], str, cv::Point(thickness, m_ascent), font, scale,
+                cv::Scalar::all(255), thickness, cv::LINE_AA);
+    }
+
+    m_initialized = true;
+    LOG_DEBUG("overlay glyphs were cached, line height %i", m_height);
+
+    return true;
+}
+
+cv::Size COverlay::GetTextSize(const std::string &text) {
+    int width = 0;
+
+    for (std::string::size_type i = 0; i < text.size(); i++) {
+        int idx = (unsigned char)text[i] - OVERLAY_FIRST_CHAR;
+        if ((idx >= 0) && (idx < OVERLAY_CHAR_COUNT)) width += m_advance[idx];
+    }
+
+    return cv::Size(width, m_height);
+}
+
+void COverlay::Stamp(cv::Mat &image, const std::string &text, const cv::Point &org, const cv::Scalar &color) {
+    // check initialization
+    if (!m_initialized) {
+        LOG_ERROR("overlay is not initialized!");
+        return;
+    }
+
+    // only 8-bit images with 1 or 3 channels are supported
+    if ((image.depth() != CV_8U) || ((image.channels() != 1) && (image.channels() != 3))) {
+        LOG_ERROR("overlay image format is not supported!");
+        return;
+    }
+
+    unsigned char c[3] = {
+        cv::saturate_cast<unsigned char>(color[0]),
+        cv::saturate_cast<unsigned char>(color[1]),
+        cv::saturate_cast<unsigned char>(color[2])
+    };
+
+    // org is baseline start as in cv::putText
+    int x = org.x;
+    int y = org.y - m_ascent;
+
+    for (std::string::size_type i = 0; i < text.size(); i++) {
+        int idx = (unsigned char)text[i] - OVERLAY_FIRST_CHAR;
+        // skip characters out of cached range
+        if ((idx < 0) || (idx >= OVERLAY_CHAR_COUNT)) continue;
+
+        Blit(image, m_glyphs[idx], x, y, c);
+        x += m_advance[idx];
+    }
+}
+
+void COverlay::Blit(cv::Mat &image, const cv::Mat &alpha, int x0, int y0, const unsigned char *pColor) {
+    int cn = image.channels();
+
+    // clip glyph to image
+    int gx0 = std::max(0, -x0);
+    int gy0 = std::max(0, -y0);
+    int gx1 = std::min(alpha.cols, image.cols - x0);
+    int gy1 = std::min(alpha.rows, image.rows - y0);
+
+    for (int gy = gy0; gy < gy1; gy++) {
+        const unsigned char *pA = alpha.ptr<unsigned char>(gy);
+        unsigned char *pDst = image.ptr<unsigned char>(y0 + gy) + (x0 + gx0) * cn;
+
+        for (int gx = gx0; gx < gx1; gx++, pDst += cn) {
+            unsigned a = pA[gx];
+            if (!a) continue;
+
+            // dst += (color - dst) * alpha
+            for (int ch = 0; ch < cn; ch++)
+                pDst[ch] = (unsigned char)((pDst[ch] * (255 - a) + pColor[ch] * a + 127) / 255);
+        }
+    }
+}
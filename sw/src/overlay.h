@@ -0,0 +1,42 @@
+#ifndef OVERLAY_H_
+#define OVERLAY_H_
+
+#include <string>
+#include <opencv2/core.hpp>
+
+// cached character range
+#define OVERLAY_FIRST_CHAR ' '
+#define OVERLAY_LAST_CHAR '~'
+#define OVERLAY_CHAR_COUNT (OVERLAY_LAST_CHAR - OVERLAY_FIRST_CHAR + 1)
+
+// text stamped into the next picture
+struct SOverlayText {
+    std::string text;
+    cv::Point invCoord; // distance of text origin from bottom-right corner
+    cv::Scalar color;
+};
+
+// text stamping from glyphs rasterised once into alpha masks
+class COverlay {
+public:
+    COverlay();
+    ~COverlay();
+
+    bool Init(int font, double scale = 1.0, int thickness = 1);
+    inline bool IsInitialized() { return m_initialized; }
+
+    cv::Size GetTextSize(const std::string &text);
+    void Stamp(cv::Mat &image, const std::string &text, const cv::Point &org, const cv::Scalar &color);
+
+private:
+    void Blit(cv::Mat &image, const cv::Mat &alpha, int x0, int y0, const unsigned char *pColor);
+
+private:
+    cv::Mat m_glyphs[OVERLAY_CHAR_COUNT];   // alpha masks, top at ascent above baseline
+    int m_advance[OVERLAY_CHAR_COUNT];
+    int m_ascent;
+    int m_height;
+    bool m_initialized;
+};
+
+#endif // OVERLAY_H_
@@ -1,21 +1,30 @@
 #include "common.h"
 #include "logger.h"
+#include <strings.h>
 #include <sys/stat.h>
+#include <algorithm>
 
 #include <opencv2/imgproc.hpp>
+#include <opencv2/highgui.hpp>
 
+#include "imgproc.h"
 #include "picture.h"
 
 CCamera::CCamera() {
 	m_connected = false;
-	m_pRaspiCam = NULL;
+	m_pSource = NULL;
+	m_format = DEF_PIXEL_FORMAT;
+	m_frameSize = cv::Size(FRAME_WIDTH, FRAME_HEIGHT);
+	m_region = cv::Rect2f(0, 0, 1, 1);
+	m_warmUpMode = DEF_WARMUP_MODE;
+	m_stackFrames = 1;
 	m_ID.clear();
 }
 
 CCamera::~CCamera() {
 	Disconnect();
-	if (m_pRaspiCam) delete m_pRaspiCam;
-	m_pRaspiCam = NULL;
+	if (m_pSource) delete m_pSource;
+	m_pSource = NULL;
 	m_ID.clear();
 }
 
@@ -24,8 +33,8 @@ bool CCamera::Connect() {
 	m_connected = true;
 
 	// connect to camera
-	if (!m_pRaspiCam->open()) {
-		CLogger::GetLogger()->LogPrintf(LL_ERROR, "can not open camera!");
+	if (!m_pSource->Open()) {
+		LOG_ERROR("can not open camera!");
 		m_connected = false;
 	}
 
@@ -37,89 +46,334 @@ void CCamera::Disconnect() {
 	m_connected = false;
 
 	// disconnect
-	m_pRaspiCam->release();
+	m_pSource->Release();
 }
 
-bool CCamera::Init() {
-	m_pRaspiCam = new raspicam::RaspiCam_Cv;
+bool CCamera::Init(CFrameSource *pSource, PixelFormat format) {
+	// use camera module if no other source is given
+	if (pSource == NULL) {
+#ifdef HAVE_RASPICAM
+		pSource = new CRaspiCamSource;
+#else
+		LOG_WARNING("built without raspicam, using synthetic frames");
+		pSource = new CSyntheticSource;
+#endif
+	}
+	m_pSource = pSource;
+
+	//set camera parameters
+	if (!m_pSource->SetFormat(FRAME_WIDTH, FRAME_HEIGHT, format)) {
+		LOG_ERROR("can not set camera format!");
+		return false;
+	}
+	m_format = format;
+	m_frameSize = cv::Size(FRAME_WIDTH, FRAME_HEIGHT);
+
+	// get camera ID
+	m_ID = m_pSource->GetId();
+	LOG_DEBUG("camera ID: %s", m_ID.c_str());
+	if (m_format == PF_I420) LOG_DEBUG("frame format: YUV420");
+	else LOG_DEBUG("channel swap: %s", SwapRBImplName());
 
+	return true;
+}
+
+bool CCamera::SetRegion(const cv::Rect2f &roi, const cv::Size &size) {
 	// check initialization
-	if (m_pRaspiCam == NULL) {
-		CLogger::GetLogger()->LogPrintf(LL_ERROR, "RaspiCam is not initialization failed!");
+	if (m_pSource == NULL) {
+		LOG_ERROR("camera is not initialized!");
 		return false;
 	}
 
-    //set camera parameters
-    m_pRaspiCam->set(CV_CAP_PROP_FORMAT, CV_8UC3); // color
-    m_pRaspiCam->set(CV_CAP_PROP_FRAME_WIDTH, FRAME_WIDTH); // width
-    m_pRaspiCam->set(CV_CAP_PROP_FRAME_HEIGHT, FRAME_HEIGHT); // height
+	// check region
+	if ((roi.x < 0) || (roi.y < 0) || (roi.width <= 0) || (roi.height <= 0) ||
+		(roi.x + roi.width > 1.0f) || (roi.y + roi.height > 1.0f) || (size.width < 2) || (size.height < 2) ||
+		(size.width > FRAME_MAX_WIDTH) || (size.height > FRAME_MAX_HEIGHT)) {
+		LOG_ERROR("region of interest is not valid!");
+		return false;
+	}
 
-	// get camera ID
-	m_ID = m_pRaspiCam->getId();
-	CLogger::GetLogger()->LogPrintf(LL_DEBUG, "RaspiCam ID: %s", m_ID.c_str());
+	// format can be changed only on closed camera, stream would get frames of another size
+	if (m_connected) {
+		LOG_ERROR("region can not be changed while camera is connected!");
+		return false;
+	}
+
+	// even size keeps I420 planes aligned
+	cv::Size frameSize(size.width & ~1, size.height & ~1);
+	cv::Rect crop;
+
+	// camera crops and scales the region itself
+	if (!m_pSource->SetCrop(roi)) {
+		m_pSource->SetCrop(cv::Rect2f(0, 0, 1, 1));
+
+		// whole view is scaled so that the region gets requested size, up to sensor resolution
+		double width = size.width / roi.width;
+		double height = size.height / roi.height;
+		double scale = std::min(1.0, std::min(FRAME_MAX_WIDTH / width, FRAME_MAX_HEIGHT / height));
+		frameSize.width = std::max(2, (int)(width * scale) & ~1);
+		frameSize.height = std::max(2, (int)(height * scale) & ~1);
+		crop.x = cvRound(roi.x * frameSize.width) & ~1;
+		crop.y = cvRound(roi.y * frameSize.height) & ~1;
+		crop.width = std::min(cvRound(size.width * scale) & ~1, frameSize.width - crop.x);
+		crop.height = std::min(cvRound(size.height * scale) & ~1, frameSize.height - crop.y);
+		if ((crop.width < 2) || (crop.height < 2)) {
+			LOG_ERROR("region of interest is too small!");
+			return false;
+		}
+		if (scale < 1.0)
+			LOG_WARNING("region is delivered in %ix%i, camera can not scale view over %ix%i", crop.width, crop.height,
+				FRAME_MAX_WIDTH, FRAME_MAX_HEIGHT);
+	}
+
+	if (!m_pSource->SetFormat(frameSize.width, frameSize.height, m_format)) {
+		LOG_ERROR("can not set camera format!");
+		return false;
+	}
+
+	m_region = roi;
+	m_frameSize = frameSize;
+	m_crop = crop;
+
+	LOG_DEBUG("camera delivers %ix%i, software crop %ix%i", frameSize.width,
+		frameSize.height, crop.width, crop.height);
+
+	return true;
+}
+
+bool CCamera::CropFrame(const cv::Mat &frame, PixelFormat format, const cv::Rect &cropReq, cv::Mat &out) {
+	// camera can deliver other size than requested
+	cv::Size size = ::GetFrameSize(frame, format);
+	cv::Rect crop = cropReq & cv::Rect(0, 0, size.width & ~1, size.height & ~1);
+	crop.width &= ~1;
+	crop.height &= ~1;
+	if (!crop.area()) {
+		LOG_ERROR("crop is out of %ix%i frame!", size.width, size.height);
+		return false;
+	}
+
+	if (format != PF_I420) {
+		// view into the frame
+		out = frame(crop);
+		return true;
+	}
+
+	CreateFrame(out, crop.width, crop.height, format);
+
+	// Y plane
+	cv::Mat outY = out.rowRange(0, crop.height);
+	frame.rowRange(0, size.height)(crop).copyTo(outY);
+
+	// U and V planes with half crop
+	cv::Rect cropC(crop.x / 2, crop.y / 2, crop.width / 2, crop.height / 2);
+	for (int i = 0; i < 2; i++) {
+		cv::Mat srcC(size.height / 2, size.width / 2, CV_8UC1, frame.data + size.area() + i * size.area() / 4);
+		cv::Mat dstC(cropC.height, cropC.width, CV_8UC1, out.data + crop.area() + i * crop.area() / 4);
+		srcC(cropC).copyTo(dstC);
+	}
 
 	return true;
 }
 
-bool CCamera::Capture(cv::Mat &outImage, int count) {
+bool CCamera::Capture(cv::Mat &outImage, int count, ColorSwap swap) {
 	// check output image
 	if (&outImage == NULL) {
-		CLogger::GetLogger()->LogPrintf(LL_ERROR, "output image is null!");
+		LOG_ERROR("output image is null!");
 		return false;
 	}
 
 	if (!m_connected) {
-		CLogger::GetLogger()->LogPrintf(LL_ERROR, "camera is not open!");
+		LOG_ERROR("camera is not open!");
 		return false;
 	}
 
+	int lastLuma = -1;
+	int stable = 0;
+	// streamed single frames are never stacked
+	bool stacking = (m_stackFrames > 1) && (count > 1);
+
+	// the last frames of fixed burst are stacked
+	if (stacking && (m_warmUpMode != WU_CONVERGE)) count = std::max(1, count - (int)m_stackFrames + 1);
+
 	// take images
 	for (int i = 1; i <= count; i++) {
 		// grab the next frame from camera
-		if (!m_pRaspiCam->grab()) {
-			CLogger::GetLogger()->LogPrintf(LL_ERROR, "can not grab frame from camera!");
+		if (!m_pSource->Grab()) {
+			LOG_ERROR("can not grab frame from camera!");
 			return false;
 		}
+
+		// skip decoding of warm-up frame
+		if ((m_warmUpMode == WU_GRAB_ONLY) && (i < count)) continue;
+
 		// decode grabbed frame
-		m_pRaspiCam->retrieve(outImage);
+		if (!m_pSource->Retrieve(outImage)) {
+			LOG_ERROR("can not decode frame from camera!");
+			return false;
+		}
 
 		if ((i%10) == 0)
-			CLogger::GetLogger()->LogPrintf(LL_DEBUG, "%i frames were taken", i);
+			LOG_DEBUG("%i frames were taken", i);
+
+		// check if exposure has converged
+		if ((m_warmUpMode == WU_CONVERGE) && (i < count)) {
+			// Y plane of I420 frame is sampled directly
+			bool planar = (m_format == PF_I420);
+			cv::Size size = ::GetFrameSize(outImage, m_format);
+			int luma = LumaGridMean(outImage.data, size.width, size.height, outImage.step, WARMUP_GRID_STEP,
+				planar ? 1 : 3);
+
+			// count stable frames
+			if ((lastLuma >= 0) && (abs(luma - lastLuma) <= WARMUP_LUMA_DELTA)) stable++;
+			else stable = 0;
+			lastLuma = luma;
+
+			// last decoded frame is the captured one
+			if ((i >= WARMUP_MIN_FRAMES) && (stable >= WARMUP_STABLE_FRAMES)) {
+				LOG_DEBUG("exposure converged after %i frames (luma %i)", i, luma);
+				break;
+			}
+		}
 	}
 
-	cv::Mat channels[3];
-	// split image into channels
-	cv::split(outImage, channels);
-	// reverse red and blue channels
-	std::swap(channels[0], channels[2]);
-	// merge swapped channels back into image
-	cv::merge(channels, 3, outImage);
+	// average following frames into the captured one
+	if (stacking && !StackFrames(outImage, m_stackFrames - 1)) return false;
+
+	// reverse red and blue channels, planar YUV is left as it is
+	SwapChannels(outImage, swap);
 
 	return true;
 }
 
-CPicture::CPicture() {
+bool CCamera::SetStacking(unsigned frames, unsigned rejectDiff) {
+	if (!frames || (frames > STACK_MAX_FRAMES)) {
+		LOG_ERROR("can not stack %u frames!", frames);
+		return false;
+	}
+
+	m_stackFrames = frames;
+	m_stacker.SetRejectDiff(rejectDiff);
+	return true;
+}
+
+bool CCamera::StackFrames(cv::Mat &image, unsigned frames) {
+	if (!m_stacker.Begin(image, m_format)) return false;
+
+	for (unsigned i = 0; i < frames; i++) {
+		// frame buffer is reused between captures
+		if (!m_pSource->Grab() || !m_pSource->Retrieve(m_stackFrame)) {
+			LOG_ERROR("can not get frame to stack!");
+			m_stacker.Finish();
+			return false;
+		}
+
+		if (!m_stacker.Add(m_stackFrame)) break;
+	}
+
+	m_stacker.Finish();
+	LOG_DEBUG("%u frames were stacked, %u/%u blocks moved", m_stacker.GetFrameCount(),
+		m_stacker.GetRejected(), m_stacker.GetBlockCount() * (m_stacker.GetFrameCount() - 1));
+
+	return true;
+}
+
+void CCamera::SwapChannels(cv::Mat &image, ColorSwap swap) {
+	// only 3-channel images can be swapped
+	if (image.empty() || image.type() != CV_8UC3) return;
+
+	switch (swap) {
+	case CS_SPLIT: {
+		cv::Mat channels[3];
+		// split image into channels
+		cv::split(image, channels);
+		// reverse red and blue channels
+		std::swap(channels[0], channels[2]);
+		// merge swapped channels back into image
+		cv::merge(channels, 3, image);
+		break;
+	}
+	case CS_SCALAR:
+	case CS_SIMD:
+		// swap whole buffer at once if possible
+		if (image.isContinuous()) {
+			if (swap == CS_SIMD) SwapRB(image.data, image.total());
+			else SwapRBScalar(image.data, image.total());
+			break;
+		}
+		// swap row by row
+		for (int r = 0; r < image.rows; r++) {
+			if (swap == CS_SIMD) SwapRB(image.ptr<unsigned char>(r), image.cols);
+			else SwapRBScalar(image.ptr<unsigned char>(r), image.cols);
+		}
+		break;
+	default:
+		break;
+	}
+}
+
+CPicture::CPicture() :
+	m_encodeTasks(PIPE_MAX_OUTPUTS),
+	m_encodeDone(PIPE_MAX_OUTPUTS) {
 	m_pCamera = NULL;
+	m_pStream = NULL;
+	m_pPipeline = NULL;
+	m_pSink = NULL;
 	m_pImage = NULL;
 	m_picPath.clear();
+	m_previewIdx = 0;
+	m_helperCount = 0;
+	m_jpegParams = m_encoders[0].GetParams();
+	m_motionGate = false;
+	m_uplinkDelta = false;
+	m_skipped = false;
+	m_exif = true;
+	m_qualityMode = QG_OFF;
+	m_qualityRetries = QUALITY_DEF_RETRIES;
+	memset(&m_meta, 0, sizeof(m_meta));
+	m_meta.motion = -1;
+	m_meta.sharpness = -1;
+	m_meta.luma = -1;
+	// evicted pictures are dropped from index
+	m_storage.SetEvictCallback(OnEvict, this);
 }
 
 CPicture::~CPicture() {
-	m_pCamera->Disconnect();
-	delete m_pCamera;
+	StopPipeline();
+	StopStreaming();
+
+	// encoder helpers
+	m_encodeTasks.Close();
+	for (unsigned i = 0; i < m_helperCount; i++) pthread_join(m_encodeHelpers[i], NULL);
+	m_helperCount = 0;
+
+	if (m_pCamera != NULL) {
+		m_pCamera->Disconnect();
+		delete m_pCamera;
+	}
 	m_pCamera = NULL;
 
-	m_pImage->release();
-	delete m_pImage;
+	if (m_pImage != NULL) {
+		m_pImage->release();
+		delete m_pImage;
+	}
 	m_pImage = NULL;
 
+	// finish open containers
+	if (m_pSink != NULL) {
+		m_pSink->Close();
+		delete m_pSink;
+	}
+	m_pSink = NULL;
+	m_storage.Stop();
+	m_index.Close();
+
 	m_picPath.clear();
 }
 
-bool CPicture::Init(const std::string &outpuPath, bool useCamera) {
+bool CPicture::Init(const std::string &outpuPath, bool useCamera, CFrameSource *pSource, PixelFormat format) {
 	// check if output path for pictures is not null
 	if (!outpuPath.size()) {
-		CLogger::GetLogger()->LogPrintf(LL_ERROR, "output path for pictures is null!");
+		LOG_ERROR("output path for pictures is null!");
 		return false;
 	}
 
@@ -127,14 +381,14 @@ bool CPicture::Init(const std::string &outpuPath, bool useCamera) {
 	if (access(outpuPath.c_str(), F_OK) < 0) {
 		// create new directory
 		if (mkdir(outpuPath.c_str(), S_IRWXU | S_IRWXG | S_IROTH | S_IXOTH) < 0) {
-			CLogger::GetLogger()->LogPrintf(LL_ERROR, "can not create path %s!", outpuPath.c_str());
+			LOG_ERROR("can not create path %s!", outpuPath.c_str());
 			return false;
 		}
 	}
 
 	// check if directory is writable
 	if (access(outpuPath.c_str(), W_OK) < 0) {
-		CLogger::GetLogger()->LogPrintf(LL_ERROR, "path %s is not writable!", outpuPath.c_str());
+		LOG_ERROR("path %s is not writable!", outpuPath.c_str());
 		return false;
 	}
 
@@ -142,17 +396,38 @@ bool CPicture::Init(const std::string &outpuPath, bool useCamera) {
 	if (useCamera) {
 		// init camera
 		m_pCamera = new CCamera();
-		if (!m_pCamera->Init()) {
-			CLogger::GetLogger()->LogPrintf(LL_ERROR, "camera was not initialized!");
+		if (!m_pCamera->Init(pSource, format)) {
+			LOG_ERROR("camera was not initialized!");
 			return false;
 		}
 
-		CLogger::GetLogger()->LogPrintf(LL_DEBUG, "camera was successfully initialized");
-	} else CLogger::GetLogger()->LogPrintf(LL_DEBUG, "camera was not used");
+		LOG_DEBUG("camera was successfully initialized");
+	} else LOG_DEBUG("camera was not used");
 
 	// set output path
 	m_picPath = outpuPath;
 
+	// time and sensor index of stored pictures, pictures are stored without it
+	// opened before storage, whose eviction removes records
+	if (!m_index.Open(m_picPath + INDEX_FILE))
+		LOG_WARNING("pictures will not be indexed");
+
+	// quota set before Init()
+	if (m_storage.HasQuota() && !m_storage.Start(m_picPath)) {
+		LOG_ERROR("can not start storage manager!");
+		return false;
+	}
+
+	// one file per picture by default
+	if (m_pSink == NULL) m_pSink = new CFileSink();
+	if (!m_pSink->Init(m_picPath)) {
+		LOG_ERROR("can not init picture output!");
+		return false;
+	}
+	m_pSink->SetStorage(m_storage.IsRunning() ? &m_storage : NULL);
+
+	// rasterise overlay glyphs
+	m_overlay.Init(cv::FONT_HERSHEY_COMPLEX_SMALL, 1.0);
 
 	return true;
 }
@@ -160,71 +435,678 @@ bool CPicture::Init(const std::string &outpuPath, bool useCamera) {
 bool CPicture::TakePicture(const std::string &fileName) {
 	// check if output file name for picture is not null
 	if (!fileName.size()) {
-		CLogger::GetLogger()->LogPrintf(LL_ERROR, "filename for picture is null!");
+		LOG_ERROR("filename for picture is null!");
 		return false;
 	}
 
 	// check initialization
 	if (m_pCamera == NULL) {
-		CLogger::GetLogger()->LogPrintf(LL_ERROR, "camera is not initialized!");
+		LOG_ERROR("camera is not initialized!");
 		return false;
 	}
 
-	// connect to camera
-	if (!m_pCamera->Connect()) {
-		CLogger::GetLogger()->LogPrintf(LL_ERROR, "can not connect to camera!");
+	CFrameRef frame;
+	cv::Mat image;
+	PixelFormat format = m_pCamera->GetFormat();
+	// streamed frame is shared with capture thread
+	bool shared = false;
+	bool passed = true;
+
+	// rejected frame is captured again in retry mode
+	for (unsigned attempt = 0; ; attempt++) {
+		if (IsStreaming()) {
+			// use the newest streamed frame, retry waits for a newer one
+			if (!TakePicture(frame, frame.IsValid() ? frame.GetSeq() + 1 : 0)) return false;
+			image = frame.GetImage();
+			format = frame.GetFormat();
+			shared = true;
+		} else {
+			// connect to camera
+			if (!m_pCamera->Connect()) {
+				LOG_ERROR("can not connect to camera!");
+				return false;
+			}
+
+			// image buffer is reused between pictures
+			if (m_pImage == NULL) m_pImage = new cv::Mat;
+
+			// take picture from camera
+			if (!m_pCamera->Capture(*m_pImage, IMAGE_FRAME_COUNT)) {
+				LOG_ERROR("can not get picture from camera!");
+				return false;
+			}
+			image = *m_pImage;
+		}
+
+		// cut region of interest if camera could not
+		if (m_pCamera->GetCrop().area()) {
+			// I420 crop is a private copy
+			if (format == PF_I420) shared = false;
+			if (!CCamera::CropFrame(image, format, m_pCamera->GetCrop(), m_crop)) return false;
+			image = m_crop;
+		}
+
+		passed = CheckQuality(image, format, m_meta);
+		if (passed || (m_qualityMode != QG_RETRY) || (attempt >= m_qualityRetries)) break;
+		LOG_DEBUG("picture \"%s\" is captured again, sharpness %.1f, luma %.0f",
+				fileName.c_str(), m_meta.sharpness, m_meta.luma);
+	}
+
+	// drop blurred or badly exposed picture, skip picture without motion
+	bool dropped = !passed && (m_qualityMode >= QG_DROP);
+	m_skipped = dropped;
+	if (dropped) {
+		LOG_DEBUG("picture \"%s\" was dropped, sharpness %.1f, luma %.0f",
+				fileName.c_str(), m_meta.sharpness, m_meta.luma);
+	} else if (m_motionGate && !m_motion.Process(image, format)) {
+		m_skipped = true;
+		LOG_DEBUG("picture \"%s\" was skipped, %u/%u blocks changed",
+				fileName.c_str(), m_motion.GetChangedBlocks(), m_motion.GetBlockCount());
+	}
+	m_meta.motion = (m_motionGate && !dropped) ? m_motion.GetScore() : -1;
+	if (m_skipped) {
+		m_texts.clear();
+		if (format != PF_I420) m_crop.release();
+		return true;
+	}
+
+	// stamp queued texts into image before encoding
+	if (!m_texts.empty()) {
+		// stamp a private copy of shared frame
+		if (shared) {
+			if (m_pImage == NULL) m_pImage = new cv::Mat;
+			image.copyTo(*m_pImage);
+			image = *m_pImage;
+		}
+		StampTexts(image, format, m_texts);
+	}
+
+	// derive smaller sizes into reused buffers
+	if (!PrepareOutputs(image, format, fileName, m_meta, m_outputs)) return false;
+
+	// tile delta for uplink
+	if (!PrepareUplink(m_outputs, m_uplink)) return false;
+
+	// encode all sizes in parallel
+	bool ok = EncodeOutputs(m_outputs);
+
+	// do not hold the streamed frame
+	m_outputs[0].image.release();
+	if (format != PF_I420) m_crop.release();
+	if (!ok) return false;
+
+	// save images
+	for (size_t i = 0; i < m_outputs.size(); i++) {
+		if (!SaveEncoded(i, m_outputs[i])) ok = false;
+	}
+
+	return ok;
+}
+
+bool CPicture::SetJpegParams(const SJpegParams &params) {
+	if (IsPipelineRunning()) {
+		LOG_ERROR("JPEG settings can not be changed while pipeline is running!");
 		return false;
 	}
 
-	// clean old image
-	if (m_pImage != NULL) {
-		m_pImage->release();
-		delete m_pImage;
-		m_pImage = NULL;
+	m_jpegParams = params;
+	return true;
+}
+
+bool CPicture::ClearOutputSizes() {
+	if (IsPipelineRunning()) {
+		LOG_ERROR("output sizes can not be changed while pipeline is running!");
+		return false;
+	}
+
+	m_sizes.clear();
+	m_previewIdx = 0;
+	return true;
+}
+
+bool CPicture::AddOutputSize(const cv::Size &size, const std::string &suffix) {
+	if (IsPipelineRunning()) {
+		LOG_ERROR("output sizes can not be changed while pipeline is running!");
+		return false;
+	}
+
+	// check size and name of output
+	if ((size.width <= 0) || (size.height <= 0) || suffix.empty()) {
+		LOG_ERROR("invalid output size!");
+		return false;
+	}
+
+	if (m_sizes.size() + 1 >= PIPE_MAX_OUTPUTS) {
+		LOG_ERROR("too many output sizes!");
+		return false;
+	}
+
+	// the same file name or picture would be stored twice
+	for (size_t i = 0; i < m_sizes.size(); i++) {
+		if ((m_sizes[i].size == size) || (m_sizes[i].suffix == suffix)) {
+			LOG_ERROR("output size %ix%i \"%s\" already exists!", size.width, size.height, suffix.c_str());
+			return false;
+		}
+	}
+
+	SOutputSize item;
+	item.size = size;
+	item.suffix = suffix;
+	m_sizes.push_back(item);
+
+	// preview is the output with the smallest area, outputs keep their index
+	if (!m_previewIdx || (size.area() < m_sizes[m_previewIdx - 1].size.area())) m_previewIdx = m_sizes.size();
+
+	return true;
+}
+
+const std::vector<unsigned char>& CPicture::GetEncoded(size_t idx) {
+	static const std::vector<unsigned char> empty;
+
+	if (idx >= m_outputs.size()) return empty;
+	return m_outputs[idx].encoded;
+}
+
+bool CPicture::PrepareOutputs(const cv::Mat &image, PixelFormat format, const std::string &fileName, const SPictureMeta &meta,
+	std::vector<SPictureOutput> &outputs) {
+	std::string::size_type dot = fileName.rfind('.');
+
+	outputs.resize(m_sizes.size() + 1);
+	uint64_t timeMs = GetWallTimeMSec();
+	uint64_t monoMs = GetMonoTimeMSec();
+
+	// full size output shares captured image
+	outputs[0].fileName = fileName;
+	outputs[0].timeMs = timeMs;
+	outputs[0].meta = meta;
+	outputs[0].meta.monoMs = monoMs;
+	outputs[0].image = image;
+	outputs[0].format = format;
+
+	// EXIF is built once and written by every JPEG output
+	outputs[0].app1.clear();
+	if (m_exif) {
+		SExifInfo info;
+		info.wallMs = timeMs;
+		info.monoMs = monoMs;
+		info.sensorCount = std::min(meta.sensorCount, (unsigned)EXIF_MAX_SENSORS);
+		for (unsigned i = 0; i < info.sensorCount; i++) info.sensors[i] = meta.sensors[i];
+		info.sharpness = meta.sharpness;
+		info.luma = meta.luma;
+		if (m_pCamera != NULL) info.cameraId = m_pCamera->GetID();
+		info.imei = m_imei;
+
+		if (!BuildExif(info, outputs[0].app1))
+			LOG_WARNING("EXIF of \"%s\" is too long", fileName.c_str());
+	}
+
+	for (size_t i = 0; i < m_sizes.size(); i++) {
+		SPictureOutput &out = outputs[i + 1];
+		out.timeMs = timeMs;
+		out.meta = outputs[0].meta;
+		out.app1 = outputs[0].app1;
+
+		// name with suffix before extension
+		if (dot == std::string::npos) out.fileName = fileName + m_sizes[i].suffix;
+		else out.fileName = fileName.substr(0, dot) + m_sizes[i].suffix + fileName.substr(dot);
+
+		// area averaging, buffer is reused while size does not change
+		out.format = format;
+		if (format == PF_I420) ResizeI420(image, out.image, m_sizes[i].size);
+		else cv::resize(image, out.image, m_sizes[i].size, 0, 0, cv::INTER_AREA);
+	}
+
+	return true;
+}
+
+bool CPicture::PrepareUplink(const std::vector<SPictureOutput> &outputs, std::vector<unsigned char> &packet) {
+	packet.clear();
+	if (!m_uplinkDelta) return true;
+
+	// the smallest output is sent
+	const SPictureOutput &preview = outputs[(m_previewIdx < outputs.size()) ? m_previewIdx : 0];
+	if (!m_delta.Encode(preview.image, preview.format, preview.timeMs, packet)) {
+		LOG_ERROR("can not encode uplink packet of \"%s\"!", preview.fileName.c_str());
+		return false;
+	}
+
+	return true;
+}
+
+// one output encoded by helper thread
+struct SEncodeTask {
+	CJpegEncoder *pEncoder;
+	SPictureOutput *pOutput;
+	bool ok;
+};
+
+void CPicture::OnEvict(const std::string &name, void *pArg) {
+	static_cast<CPicture*>(pArg)->m_index.Remove(name);
+}
+
+void* CPicture::RunEncodeHelper(void *pArg) {
+	static_cast<CPicture*>(pArg)->EncodeHelperLoop();
+	return NULL;
+}
+
+void CPicture::EncodeHelperLoop() {
+	SEncodeTask *pTask;
+
+	while (m_encodeTasks.Pop(pTask)) {
+		pTask->ok = EncodeImage(*pTask->pEncoder, *pTask->pOutput);
+		m_encodeDone.Push(pTask);
 	}
+}
+
+bool CPicture::EncodeOutputs(std::vector<SPictureOutput> &outputs) {
+	SEncodeTask tasks[PIPE_MAX_OUTPUTS];
+	size_t queued = 0;
+
+	// helpers are started once and reused by following pictures
+	while (m_helperCount + 1 < outputs.size()) {
+		if (pthread_create(&m_encodeHelpers[m_helperCount], NULL, RunEncodeHelper, this)) break;
+		m_helperCount++;
+	}
+
+	// smaller outputs are encoded by helper threads
+	for (size_t i = 1; i < outputs.size(); i++) {
+		tasks[i].pEncoder = &m_encoders[i];
+		tasks[i].pOutput = &outputs[i];
+		tasks[i].ok = false;
+
+		// encode in this thread if no helper could be started
+		if (m_helperCount && m_encodeTasks.Push(&tasks[i])) queued++;
+		else tasks[i].ok = EncodeImage(m_encoders[i], outputs[i]);
+	}
+
+	// full size is encoded by calling thread
+	bool ok = EncodeImage(m_encoders[0], outputs[0]);
+
+	// wait for all helpers
+	SEncodeTask *pTask;
+	for (; queued && m_encodeDone.Pop(pTask); queued--) ;
+
+	for (size_t i = 1; i < outputs.size(); i++) {
+		if (!tasks[i].ok) ok = false;
+	}
+
+	return ok;
+}
+
+bool CPicture::TakePicture(CFrameRef &frame, unsigned minSeq) {
+	// check streaming
+	if (!IsStreaming()) {
+		LOG_ERROR("camera is not streaming!");
+		return false;
+	}
+
+	// get the newest frame without copying
+	if (!m_pStream->GetFrame(frame, minSeq)) {
+		LOG_ERROR("can not get frame from capture thread!");
+		return false;
+	}
+
+	return true;
+}
+
+bool CPicture::StartStreaming() {
+	// check initialization
+	if (m_pCamera == NULL) {
+		LOG_ERROR("camera is not initialized!");
+		return false;
+	}
+
+	if (m_pStream == NULL) m_pStream = new CCaptureThread(m_pCamera);
+
+	// start capture thread with frame ring
+	if (!m_pStream->Start(m_pCamera->GetFrameSize().width, m_pCamera->GetFrameSize().height)) {
+		LOG_ERROR("can not start streaming!");
+		return false;
+	}
+
+	return true;
+}
+
+void CPicture::StopStreaming() {
+	if (m_pStream == NULL) return;
 
-	// create new image
-	m_pImage = new cv::Mat;
+	m_pStream->Stop();
+	delete m_pStream;
+	m_pStream = NULL;
+}
 
-	// take picture from camera
-	if (!m_pCamera->Capture(*m_pImage, IMAGE_FRAME_COUNT)) {
-		CLogger::GetLogger()->LogPrintf(LL_ERROR, "can not get picture from camera!");
+bool CPicture::SetRegion(const cv::Rect2f &roi, const cv::Size &size) {
+	// check initialization
+	if (m_pCamera == NULL) {
+		LOG_ERROR("camera is not initialized!");
 		return false;
 	}
 
-	// save image
-	if (!cv::imwrite(m_picPath + fileName, *m_pImage)) {
-		CLogger::GetLogger()->LogPrintf(LL_ERROR, "can not save picture \"%s\"!", fileName.c_str());
+	// pipeline capture thread uses the camera
+	if (IsPipelineRunning()) {
+		LOG_ERROR("region can not be changed while pipeline is running!");
 		return false;
 	}
 
-	CLogger::GetLogger()->LogPrintf(LL_DEBUG, "picture \"%s\" was saved", fileName.c_str());
+	// camera format is changed only on closed camera, stream gets frames of the new size after restart
+	bool streaming = IsStreaming();
+	StopStreaming();
+	m_pCamera->Disconnect();
 
+	bool ok = m_pCamera->SetRegion(roi, size);
+
+	if (streaming && !StartStreaming()) ok = false;
+	return ok;
+}
+
+bool CPicture::SetWarmUpMode(WarmUpMode mode) {
+	// check initialization
+	if (m_pCamera == NULL) {
+		LOG_ERROR("camera is not initialized!");
+		return false;
+	}
+
+	// capture threads use the camera
+	if (IsPipelineRunning() || IsStreaming() || (mode >= WU_COUNT)) {
+		LOG_ERROR("warm-up mode can not be changed!");
+		return false;
+	}
+
+	m_pCamera->SetWarmUpMode(mode);
 	return true;
 }
 
-void CPicture::PutText(const std::string &image, const std::string &text, const cv::Point &invCoord, const cv::Scalar &color) {
-	// check if picture is not null
-	if (&image == NULL)  {
-		CLogger::GetLogger()->LogPrintf(LL_ERROR, "image is null!");
+bool CPicture::SetStacking(unsigned frames, unsigned rejectDiff) {
+	// check initialization
+	if (m_pCamera == NULL) {
+		LOG_ERROR("camera is not initialized!");
+		return false;
+	}
+
+	// capture threads use the camera
+	if (IsPipelineRunning() || IsStreaming()) {
+		LOG_ERROR("stacking can not be changed while capturing!");
+		return false;
+	}
+
+	return m_pCamera->SetStacking(frames, rejectDiff);
+}
+
+void CPicture::PutText(const std::string &text, const cv::Point &invCoord, const cv::Scalar &color) {
+	// check if text is not empty
+	if (text.empty()) {
+		LOG_ERROR("text is empty!");
 		return;
 	}
 
-	// check if image exist with rw rights
-	if (!access(image.c_str(), R_OK | W_OK)) {
-		CLogger::GetLogger()->LogPrintf(LL_ERROR, "image is not readable or writable!");
+	SOverlayText item;
+	item.text = text;
+	item.invCoord = invCoord;
+	item.color = color;
+	m_texts.push_back(item);
+}
+
+void CPicture::StampTexts(cv::Mat &image, PixelFormat format, std::vector<SOverlayText> &texts) {
+	// text of I420 frame is stamped into Y plane only
+	bool planar = (format == PF_I420);
+	cv::Mat target = image;
+	if (planar) GetLumaView(image, format, target);
+
+	for (std::vector<SOverlayText>::size_type i = 0; i < texts.size(); i++) {
+		const SOverlayText &item = texts[i];
+		cv::Scalar color = item.color;
+		if (planar) color = cv::Scalar(0.114 * color[0] + 0.587 * color[1] + 0.299 * color[2]);
+		m_overlay.Stamp(target, item.text, cv::Point(target.cols - item.invCoord.x, target.rows - item.invCoord.y), color);
+	}
+
+	// texts are valid only for one picture
+	texts.clear();
+}
+
+bool CPicture::StartPipeline(unsigned encoders) {
+	// check initialization
+	if (m_pCamera == NULL) {
+		LOG_ERROR("camera is not initialized!");
+		return false;
+	}
+
+	if (m_pPipeline == NULL) m_pPipeline = new CPicturePipeline(this);
+
+	// start stage threads
+	if (!m_pPipeline->Start(encoders)) {
+		LOG_ERROR("can not start picture pipeline!");
+		return false;
+	}
+
+	return true;
+}
+
+void CPicture::StopPipeline() {
+	if (m_pPipeline == NULL) return;
+
+	// finish queued pictures
+	m_pPipeline->Stop();
+	delete m_pPipeline;
+	m_pPipeline = NULL;
+}
+
+CPictureJob* CPicture::TakePictureAsync(const std::string &fileName, PictureCallback callback, void *pArg) {
+	// check if output file name for picture is not null
+	if (!fileName.size()) {
+		LOG_ERROR("filename for picture is null!");
+		return NULL;
+	}
+
+	// check pipeline
+	if (!IsPipelineRunning()) {
+		LOG_ERROR("picture pipeline is not running!");
+		return NULL;
+	}
+
+	CPictureJob *pJob = new CPictureJob(fileName, callback, pArg);
+
+	// queued texts and the latest readings belong to this picture
+	pJob->m_texts.swap(m_texts);
+	pJob->m_meta = m_meta;
+
+	if (!m_pPipeline->Submit(pJob)) {
+		pJob->Release();
+		return NULL;
+	}
+
+	return pJob;
+}
+
+void CPicture::GetPipelineStats(SPipeStats &stats) {
+	if (m_pPipeline == NULL) {
+		memset(&stats, 0, sizeof(stats));
 		return;
 	}
 
-	// load image
-	cv::Mat outImage = cv::imread(m_picPath + image, CV_LOAD_IMAGE_UNCHANGED);
+	m_pPipeline->GetStats(stats);
+}
 
-	// put text
-	cv::putText(outImage, text, cv::Point(outImage.size().width - invCoord.x, outImage.size().height - invCoord.y), cv::FONT_HERSHEY_COMPLEX_SMALL, 1.0, color);
+bool CPicture::CaptureImage(cv::Mat &image, PixelFormat &format, std::vector<SOverlayText> &texts, SPictureMeta &meta,
+	bool &skipped) {
+	CFrameRef frame;
+	bool passed = true;
 
-	// write image file
-	cv::imwrite(m_picPath + image, outImage);
+	format = m_pCamera->GetFormat();
+
+	// rejected frame is captured again in retry mode
+	for (unsigned attempt = 0; ; attempt++) {
+		if (IsStreaming()) {
+			// copy the newest frame, image leaves the ring, retry waits for a newer one
+			if (!TakePicture(frame, frame.IsValid() ? frame.GetSeq() + 1 : 0)) return false;
+
+			// copy only region of interest, I420 crop copies the planes itself
+			const cv::Mat &src = frame.GetImage();
+			const cv::Rect &crop = m_pCamera->GetCrop();
+			format = frame.GetFormat();
+			if (!crop.area()) src.copyTo(image);
+			else {
+				cv::Mat view;
+				if (!CCamera::CropFrame(src, format, crop, (format == PF_I420) ? image : view)) return false;
+				if (format != PF_I420) view.copyTo(image);
+			}
+		} else {
+			// connect to camera
+			if (!m_pCamera->Connect()) {
+				LOG_ERROR("can not connect to camera!");
+				return false;
+			}
+
+			// take picture from camera
+			if (!m_pCamera->Capture(image, IMAGE_FRAME_COUNT)) {
+				LOG_ERROR("can not get picture from camera!");
+				return false;
+			}
+
+			// job owns the frame, packed crop stays a view
+			if (m_pCamera->GetCrop().area()) {
+				cv::Mat view;
+				if (!CCamera::CropFrame(image, format, m_pCamera->GetCrop(), view)) return false;
+				image = view;
+			}
+		}
+
+		passed = CheckQuality(image, format, meta);
+		if (passed || (m_qualityMode != QG_RETRY) || (attempt >= m_qualityRetries)) break;
+	}
+
+	// drop blurred or badly exposed picture, skip picture without motion
+	bool dropped = !passed && (m_qualityMode >= QG_DROP);
+	skipped = dropped || (m_motionGate && !m_motion.Process(image, format));
+	meta.motion = (m_motionGate && !dropped) ? m_motion.GetScore() : -1;
+	if (skipped) {
+		texts.clear();
+		return true;
+	}
+
+	// stamp texts before encoding
+	StampTexts(image, format, texts);
+
+	return true;
+}
+
+bool CPicture::EncodeImage(CJpegEncoder &encoder, SPictureOutput &output) {
+	const cv::Mat &image = output.image;
+	const std::string &fileName = output.fileName;
+	std::vector<unsigned char> &out = output.encoded;
+	std::string::size_type dot = fileName.rfind('.');
+
+	// encoder is chosen by file extension
+	if (dot == std::string::npos) {
+		LOG_ERROR("picture \"%s\" has no extension!", fileName.c_str());
+		return false;
+	}
+
+	std::string ext = fileName.substr(dot);
+
+	// JPEG is encoded by persistent libjpeg compressor
+	if (!strcasecmp(ext.c_str(), ".jpg") || !strcasecmp(ext.c_str(), ".jpeg")) {
+		encoder.SetParams(m_jpegParams);
+		// metadata in the same pass
+		if (!output.app1.empty()) encoder.SetApp1(output.app1);
+		// YUV420 planes go to the encoder without colour conversion
+		bool ok = (output.format == PF_I420) ? encoder.EncodeI420(image, out) : encoder.Encode(image, out);
+		if (!ok) {
+			LOG_ERROR("can not encode picture \"%s\"!", fileName.c_str());
+			return false;
+		}
+		return true;
+	}
+
+	// other formats need BGR
+	cv::Mat bgr = image;
+	if (output.format == PF_I420) cv::cvtColor(image, bgr, cv::COLOR_YUV2BGR_I420);
+
+	if (!cv::imencode(ext, bgr, out)) {
+		LOG_ERROR("can not encode picture \"%s\"!", fileName.c_str());
+		return false;
+	}
+
+	return true;
+}
+
+bool CPicture::SetSink(CPictureSink *pSink) {
+	if (pSink == NULL) pSink = new CFileSink();
+
+	// sink writes into picture directory
+	if (!m_picPath.empty() && !pSink->Init(m_picPath)) {
+		LOG_ERROR("can not init picture output!");
+		delete pSink;
+		return false;
+	}
+
+	if (m_pSink != NULL) {
+		m_pSink->Close();
+		delete m_pSink;
+	}
+	m_pSink = pSink;
+	m_pSink->SetStorage(m_storage.IsRunning() ? &m_storage : NULL);
+
+	return true;
+}
+
+bool CPicture::SetStorageQuota(uint64_t maxBytes, unsigned maxFiles) {
+	m_storage.SetQuota(maxBytes, maxFiles);
+
+	// started by Init() when picture directory is not known yet
+	if (m_picPath.empty() || m_storage.IsRunning() || !m_storage.HasQuota()) return true;
+
+	if (!m_storage.Start(m_picPath)) {
+		LOG_ERROR("can not start storage manager!");
+		return false;
+	}
+	if (m_pSink != NULL) m_pSink->SetStorage(&m_storage);
+
+	return true;
+}
+
+bool CPicture::SaveEncoded(unsigned idx, const SPictureOutput &output) {
+	// check initialization
+	if (m_pSink == NULL) {
+		LOG_ERROR("picture output is not initialized!");
+		return false;
+	}
+
+	if (!m_pSink->Write(idx, output.fileName, output.encoded, output.timeMs)) return false;
+
+	// index follows the stored picture
+	if (m_index.IsOpen()) {
+		SIndexRecord record;
+		memset(&record, 0, sizeof(record));
+		record.timeMs = output.timeMs;
+		record.offset = m_pSink->GetLastOffset();
+		record.size = output.encoded.size();
+		record.output = idx;
+		record.sensorCount = std::min(output.meta.sensorCount, (unsigned)INDEX_SENSORS);
+		record.motion = (output.meta.motion < 0) ? INDEX_NO_MOTION : cvRound(output.meta.motion * 1000);
+		for (unsigned i = 0; i < record.sensorCount; i++) record.sensors[i] = output.meta.sensors[i];
+		record.sharpness = (output.meta.sharpness < 0) ? INDEX_NO_QUALITY : output.meta.sharpness;
+		record.luma = (output.meta.luma < 0) ? INDEX_NO_QUALITY : cvRound(output.meta.luma);
+		strncpy(record.name, m_pSink->GetLastName().c_str(), INDEX_NAME_LEN);
+		m_index.Append(record);
+	}
+
+	return true;
+}
+
+bool CPicture::CheckQuality(const cv::Mat &image, PixelFormat format, SPictureMeta &meta) {
+	if (m_qualityMode == QG_OFF) {
+		meta.sharpness = -1;
+		meta.luma = -1;
+		return true;
+	}
+
+	bool passed = m_quality.Process(image, format);
+	meta.sharpness = m_quality.GetSharpness();
+	meta.luma = m_quality.GetLuma();
+	return passed;
+}
 
-	// clean
-	outImage.release();
+void CPicture::SetSensorValues(const float *pValues, unsigned count) {
+	m_meta.sensorCount = std::min(count, (unsigned)PIPE_MAX_SENSORS);
+	for (unsigned i = 0; i < m_meta.sensorCount; i++) m_meta.sensors[i] = pValues[i];
 }
@@ -2,11 +2,68 @@
 #define PICTURE_H_
 
 #include <string>
-#include <opencv/cv.h>
-#include <raspicam/raspicam_cv.h>
+#include <vector>
+#include <opencv2/core.hpp>
+
+#include "capture.h"
+#include "delta.h"
+#include "exif.h"
+#include "framesource.h"
+#include "index.h"
+#include "jpegenc.h"
+#include "motion.h"
+#include "quality.h"
+#include "stacker.h"
+#include "overlay.h"
+#include "pipeline.h"
+#include "sink.h"
+#include "storage.h"
 
 #define FRAME_WIDTH 1024
 #define FRAME_HEIGHT 768
+// full resolution of camera sensor, limit of scaled whole view
+#define FRAME_MAX_WIDTH 2592
+#define FRAME_MAX_HEIGHT 1944
+
+// fix-up of red and blue channels in captured frame
+typedef enum ColorSwap {
+	CS_NONE = 0,	// frame has already right channel order
+	CS_SPLIT,		// split/swap/merge channels (allocates planes)
+	CS_SCALAR,		// in-place scalar swap
+	CS_SIMD,		// in-place NEON/SSSE3/AVX2 swap
+	CS_COUNT
+} ColorSwap;
+
+// default channel fix-up, set to CS_NONE if raspicam delivers BGR
+#ifndef DEF_COLOR_SWAP
+#define DEF_COLOR_SWAP CS_SIMD
+#endif
+
+// handling of warm-up frames before the captured one
+typedef enum WarmUpMode {
+	WU_DECODE_ALL = 0,	// grab and decode every frame
+	WU_GRAB_ONLY,		// grab every frame, decode only the last one
+	WU_CONVERGE,		// stop when exposure converges, decode sampled frames
+	WU_COUNT
+} WarmUpMode;
+
+// default frame format, PF_BGR or PF_I420
+#ifndef DEF_PIXEL_FORMAT
+#define DEF_PIXEL_FORMAT PF_BGR
+#endif
+
+#ifndef DEF_WARMUP_MODE
+#define DEF_WARMUP_MODE WU_CONVERGE
+#endif
+
+// min count of frames before exposure can be considered as converged
+#define WARMUP_MIN_FRAMES 3
+// count of consecutive stable frames for converged exposure
+#define WARMUP_STABLE_FRAMES 2
+// max luma change between stable frames
+#define WARMUP_LUMA_DELTA 2
+// grid step in pixels for luma sampling
+#define WARMUP_GRID_STEP 32
 
 class CCamera
 {
@@ -14,36 +71,202 @@ public:
 	CCamera();
 	~CCamera();
 
-	bool Init();
+	bool Init(CFrameSource *pSource = NULL, PixelFormat format = DEF_PIXEL_FORMAT);
+	inline PixelFormat GetFormat() { return m_format; }
 
 	bool Connect();
 	inline bool isConnected() { return m_connected; }
 	void Disconnect();
+	inline const std::string& GetID() { return m_ID; }
 
-	bool Capture(cv::Mat &outImage, int count = 1);
+	inline void SetWarmUpMode(WarmUpMode mode) { m_warmUpMode = mode; }
+	inline WarmUpMode GetWarmUpMode() { return m_warmUpMode; }
+	// average the last frames of capture burst (e.g. at night), 1 = off
+	// fixed count modes stack the last frames of the burst, WU_CONVERGE stacks frames following the converged one
+	bool SetStacking(unsigned frames, unsigned rejectDiff = STACK_DEF_REJECT_DIFF);
+	inline unsigned GetStacking() { return m_stackFrames; }
+
+	// region of field of view (normalised 0..1) delivered in given size, camera has to be disconnected
+	// (see CPicture::SetRegion()), crop is pushed to camera if possible, otherwise camera scales whole view
+	// and crop is left to GetCrop(), region is delivered smaller when the view would exceed the sensor
+	bool SetRegion(const cv::Rect2f &roi, const cv::Size &size);
+	inline const cv::Rect2f& GetRegion() { return m_region; }
+	// size of captured frames
+	inline const cv::Size& GetFrameSize() { return m_frameSize; }
+	// crop of captured frames left to software, empty if not needed
+	inline const cv::Rect& GetCrop() { return m_crop; }
+
+	bool Capture(cv::Mat &outImage, int count = 1, ColorSwap swap = DEF_COLOR_SWAP);
+	static void SwapChannels(cv::Mat &image, ColorSwap swap);
+	// packed frame is cropped as view without copying, I420 planes are copied into out,
+	// crop is clamped to the frame (e.g. camera delivered smaller size), false if nothing is left
+	static bool CropFrame(const cv::Mat &frame, PixelFormat format, const cv::Rect &crop, cv::Mat &out);
+
+private:
+	bool StackFrames(cv::Mat &image, unsigned frames);
 
 private:
-	raspicam::RaspiCam_Cv *m_pRaspiCam;
+	CFrameSource *m_pSource;
+	PixelFormat m_format;
+	cv::Size m_frameSize;
+	cv::Rect2f m_region;
+	cv::Rect m_crop;
 	bool m_connected;
+	WarmUpMode m_warmUpMode;
+	CFrameStacker m_stacker;
+	cv::Mat m_stackFrame;
+	unsigned m_stackFrames;
 	std::string m_ID;
 };
 
 #define IMAGE_FRAME_COUNT 10
 
+// smaller output encoded by persistent helper thread
+struct SEncodeTask;
+
+// additional smaller output of every picture
+struct SOutputSize {
+	cv::Size size;
+	std::string suffix;		// inserted before file extension
+};
+
+
 class CPicture {
 public:
 	CPicture();
 	~CPicture();
 
-	bool Init(const std::string &outpuPath, bool useCamera = true);
+	bool Init(const std::string &outpuPath, bool useCamera = true, CFrameSource *pSource = NULL,
+		PixelFormat format = DEF_PIXEL_FORMAT);
 	bool TakePicture(const std::string &fileName);
-	void PutText(const std::string &image, const std::string &text,
+	// minSeq > 0 waits for a frame newer than already taken one
+	bool TakePicture(CFrameRef &frame, unsigned minSeq = 0);
+	// queue text for the next picture, it is stamped before encoding
+	void PutText(const std::string &text,
 		const cv::Point &invCoord = cv::Point(235, 20), const cv::Scalar &color = cv::Scalar(255, 255, 255));
 
+	// the latest sensor readings, attached to every following picture
+	void SetSensorValues(const float *pValues, unsigned count);
+	// modem IMEI written into EXIF
+	inline void SetModemId(const std::string &imei) { m_imei = imei; }
+	// EXIF with times, readings, camera ID and IMEI in JPEG outputs
+	inline void SetExif(bool enable) { m_exif = enable; }
+
+	// JPEG settings, applied to synchronous and pipeline encoders
+	// settings and output sizes are read by pipeline threads, changes are rejected while pipeline is running
+	bool SetJpegParams(const SJpegParams &params);
+	inline const SJpegParams& GetJpegParams() { return m_jpegParams; }
+	// smaller outputs (e.g. thumbnail) derived from the same captured frame,
+	// outputs keep order of adding, duplicate sizes and suffixes are rejected
+	bool AddOutputSize(const cv::Size &size, const std::string &suffix);
+	bool ClearOutputSizes();
+	inline size_t GetOutputCount() { return m_sizes.size() + 1; }
+	// encoded bytes of the last synchronous picture, 0 = full size
+	const std::vector<unsigned char>& GetEncoded(size_t idx = 0);
+	// output with the smallest area, sent by uplink by default
+	inline size_t GetPreviewIndex() { return m_previewIdx; }
+	inline const std::vector<unsigned char>& GetPreview() { return GetEncoded(m_previewIdx); }
+
+	// uplink gets tile deltas of the smallest output instead of whole preview
+	inline void SetUplinkDelta(bool enable) { m_uplinkDelta = enable; m_delta.ForceKey(); }
+	inline CDeltaEncoder& GetDeltaEncoder() { return m_delta; }
+	// delta packet of the last synchronous picture, empty if delta uplink is off
+	inline const std::vector<unsigned char>& GetUplinkPacket() { return m_uplink; }
+	// receiver has got the packet, the next deltas are based on it
+	inline void AckUplink(unsigned seq) { m_delta.Ack(seq); }
+
+	// destination of encoded pictures, CPicture takes ownership, NULL = one file per picture
+	// do not change while pipeline is running
+	bool SetSink(CPictureSink *pSink);
+	inline CPictureSink* GetSink() { return m_pSink; }
+
+	// picture directory kept under byte and file count quota [B], 0 = no limit
+	bool SetStorageQuota(uint64_t maxBytes, unsigned maxFiles);
+	inline CStorageManager& GetStorage() { return m_storage; }
+
+	// save only pictures with motion against the last saved one
+	inline void SetMotionGate(bool enable) { m_motionGate = enable; m_motion.Reset(); }
+	inline CMotionDetector& GetMotionDetector() { return m_motion; }
+	// score sharpness and exposure of pictures, rejected ones are dropped or captured again
+	inline void SetQualityGate(QualityGateMode mode, unsigned retries = QUALITY_DEF_RETRIES) {
+		m_qualityMode = mode;
+		m_qualityRetries = retries;
+	}
+	inline CQualityGate& GetQualityGate() { return m_quality; }
+	// last synchronous picture was skipped by motion or quality gate
+	inline bool WasSkipped() { return m_skipped; }
+
+	// camera region (see CCamera::SetRegion()), streaming is restarted and the next picture reconnects camera,
+	// rejected while pipeline is running
+	bool SetRegion(const cv::Rect2f &roi, const cv::Size &size);
+	// capture burst settings of camera (see CCamera), rejected while pipeline or streaming is running
+	bool SetWarmUpMode(WarmUpMode mode);
+	bool SetStacking(unsigned frames, unsigned rejectDiff = STACK_DEF_REJECT_DIFF);
+
+	bool StartStreaming();
+	void StopStreaming();
+	inline bool IsStreaming() { return (m_pStream != NULL) && m_pStream->IsRunning(); }
+
+	// asynchronous pictures, do not mix with synchronous TakePicture() while running
+	bool StartPipeline(unsigned encoders = 0);
+	void StopPipeline();
+	inline bool IsPipelineRunning() { return (m_pPipeline != NULL) && m_pPipeline->IsRunning(); }
+	// returned job has to be released by caller, NULL if request was rejected
+	CPictureJob* TakePictureAsync(const std::string &fileName, PictureCallback callback = NULL, void *pArg = NULL);
+	void GetPipelineStats(SPipeStats &stats);
+
+private:
+	void StampTexts(cv::Mat &image, PixelFormat format, std::vector<SOverlayText> &texts);
+	bool CheckQuality(const cv::Mat &image, PixelFormat format, SPictureMeta &meta);
+	static void* RunEncodeHelper(void *pArg);
+	void EncodeHelperLoop();
+	static void OnEvict(const std::string &name, void *pArg);
+	bool EncodeOutputs(std::vector<SPictureOutput> &outputs);
+
+	// pipeline stages
+	bool CaptureImage(cv::Mat &image, PixelFormat &format, std::vector<SOverlayText> &texts, SPictureMeta &meta,
+		bool &skipped);
+	bool PrepareOutputs(const cv::Mat &image, PixelFormat format, const std::string &fileName, const SPictureMeta &meta,
+		std::vector<SPictureOutput> &outputs);
+	bool PrepareUplink(const std::vector<SPictureOutput> &outputs, std::vector<unsigned char> &packet);
+	bool EncodeImage(CJpegEncoder &encoder, SPictureOutput &output);
+	bool SaveEncoded(unsigned idx, const SPictureOutput &output);
+	friend class CPicturePipeline;
+
 private:
 	CCamera *m_pCamera;
+	CCaptureThread *m_pStream;
+	CPicturePipeline *m_pPipeline;
+	CPictureSink *m_pSink;
+	CStorageManager m_storage;
+	CPictureIndexWriter m_index;
 	cv::Mat *m_pImage;
+	cv::Mat m_crop;
 	std::string m_picPath;
+	COverlay m_overlay;
+	CJpegEncoder m_encoders[PIPE_MAX_OUTPUTS];
+	SJpegParams m_jpegParams;
+	std::vector<SOutputSize> m_sizes;
+	size_t m_previewIdx;
+	std::vector<SPictureOutput> m_outputs;
+	// helpers encoding smaller outputs of synchronous pictures
+	CBoundedQueue<SEncodeTask*> m_encodeTasks;
+	CBoundedQueue<SEncodeTask*> m_encodeDone;
+	pthread_t m_encodeHelpers[PIPE_MAX_OUTPUTS];
+	unsigned m_helperCount;
+	CMotionDetector m_motion;
+	CQualityGate m_quality;
+	QualityGateMode m_qualityMode;
+	unsigned m_qualityRetries;
+	CDeltaEncoder m_delta;
+	std::vector<unsigned char> m_uplink;
+	bool m_uplinkDelta;
+	bool m_exif;
+	std::string m_imei;
+	bool m_motionGate;
+	bool m_skipped;
+	std::vector<SOverlayText> m_texts;
+	SPictureMeta m_meta;
 };
 
 #endif // PICTURE_H_
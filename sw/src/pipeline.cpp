@@ -0,0 +1,384 @@
+#include "common.h"
+#include "logger.h"
+#include <errno.h>
+#include <sys/time.h>
+#include <algorithm>
+
+#include "picture.h"
+#include "pipeline.h"
+
+CPictureJob::CPictureJob(const std::string &fileName, PictureCallback callback, void *pArg) :
+    m_fileName(fileName),
+    m_callback(callback),
+    m_pArg(pArg),
+    m_format(PF_BGR),
+    m_submitTime(0),
+    m_seq(0),
+    m_pending(0),
+    m_failed(0),
+    m_status(JOB_PENDING),
+    m_refCount(1) {
+    memset(m_stageTime, 0, sizeof(m_stageTime));
+    memset(&m_meta, 0, sizeof(m_meta));
+    m_meta.motion = -1;
+    m_meta.sharpness = -1;
+    m_meta.luma = -1;
+    pthread_mutex_init(&m_lock, NULL);
+    pthread_cond_init(&m_done, NULL);
+}
+
+CPictureJob::~CPictureJob() {
+    m_image.release();
+    pthread_cond_destroy(&m_done);
+    pthread_mutex_destroy(&m_lock);
+}
+
+const std::vector<unsigned char>& CPictureJob::GetEncoded(size_t idx) {
+    static const std::vector<unsigned char> empty;
+
+    if (idx >= m_outputs.size()) return empty;
+    return m_outputs[idx].encoded;
+}
+
+void CPictureJob::AddRef() {
+    __sync_fetch_and_add(&m_refCount, 1);
+}
+
+void CPictureJob::Release() {
+    if (__sync_sub_and_fetch(&m_refCount, 1) == 0) delete this;
+}
+
+int CPictureJob::Wait(unsigned tmt) {
+    struct timeval now;
+    struct timespec until;
+
+    // compute absolute timeout
+    gettimeofday(&now, NULL);
+    until.tv_sec = now.tv_sec + tmt / 1000;
+    until.tv_nsec = now.tv_usec * 1000 + (tmt % 1000) * 1000000;
+    if (until.tv_nsec >= 1000000000) {
+        until.tv_sec++;
+        until.tv_nsec -= 1000000000;
+    }
+
+    pthread_mutex_lock(&m_lock);
+    while (m_status == JOB_PENDING) {
+        if (!tmt) pthread_cond_wait(&m_done, &m_lock);
+        else if (pthread_cond_timedwait(&m_done, &m_lock, &until) == ETIMEDOUT) break;
+    }
+    int status = m_status;
+    pthread_mutex_unlock(&m_lock);
+
+    return status;
+}
+
+void CPictureJob::Complete(int status) {
+    // free raw image, encoded data stay for the owner (e.g. upload)
+    m_image.release();
+
+    pthread_mutex_lock(&m_lock);
+    m_status = status;
+    pthread_cond_broadcast(&m_done);
+    pthread_mutex_unlock(&m_lock);
+
+    // notify owner
+    if (m_callback != NULL) m_callback(this, m_pArg);
+}
+
+CPicturePipeline::CPicturePipeline(CPicture *pPicture) :
+    m_pPicture(pPicture),
+    m_captureQueue(PIPE_REQ_QUEUE_SIZE),
+    m_encodeQueue(PIPE_STAGE_QUEUE_SIZE * PIPE_MAX_OUTPUTS),
+    m_writeQueue(PIPE_STAGE_QUEUE_SIZE),
+    m_encoders(0),
+    m_nextSeq(0),
+    m_running(false) {
+    memset(&m_stats, 0, sizeof(m_stats));
+    pthread_mutex_init(&m_statsLock, NULL);
+    pthread_mutex_init(&m_buffersLock, NULL);
+}
+
+CPicturePipeline::~CPicturePipeline() {
+    Stop();
+    m_pPicture = NULL;
+    pthread_mutex_destroy(&m_statsLock);
+    pthread_mutex_destroy(&m_buffersLock);
+}
+
+bool CPicturePipeline::Start(unsigned encoders) {
+    if (m_running) return true;
+
+    // one encoder per core by default
+    if (!encoders) {
+        long cores = sysconf(_SC_NPROCESSORS_ONLN);
+        encoders = (cores > 0) ? (unsigned)cores : 1;
+    }
+    if (encoders > PIPE_MAX_ENCODERS) encoders = PIPE_MAX_ENCODERS;
+
+    m_captureQueue.Reopen();
+    m_encodeQueue.Reopen();
+    m_writeQueue.Reopen();
+    m_nextSeq = 0;
+
+    // start stages from the end
+    if (pthread_create(&m_writeThread, NULL, RunWrite, this)) {
+        LOG_ERROR("can not start writer thread!");
+        return false;
+    }
+
+    for (m_encoders = 0; m_encoders < encoders; m_encoders++) {
+        if (pthread_create(&m_encodeThreads[m_encoders], NULL, RunEncode, this)) {
+            LOG_ERROR("can not start encoder thread!");
+            break;
+        }
+    }
+
+    if (!m_encoders || pthread_create(&m_captureThread, NULL, RunCapture, this)) {
+        LOG_ERROR("can not start capture thread!");
+        // stop already started threads
+        m_encodeQueue.Close();
+        for (unsigned i = 0; i < m_encoders; i++) pthread_join(m_encodeThreads[i], NULL);
+        m_writeQueue.Close();
+        pthread_join(m_writeThread, NULL);
+        return false;
+    }
+
+    m_running = true;
+    LOG_DEBUG("picture pipeline was started with %u encoders", m_encoders);
+
+    return true;
+}
+
+void CPicturePipeline::Stop() {
+    if (!m_running) return;
+
+    // drain stages one by one, queued jobs are finished
+    m_captureQueue.Close();
+    pthread_join(m_captureThread, NULL);
+
+    m_encodeQueue.Close();
+    for (unsigned i = 0; i < m_encoders; i++) pthread_join(m_encodeThreads[i], NULL);
+
+    m_writeQueue.Close();
+    pthread_join(m_writeThread, NULL);
+
+    m_running = false;
+    LOG_DEBUG("picture pipeline was stopped");
+}
+
+bool CPicturePipeline::Submit(CPictureJob *pJob) {
+    if (!m_running) {
+        LOG_ERROR("picture pipeline is not running!");
+        return false;
+    }
+
+    pJob->m_submitTime = GetTimeSec();
+
+    // pipeline holds its own reference until the job is finished
+    pJob->AddRef();
+
+    // never block the caller, full queue means pipeline can not keep up
+    if (!m_captureQueue.Push(pJob, false)) {
+        LOG_WARNING("picture pipeline is full, \"%s\" was rejected",
+                pJob->m_fileName.c_str());
+        pJob->Release();
+        return false;
+    }
+
+    return true;
+}
+
+void CPicturePipeline::GetStats(SPipeStats &stats) {
+    pthread_mutex_lock(&m_statsLock);
+    stats = m_stats;
+    pthread_mutex_unlock(&m_statsLock);
+
+    stats.depth[PS_CAPTURE] = m_captureQueue.GetDepth();
+    stats.depth[PS_ENCODE] = m_encodeQueue.GetDepth();
+    stats.depth[PS_WRITE] = m_writeQueue.GetDepth();
+    stats.maxDepth[PS_CAPTURE] = m_captureQueue.GetMaxDepth();
+    stats.maxDepth[PS_ENCODE] = m_encodeQueue.GetMaxDepth();
+    stats.maxDepth[PS_WRITE] = m_writeQueue.GetMaxDepth();
+}
+
+void* CPicturePipeline::RunCapture(void *pArg) {
+    static_cast<CPicturePipeline*>(pArg)->CaptureLoop();
+    return NULL;
+}
+
+void* CPicturePipeline::RunEncode(void *pArg) {
+    static_cast<CPicturePipeline*>(pArg)->EncodeLoop();
+    return NULL;
+}
+
+void* CPicturePipeline::RunWrite(void *pArg) {
+    static_cast<CPicturePipeline*>(pArg)->WriteLoop();
+    return NULL;
+}
+
+void CPicturePipeline::Account(CPictureJob *pJob, PipeStage stage, double start) {
+    double latency = GetTimeSec() - start;
+
+    pJob->m_stageTime[stage] = latency;
+
+    pthread_mutex_lock(&m_statsLock);
+    m_stats.jobs[stage]++;
+    m_stats.latency[stage] += latency;
+    if (latency > m_stats.maxLatency[stage]) m_stats.maxLatency[stage] = latency;
+    pthread_mutex_unlock(&m_statsLock);
+}
+
+void CPicturePipeline::Finish(CPictureJob *pJob, PipeStage stage, int status) {
+    if (status != JOB_DONE) {
+        if (status == JOB_FAILED)
+            LOG_ERROR("picture \"%s\" failed in stage %i!",
+                    pJob->m_fileName.c_str(), stage);
+
+        pthread_mutex_lock(&m_statsLock);
+        if (status == JOB_SKIPPED) m_stats.skipped++;
+        else m_stats.failed++;
+        pthread_mutex_unlock(&m_statsLock);
+    }
+
+    pJob->Complete(status);
+    pJob->Release();
+}
+
+void CPicturePipeline::CaptureLoop() {
+    CPictureJob *pJob;
+    double start;
+
+    while (m_captureQueue.Pop(pJob)) {
+        // latency includes waiting in request queue
+        start = pJob->m_submitTime;
+
+        bool skipped = false;
+        if (!m_pPicture->CaptureImage(pJob->m_image, pJob->m_format, pJob->m_texts, pJob->m_meta, skipped)) {
+            Finish(pJob, PS_CAPTURE, JOB_FAILED);
+            continue;
+        }
+        Account(pJob, PS_CAPTURE, start);
+
+        // nothing has changed since the last picture
+        if (skipped) {
+            Finish(pJob, PS_CAPTURE, JOB_SKIPPED);
+            continue;
+        }
+
+        // derive smaller sizes from captured frame into reused buffers
+        TakeBuffers(pJob);
+        if (!m_pPicture->PrepareOutputs(pJob->m_image, pJob->m_format, pJob->m_fileName, pJob->m_meta, pJob->m_outputs)) {
+            Finish(pJob, PS_CAPTURE, JOB_FAILED);
+            continue;
+        }
+        pJob->m_image.release();
+
+        // deltas depend on the previous picture, so they are made in order here
+        if (!m_pPicture->PrepareUplink(pJob->m_outputs, pJob->m_uplink)) {
+            Finish(pJob, PS_CAPTURE, JOB_FAILED);
+            continue;
+        }
+
+        // every output is encoded separately, so sizes are encoded in parallel
+        pJob->m_seq = m_nextSeq++;
+        pJob->m_pending = pJob->m_outputs.size();
+        pJob->m_submitTime = GetTimeSec();
+        for (size_t i = 0; i < pJob->m_outputs.size(); i++) {
+            SEncodeItem item;
+            item.pJob = pJob;
+            item.idx = i;
+
+            // wait while encoders are busy
+            if (!m_encodeQueue.Push(item)) EncodeDone(pJob, false, pJob->m_submitTime);
+        }
+    }
+}
+
+void CPicturePipeline::TakeBuffers(CPictureJob *pJob) {
+    size_t count = std::min(m_pPicture->GetOutputCount(), (size_t)PIPE_MAX_OUTPUTS);
+    pJob->m_outputs.resize(count);
+
+    pthread_mutex_lock(&m_buffersLock);
+    for (size_t i = 1; i < count; i++) {
+        if (m_buffers[i].empty()) continue;
+        pJob->m_outputs[i].image = m_buffers[i].back();
+        m_buffers[i].pop_back();
+    }
+    pthread_mutex_unlock(&m_buffersLock);
+}
+
+void CPicturePipeline::ReturnBuffer(size_t idx, cv::Mat &image) {
+    pthread_mutex_lock(&m_buffersLock);
+    if ((idx < PIPE_MAX_OUTPUTS) && (m_buffers[idx].size() < PIPE_MAX_BUFFERS)) m_buffers[idx].push_back(image);
+    pthread_mutex_unlock(&m_buffersLock);
+    image.release();
+}
+
+void CPicturePipeline::EncodeDone(CPictureJob *pJob, bool ok, double start) {
+    if (!ok) __sync_fetch_and_add(&pJob->m_failed, 1);
+
+    // the last encoded output hands the job over to writer, also failed one to keep the sequence
+    if (__sync_sub_and_fetch(&pJob->m_pending, 1)) return;
+
+    if (!pJob->m_failed) Account(pJob, PS_ENCODE, start);
+
+    pJob->m_submitTime = GetTimeSec();
+    if (!m_writeQueue.Push(pJob)) Finish(pJob, PS_ENCODE, JOB_FAILED);
+}
+
+void CPicturePipeline::EncodeLoop() {
+    SEncodeItem item;
+    // compressor lives as long as the encoder thread
+    CJpegEncoder encoder;
+
+    while (m_encodeQueue.Pop(item)) {
+        SPictureOutput &out = item.pJob->m_outputs[item.idx];
+        double start = item.pJob->m_submitTime;
+
+        bool ok = m_pPicture->EncodeImage(encoder, out);
+
+        // raw image is not needed anymore, resize buffer goes back to the pool
+        if (item.idx) ReturnBuffer(item.idx, out.image);
+        else out.image.release();
+
+        EncodeDone(item.pJob, ok, start);
+    }
+}
+
+void CPicturePipeline::WriteJob(CPictureJob *pJob) {
+    double start = pJob->m_submitTime;
+
+    if (pJob->m_failed) {
+        Finish(pJob, PS_ENCODE, JOB_FAILED);
+        return;
+    }
+
+    bool ok = true;
+    for (size_t i = 0; i < pJob->m_outputs.size(); i++) {
+        if (!m_pPicture->SaveEncoded(i, pJob->m_outputs[i])) ok = false;
+    }
+    if (ok) Account(pJob, PS_WRITE, start);
+
+    Finish(pJob, PS_WRITE, ok ? JOB_DONE : JOB_FAILED);
+}
+
+void CPicturePipeline::WriteLoop() {
+    CPictureJob *pJob;
+    // jobs finished by encoders ahead of older ones, bounded by jobs in flight
+    std::map<unsigned, CPictureJob*> ready;
+    unsigned next = 0;
+
+    while (m_writeQueue.Pop(pJob)) {
+        ready[pJob->m_seq] = pJob;
+
+        // pictures, containers and index are written in capture order
+        while (!ready.empty() && (ready.begin()->first == next)) {
+            WriteJob(ready.begin()->second);
+            ready.erase(ready.begin());
+            next++;
+        }
+    }
+
+    // jobs behind a lost one on shutdown
+    for (std::map<unsigned, CPictureJob*>::iterator it = ready.begin(); it != ready.end(); ++it) WriteJob(it->second);
+}
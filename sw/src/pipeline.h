@@ -0,0 +1,270 @@
+#ifndef PIPELINE_H_
+#define PIPELINE_H_
+
+#include <pthread.h>
+#include <stdint.h>
+#include <deque>
+#include <map>
+#include <string>
+#include <vector>
+#include <opencv2/core.hpp>
+
+#include "framesource.h"
+#include "overlay.h"
+
+// capacity of queue for picture requests
+#define PIPE_REQ_QUEUE_SIZE 4
+// capacity of queues between stages
+#define PIPE_STAGE_QUEUE_SIZE 2
+// max count of encoder threads
+#define PIPE_MAX_ENCODERS 4
+// max count of output sizes of one picture
+#define PIPE_MAX_OUTPUTS 4
+// max count of sensor readings attached to a picture
+#define PIPE_MAX_SENSORS 4
+// free resize buffers kept for each smaller output
+#define PIPE_MAX_BUFFERS (PIPE_REQ_QUEUE_SIZE + PIPE_STAGE_QUEUE_SIZE)
+
+// readings attached to a picture
+struct SPictureMeta {
+    float sensors[PIPE_MAX_SENSORS];    // e.g. DS18B20 temperatures [deg C]
+    unsigned sensorCount;
+    float motion;           // changed blocks ratio, < 0 if not measured
+    float sharpness;        // Laplacian variance, < 0 if not measured
+    float luma;             // mean luma, < 0 if not measured
+    uint64_t monoMs;        // monotonic capture time since boot [ms]
+};
+
+// one output size of a picture
+struct SPictureOutput {
+    std::string fileName;
+    uint64_t timeMs;        // wall clock capture time [ms]
+    SPictureMeta meta;
+    cv::Mat image;
+    PixelFormat format;
+    std::vector<unsigned char> app1;    // EXIF written by JPEG encoder, empty = none
+    std::vector<unsigned char> encoded;
+};
+
+// blocking FIFO with fixed capacity, producers wait while it is full
+template <typename T>
+class CBoundedQueue {
+public:
+    explicit CBoundedQueue(size_t capacity) :
+        m_capacity(capacity),
+        m_maxDepth(0),
+        m_closed(false) {
+        pthread_mutex_init(&m_lock, NULL);
+        pthread_cond_init(&m_notEmpty, NULL);
+        pthread_cond_init(&m_notFull, NULL);
+    }
+
+    ~CBoundedQueue() {
+        pthread_cond_destroy(&m_notFull);
+        pthread_cond_destroy(&m_notEmpty);
+        pthread_mutex_destroy(&m_lock);
+    }
+
+    // push item, wait while queue is full, fails if queue is closed
+    bool Push(const T &item, bool wait = true) {
+        pthread_mutex_lock(&m_lock);
+        while (!m_closed && (m_items.size() >= m_capacity)) {
+            if (!wait) break;
+            pthread_cond_wait(&m_notFull, &m_lock);
+        }
+        if (m_closed || (m_items.size() >= m_capacity)) {
+            pthread_mutex_unlock(&m_lock);
+            return false;
+        }
+        m_items.push_back(item);
+        if (m_items.size() > m_maxDepth) m_maxDepth = m_items.size();
+        pthread_cond_signal(&m_notEmpty);
+        pthread_mutex_unlock(&m_lock);
+        return true;
+    }
+
+    // pop item, wait while queue is empty, fails if queue is closed and empty
+    bool Pop(T &item) {
+        pthread_mutex_lock(&m_lock);
+        while (!m_closed && m_items.empty()) pthread_cond_wait(&m_notEmpty, &m_lock);
+        if (m_items.empty()) {
+            pthread_mutex_unlock(&m_lock);
+            return false;
+        }
+        item = m_items.front();
+        m_items.pop_front();
+        pthread_cond_signal(&m_notFull);
+        pthread_mutex_unlock(&m_lock);
+        return true;
+    }
+
+    // wake up all waiting threads, remaining items can be still popped
+    void Close() {
+        pthread_mutex_lock(&m_lock);
+        m_closed = true;
+        pthread_cond_broadcast(&m_notEmpty);
+        pthread_cond_broadcast(&m_notFull);
+        pthread_mutex_unlock(&m_lock);
+    }
+
+    void Reopen() {
+        pthread_mutex_lock(&m_lock);
+        m_closed = false;
+        pthread_mutex_unlock(&m_lock);
+    }
+
+    size_t GetDepth() {
+        pthread_mutex_lock(&m_lock);
+        size_t depth = m_items.size();
+        pthread_mutex_unlock(&m_lock);
+        return depth;
+    }
+
+    inline size_t GetMaxDepth() { return m_maxDepth; }
+    inline size_t GetCapacity() { return m_capacity; }
+
+private:
+    CBoundedQueue(CBoundedQueue const& copy); // not implemented
+    CBoundedQueue& operator=(CBoundedQueue const& copy); // not implemented
+
+private:
+    std::deque<T> m_items;
+    size_t m_capacity;
+    size_t m_maxDepth;
+    bool m_closed;
+    pthread_mutex_t m_lock;
+    pthread_cond_t m_notEmpty;
+    pthread_cond_t m_notFull;
+};
+
+class CPictureJob;
+class CPicture;
+
+typedef void (*PictureCallback)(CPictureJob *pJob, void *pArg);
+
+enum JobStatus {
+    JOB_PENDING = 0,
+    JOB_DONE,
+    JOB_FAILED,
+    JOB_SKIPPED,    // no motion, picture was not saved
+    JOB_COUNT
+};
+
+// pipeline stages
+enum PipeStage {
+    PS_CAPTURE = 0,
+    PS_ENCODE,
+    PS_WRITE,
+    PS_COUNT
+};
+
+// completion handle for one picture, shared by caller and pipeline
+class CPictureJob {
+public:
+    CPictureJob(const std::string &fileName, PictureCallback callback, void *pArg);
+
+    void AddRef();
+    void Release();
+
+    // wait for completion, tmt in [ms], 0 = forever
+    int Wait(unsigned tmt = 0);
+    inline int GetStatus() { return m_status; }
+    inline const std::string& GetFileName() { return m_fileName; }
+    inline double GetStageTime(PipeStage stage) { return m_stageTime[stage]; }
+    // encoded outputs, valid after successful completion, 0 = full size
+    inline size_t GetOutputCount() { return m_outputs.size(); }
+    const std::vector<unsigned char>& GetEncoded(size_t idx = 0);
+    // uplink delta packet, empty if delta uplink is off
+    inline const std::vector<unsigned char>& GetUplinkPacket() { return m_uplink; }
+
+private:
+    ~CPictureJob();
+    void Complete(int status);
+
+private:
+    std::string m_fileName;
+    PictureCallback m_callback;
+    void *m_pArg;
+    cv::Mat m_image;
+    PixelFormat m_format;
+    std::vector<SPictureOutput> m_outputs;
+    std::vector<unsigned char> m_uplink;
+    std::vector<SOverlayText> m_texts;
+    SPictureMeta m_meta;
+    double m_submitTime;
+    double m_stageTime[PS_COUNT];   // stage latency incl. queue wait [s]
+    unsigned m_seq;     // capture order, encoders may finish jobs in any order
+    int m_pending;      // outputs not encoded yet
+    int m_failed;       // outputs failed to encode
+    volatile int m_status;
+    int m_refCount;
+    pthread_mutex_t m_lock;
+    pthread_cond_t m_done;
+    friend class CPicturePipeline;
+    friend class CPicture;
+};
+
+// pipeline counters
+struct SPipeStats {
+    unsigned jobs[PS_COUNT];        // jobs processed by stage
+    unsigned failed;                // failed jobs
+    unsigned skipped;               // jobs skipped by motion gate
+    double latency[PS_COUNT];       // summed stage latency [s]
+    double maxLatency[PS_COUNT];    // max stage latency [s]
+    size_t depth[PS_COUNT];         // actual queue depth in front of stage
+    size_t maxDepth[PS_COUNT];      // max queue depth in front of stage
+};
+
+// capture -> encode -> write pipeline running on its own threads
+class CPicturePipeline {
+public:
+    explicit CPicturePipeline(CPicture *pPicture);
+    ~CPicturePipeline();
+
+    bool Start(unsigned encoders = 0);
+    void Stop();
+    inline bool IsRunning() { return m_running; }
+
+    bool Submit(CPictureJob *pJob);
+    void GetStats(SPipeStats &stats);
+
+private:
+    static void* RunCapture(void *pArg);
+    static void* RunEncode(void *pArg);
+    static void* RunWrite(void *pArg);
+    void CaptureLoop();
+    void EncodeLoop();
+    void WriteLoop();
+    void Finish(CPictureJob *pJob, PipeStage stage, int status);
+    void EncodeDone(CPictureJob *pJob, bool ok, double start);
+    void WriteJob(CPictureJob *pJob);
+
+    // one output of a job waiting for encoder
+    struct SEncodeItem {
+        CPictureJob *pJob;
+        size_t idx;
+    };
+    void Account(CPictureJob *pJob, PipeStage stage, double start);
+    // resize buffers of smaller outputs are reused by following jobs
+    void TakeBuffers(CPictureJob *pJob);
+    void ReturnBuffer(size_t idx, cv::Mat &image);
+
+private:
+    CPicture *m_pPicture;
+    CBoundedQueue<CPictureJob*> m_captureQueue;
+    CBoundedQueue<SEncodeItem> m_encodeQueue;
+    CBoundedQueue<CPictureJob*> m_writeQueue;
+    pthread_t m_captureThread;
+    pthread_t m_encodeThreads[PIPE_MAX_ENCODERS];
+    pthread_t m_writeThread;
+    unsigned m_encoders;
+    // sequence of the next job handed to encoders
+    unsigned m_nextSeq;
+    bool m_running;
+    SPipeStats m_stats;
+    pthread_mutex_t m_statsLock;
+    std::vector<cv::Mat> m_buffers[PIPE_MAX_OUTPUTS];
+    pthread_mutex_t m_buffersLock;
+};
+
+#endif // PIPELINE_H_
@@ -0,0 +1,98 @@
+#include "common.h"
+#include "logger.h"
+
+#include "framesource.h"
+#include "imgproc.h"
+#include "quality.h"
+
+CQualityGate::CQualityGate() :
+    m_sharpness(0),
+    m_luma(0),
+    m_spread(0),
+    m_clipped(0) {
+    m_thresholds.minSharpness = QUALITY_DEF_SHARPNESS;
+    m_thresholds.minLuma = QUALITY_DEF_MIN_LUMA;
+    m_thresholds.maxLuma = QUALITY_DEF_MAX_LUMA;
+    m_thresholds.minSpread = QUALITY_DEF_SPREAD;
+    m_thresholds.maxClipped = QUALITY_DEF_CLIPPED;
+    memset(m_hist, 0, sizeof(m_hist));
+}
+
+CQualityGate::~CQualityGate() {
+    m_act.release();
+}
+
+void CQualityGate::SetThresholds(const SQualityThresholds &thresholds) {
+    m_thresholds = thresholds;
+}
+
+void CQualityGate::ScoreHistogram() {
+    uint64_t count = 0, sum = 0;
+    unsigned clipped = 0;
+
+    for (int i = 0; i < 256; i++) {
+        count += m_hist[i];
+        sum += (uint64_t)i * m_hist[i];
+        if ((i <= QUALITY_DARK_LEVEL) || (i >= QUALITY_BRIGHT_LEVEL)) clipped += m_hist[i];
+    }
+
+    if (!count) {
+        m_luma = 0;
+        m_spread = 0;
+        m_clipped = 1;
+        return;
+    }
+
+    m_luma = (float)sum / count;
+    m_clipped = (float)clipped / count;
+
+    // distance of low and high percentile
+    uint64_t low = count * QUALITY_SPREAD_LOW / 100;
+    uint64_t high = count * QUALITY_SPREAD_HIGH / 100;
+    uint64_t acc = 0;
+    int lowBin = -1, highBin = 255;
+    for (int i = 0; i < 256; i++) {
+        acc += m_hist[i];
+        if ((lowBin < 0) && (acc > low)) lowBin = i;
+        if (acc > high) {
+            highBin = i;
+            break;
+        }
+    }
+    m_spread = highBin - lowBin;
+}
+
+bool CQualityGate::Process(const cv::Mat &frame, PixelFormat format) {
+    // only BGR and I420 frames are supported
+    if (!CheckFrame(frame, format)) {
+        LOG_ERROR("quality gate needs BGR or YUV420 frame!");
+        return true;
+    }
+
+    // luma grid into reused buffer, Y plane of I420 is used as it is
+    cv::Size size = GetFrameSize(frame, format);
+    m_act.create(size.height / QUALITY_STEP, size.width / QUALITY_STEP, CV_8UC1);
+    SubsampleLuma(frame.data, size.width, size.height, frame.step, QUALITY_STEP, m_act.data, m_act.step,
+            frame.channels());
+
+    // variance of Laplacian drops with blur and fog
+    int64_t sum;
+    uint64_t sumSq;
+    LaplacianSums(m_act.data, m_act.cols, m_act.rows, m_act.step, sum, sumSq);
+    double n = (double)(m_act.cols - 2) * (m_act.rows - 2);
+    if (n > 0) {
+        double mean = sum / n;
+        m_sharpness = (float)(sumSq / n - mean * mean);
+    } else {
+        m_sharpness = 0;
+    }
+
+    // exposure from luma histogram
+    Histogram(m_act.data, m_act.cols, m_act.rows, m_act.step, m_hist);
+    ScoreHistogram();
+
+    if (m_sharpness < m_thresholds.minSharpness) return false;
+    if ((m_luma < m_thresholds.minLuma) || (m_luma > m_thresholds.maxLuma)) return false;
+    if (m_spread < m_thresholds.minSpread) return false;
+    return m_clipped <= m_thresholds.maxClipped;
+}
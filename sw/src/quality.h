@@ -0,0 +1,73 @@
+#ifndef QUALITY_H_
+#define QUALITY_H_
+
+#include <opencv2/core.hpp>
+
+#include "framesource.h"
+
+// grid step of analysed luma image
+#define QUALITY_STEP 2
+// luma at or below is counted as clipped dark, at or above as clipped bright
+#define QUALITY_DARK_LEVEL 8
+#define QUALITY_BRIGHT_LEVEL 247
+// spread is measured between these percentiles of the luma histogram
+#define QUALITY_SPREAD_LOW 5
+#define QUALITY_SPREAD_HIGH 95
+// default thresholds, sharpness is Laplacian variance of the luma grid
+#define QUALITY_DEF_SHARPNESS 20.0f
+#define QUALITY_DEF_MIN_LUMA 24
+#define QUALITY_DEF_MAX_LUMA 232
+#define QUALITY_DEF_SPREAD 24
+#define QUALITY_DEF_CLIPPED 0.5f
+// default count of new captures of rejected frame
+#define QUALITY_DEF_RETRIES 2
+
+typedef enum QualityGateMode {
+    QG_OFF = 0,     // frames are not scored
+    QG_SCORE,       // scores go to metadata, every frame is saved
+    QG_DROP,        // rejected frames are not saved
+    QG_RETRY,       // rejected frames are captured again, dropped when retries run out
+    QG_COUNT
+} QualityGateMode;
+
+// frame is rejected when any threshold is not met, 0 disables minimum
+struct SQualityThresholds {
+    float minSharpness;     // blur, fog
+    unsigned minLuma;       // dark frame
+    unsigned maxLuma;       // overexposed frame, 255 = off
+    unsigned minSpread;     // low contrast (fog, lens cover)
+    float maxClipped;       // ratio of clipped pixels, 1 = off
+};
+
+// blur and exposure scoring on subsampled greyscale image
+class CQualityGate {
+public:
+    CQualityGate();
+    ~CQualityGate();
+
+    void SetThresholds(const SQualityThresholds &thresholds);
+    inline const SQualityThresholds& GetThresholds() { return m_thresholds; }
+
+    // score frame, true if it meets all thresholds
+    bool Process(const cv::Mat &frame, PixelFormat format);
+
+    // scores of the last processed frame
+    inline float GetSharpness() { return m_sharpness; }
+    inline float GetLuma() { return m_luma; }
+    inline unsigned GetSpread() { return m_spread; }
+    inline float GetClipped() { return m_clipped; }
+
+private:
+    void ScoreHistogram();
+
+private:
+    cv::Mat m_act;
+    SQualityThresholds m_thresholds;
+    unsigned m_hist[256];
+    float m_sharpness;
+    float m_luma;
+    unsigned m_spread;
+    float m_clipped;
+};
+
+#endif // QUALITY_H_
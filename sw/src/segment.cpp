@@ -0,0 +1,209 @@
+#include "common.h"
+#include "logger.h"
+#include <errno.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <algorithm>
+
+#include "storage.h"
+#include "segment.h"
+
+// padding of records
+static const unsigned char c_pad[SEGMENT_ALIGN] = { 0 };
+
+static size_t PadSize(size_t size) {
+    return (SEGMENT_ALIGN - size % SEGMENT_ALIGN) % SEGMENT_ALIGN;
+}
+
+static uint32_t RecordCrc(const SSegmentRecord &header, const unsigned char *pData, const char *pName) {
+    SSegmentRecord tmp = header;
+    tmp.crc = 0;
+
+    uint32_t crc = Crc32(&tmp, sizeof(tmp));
+    crc = Crc32(pData, header.size, crc);
+    return Crc32(pName, header.nameLen, crc);
+}
+
+CSegmentWriter::CSegmentWriter() :
+    m_fd(-1),
+    m_size(0),
+    m_capacity(0) {
+}
+
+CSegmentWriter::~CSegmentWriter() {
+    Close();
+}
+
+bool CSegmentWriter::Open(const std::string &path, uint64_t capacity) {
+    Close();
+
+    // never append into an existing segment
+    if ((m_fd = open(path.c_str(), O_RDWR | O_CREAT | O_EXCL, 0644)) < 0) {
+        LOG_ERROR("can not create segment %s!", path.c_str());
+        return false;
+    }
+
+    // whole segment in continuous blocks, zeroed tail ends the record scan
+    CStorageManager::Preallocate(m_fd, capacity);
+
+    if (write(m_fd, SEGMENT_MAGIC, SEGMENT_MAGIC_LEN) != SEGMENT_MAGIC_LEN) {
+        LOG_ERROR("can not write segment header!");
+        close(m_fd);
+        m_fd = -1;
+        return false;
+    }
+
+    m_path = path;
+    m_size = SEGMENT_MAGIC_LEN;
+    m_capacity = capacity;
+
+    LOG_DEBUG("segment %s was created", path.c_str());
+    return true;
+}
+
+bool CSegmentWriter::Append(unsigned output, const std::string &name, const unsigned char *pData, size_t size,
+        uint64_t timeMs, uint64_t &dataOffset) {
+    if (m_fd < 0) {
+        LOG_ERROR("segment is not open!");
+        return false;
+    }
+
+    SSegmentRecord header;
+    memset(&header, 0, sizeof(header));
+    header.tag = SEGMENT_RECORD_TAG;
+    header.size = size;
+    header.timeMs = timeMs;
+    header.nameLen = std::min(name.size(), (size_t)0xffff);
+    header.output = output;
+    header.crc = RecordCrc(header, pData, name.c_str());
+
+    // header, data, name and padding by one syscall without copying data
+    struct iovec iov[4];
+    size_t pad = PadSize(sizeof(header) + size + header.nameLen);
+    iov[0].iov_base = &header;
+    iov[0].iov_len = sizeof(header);
+    iov[1].iov_base = (void*)pData;
+    iov[1].iov_len = size;
+    iov[2].iov_base = (void*)name.c_str();
+    iov[2].iov_len = header.nameLen;
+    iov[3].iov_base = (void*)c_pad;
+    iov[3].iov_len = pad;
+
+    ssize_t total = sizeof(header) + size + header.nameLen + pad;
+    if (pwritev(m_fd, iov, 4, m_size) != total) {
+        LOG_ERROR("can not append to segment %s!", m_path.c_str());
+        // partial record is overwritten by the next one, readers stop on its checksum
+        return false;
+    }
+
+    dataOffset = m_size + sizeof(header);
+    m_size += total;
+    return true;
+}
+
+bool CSegmentWriter::Sync() {
+    if (m_fd < 0) return true;
+    return fdatasync(m_fd) == 0;
+}
+
+bool CSegmentWriter::Close() {
+    if (m_fd < 0) return true;
+
+    // unused preallocated space is returned, size change needs fsync
+    bool ok = (ftruncate(m_fd, m_size) == 0) && (fsync(m_fd) == 0);
+    if (close(m_fd) != 0) ok = false;
+    m_fd = -1;
+
+    if (!ok) {
+        LOG_ERROR("can not close segment %s!", m_path.c_str());
+        return false;
+    }
+
+    LOG_DEBUG("segment %s was closed with %llu bytes", m_path.c_str(),
+            (unsigned long long)m_size);
+    return true;
+}
+
+CSegmentReader::CSegmentReader() :
+    m_fd(-1),
+    m_pMap(NULL),
+    m_mapSize(0) {
+}
+
+CSegmentReader::~CSegmentReader() {
+    Close();
+}
+
+bool CSegmentReader::Open(const std::string &path) {
+    struct stat st;
+
+    Close();
+
+    if ((m_fd = open(path.c_str(), O_RDONLY)) < 0) {
+        LOG_ERROR("can not open segment %s!", path.c_str());
+        return false;
+    }
+
+    if ((fstat(m_fd, &st) < 0) || (st.st_size < SEGMENT_MAGIC_LEN)) {
+        LOG_ERROR("%s is not a segment!", path.c_str());
+        Close();
+        return false;
+    }
+
+    void *pMap = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, m_fd, 0);
+    if (pMap == MAP_FAILED) {
+        LOG_ERROR("can not map segment %s: %s", path.c_str(), strerror(errno));
+        Close();
+        return false;
+    }
+    m_pMap = (const unsigned char*)pMap;
+    m_mapSize = st.st_size;
+
+    // check header
+    if (memcmp(m_pMap, SEGMENT_MAGIC, SEGMENT_MAGIC_LEN)) {
+        LOG_ERROR("%s is not a segment!", path.c_str());
+        Close();
+        return false;
+    }
+
+    return true;
+}
+
+void CSegmentReader::Close() {
+    if (m_pMap != NULL) munmap((void*)m_pMap, m_mapSize);
+    m_pMap = NULL;
+    m_mapSize = 0;
+
+    if (m_fd >= 0) close(m_fd);
+    m_fd = -1;
+}
+
+bool CSegmentReader::Check(uint64_t offset, SSegmentView &view) {
+    if ((m_pMap == NULL) || (offset % SEGMENT_ALIGN) || (offset + sizeof(SSegmentRecord) > m_mapSize)) return false;
+
+    const SSegmentRecord *pHeader = (const SSegmentRecord*)(m_pMap + offset);
+    if ((pHeader->tag != SEGMENT_RECORD_TAG) ||
+            (offset + sizeof(SSegmentRecord) + pHeader->size + pHeader->nameLen > m_mapSize)) return false;
+
+    view.pHeader = pHeader;
+    view.dataOffset = offset + sizeof(SSegmentRecord);
+    view.pData = m_pMap + view.dataOffset;
+    view.pName = (const char*)view.pData + pHeader->size;
+
+    // torn or stale record after power loss
+    return RecordCrc(*pHeader, view.pData, view.pName) == pHeader->crc;
+}
+
+bool CSegmentReader::Next(uint64_t &offset, SSegmentView &view) {
+    if (!Check(offset, view)) return false;
+
+    offset = view.dataOffset + view.pHeader->size + view.pHeader->nameLen;
+    offset += PadSize(offset);
+    return true;
+}
+
+bool CSegmentReader::Get(uint64_t dataOffset, SSegmentView &view) {
+    if (dataOffset < sizeof(SSegmentRecord)) return false;
+    return Check(dataOffset - sizeof(SSegmentRecord), view);
+}
@@ -0,0 +1,91 @@
+#ifndef SEGMENT_H_
+#define SEGMENT_H_
+
+#include <stdint.h>
+#include <string>
+
+// file header of segment
+#define SEGMENT_MAGIC "CAMSEG01"
+#define SEGMENT_MAGIC_LEN 8
+// tag of record header, "SREC"
+#define SEGMENT_RECORD_TAG 0x43455253
+// records are aligned in the file
+#define SEGMENT_ALIGN 8
+// default size of preallocated segment
+#define SEGMENT_DEF_SIZE (32 * 1024 * 1024)
+#define SEGMENT_PREFIX "segment-"
+#define SEGMENT_EXT ".seg"
+
+// header of every record, followed by data, name and padding
+struct SSegmentRecord {
+    uint32_t tag;
+    uint32_t size;          // data size
+    uint64_t timeMs;        // wall clock capture time [ms]
+    uint32_t crc;           // CRC-32 of header with crc = 0, data and name
+    uint16_t nameLen;
+    uint8_t output;         // 0 = full size
+    uint8_t reserved;
+};
+
+// record in mapped segment, pointers are valid while reader is open
+struct SSegmentView {
+    const SSegmentRecord *pHeader;
+    const unsigned char *pData;
+    const char *pName;
+    uint64_t dataOffset;
+};
+
+// appends records into a preallocated segment file
+class CSegmentWriter {
+public:
+    CSegmentWriter();
+    ~CSegmentWriter();
+
+    bool Open(const std::string &path, uint64_t capacity);
+    // offset of data is returned for the index
+    bool Append(unsigned output, const std::string &name, const unsigned char *pData, size_t size, uint64_t timeMs,
+            uint64_t &dataOffset);
+    bool Sync();
+    // unused preallocated space is released
+    bool Close();
+
+    inline bool IsOpen() { return m_fd >= 0; }
+    inline uint64_t GetSize() { return m_size; }
+    // record with given sizes does not fit
+    inline bool IsFull(size_t size, size_t nameLen) {
+        return m_size + sizeof(SSegmentRecord) + size + nameLen > m_capacity;
+    }
+
+private:
+    int m_fd;
+    std::string m_path;
+    uint64_t m_size;
+    uint64_t m_capacity;
+};
+
+// zero-copy access to records of memory mapped segment
+class CSegmentReader {
+public:
+    CSegmentReader();
+    ~CSegmentReader();
+
+    bool Open(const std::string &path);
+    void Close();
+
+    // record at offset, offset is moved to the next one, false at the end of valid records
+    bool Next(uint64_t &offset, SSegmentView &view);
+    // record by data offset stored in the index
+    bool Get(uint64_t dataOffset, SSegmentView &view);
+    // offset of the first record
+    inline uint64_t GetStart() { return SEGMENT_MAGIC_LEN; }
+
+private:
+    bool Check(uint64_t offset, SSegmentView &view);
+
+private:
+    int m_fd;
+    const unsigned char *m_pMap;
+    size_t m_mapSize;
+};
+
+#endif // SEGMENT_H_
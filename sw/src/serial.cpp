@@ -17,13 +17,13 @@ CSerial::~CSerial() {
 
 bool CSerial::Open(const BaudRate baudrate, const char *device) {
 	if (m_isOpened) {
-		CLogger::GetLogger()->LogPrintf(LL_ERROR, "device %s is already opened!", m_devNode.c_str());
+		LOG_ERROR("device %s is already opened!", m_devNode.c_str());
 		return false;
 	}
 
 	// check if device is entered
 	if (device == NULL) {
-		CLogger::GetLogger()->LogPrintf(LL_ERROR, "device %s is null!", device);
+		LOG_ERROR("device %s is null!", device);
 		return false;
 	}
 
@@ -33,7 +33,7 @@ bool CSerial::Open(const BaudRate baudrate, const char *device) {
 	// open device
 	// rd+rw, without terminal access, non-blocking mode
 	if ((m_devFd = open(m_devNode.c_str(), O_RDWR | O_NOCTTY | O_NDELAY | O_NONBLOCK)) < 0) {
-		CLogger::GetLogger()->LogPrintf(LL_ERROR, "can not access to device %s!", m_devNode.c_str());
+		LOG_ERROR("can not access to device %s!", m_devNode.c_str());
 		m_devNode.clear();
 		return false;
 	}
@@ -64,7 +64,7 @@ bool CSerial::Open(const BaudRate baudrate, const char *device) {
 		tcflush(m_devFd, TCIFLUSH);
 		tcsetattr(m_devFd, TCSANOW, &options);
 	} catch (std::exception &ex) {
-		CLogger::GetLogger()->LogPrintf(LL_ERROR, "can not set parameters to device %s!", m_devNode.c_str());
+		LOG_ERROR("can not set parameters to device %s!", m_devNode.c_str());
 
 		// cleaning
 		m_devNode.clear();
@@ -75,7 +75,7 @@ bool CSerial::Open(const BaudRate baudrate, const char *device) {
 	// set connection flag
 	m_isOpened = true;
 
-	CLogger::GetLogger()->LogPrintf(LL_DEBUG, "device %s@%i was successfully initialized", m_devNode.c_str(), baudrate);
+	LOG_DEBUG("device %s@%i was successfully initialized", m_devNode.c_str(), baudrate);
 
 	return true;
 }
@@ -95,31 +95,31 @@ void CSerial::Close() {
 void CSerial::Putc(char c) {
 	// check connection
 	if ((!m_isOpened) || (!m_devFd)) {
-		CLogger::GetLogger()->LogPrintf(LL_ERROR, "device %s is not open!", m_devNode.c_str());
+		LOG_ERROR("device %s is not open!", m_devNode.c_str());
 		return;
 	}
 
 	// write data to device
 	if (write(m_devFd, &c, 1) != 1)
-		CLogger::GetLogger()->LogPrintf(LL_ERROR, "can not write data to device %s!", m_devNode.c_str());
+		LOG_ERROR("can not write data to device %s!", m_devNode.c_str());
 }
 
 void CSerial::Puts(const char *data, size_t len) {
 	// check connection
 	if ((!m_isOpened) || (!m_devFd)) {
-		CLogger::GetLogger()->LogPrintf(LL_ERROR, "device %s is not open!", m_devNode.c_str());
+		LOG_ERROR("device %s is not open!", m_devNode.c_str());
 		return;
 	}
 
 	// check output data
 	if (data == NULL) {
-		CLogger::GetLogger()->LogPrintf(LL_ERROR, "output data are null!");
+		LOG_ERROR("output data are null!");
 		return;
 	}
 
 	// write data to device
 	if (write(m_devFd, data, len) != (ssize_t)len)
-		CLogger::GetLogger()->LogPrintf(LL_ERROR, "can not write data to device %s!", m_devNode.c_str());
+		LOG_ERROR("can not write data to device %s!", m_devNode.c_str());
 }
 
 void CSerial::Printf(const char *message, ...) {
@@ -134,7 +134,7 @@ void CSerial::Printf(const char *message, ...) {
 	size = vsnprintf(NULL, 0, message, args) + 1;
 	// check max size
 	if (size > (MAX_BUFF_SIZE - 1)) {
-		CLogger::GetLogger()->LogPrintf(LL_ERROR, "tx message is too long!");
+		LOG_ERROR("tx message is too long!");
 		return;
 	}
 
@@ -160,7 +160,7 @@ void CSerial::Printf(const std::string &message) {
 char CSerial::Getc() {
 	// check connection
 	if ((!m_isOpened) || (!m_devFd)) {
-		CLogger::GetLogger()->LogPrintf(LL_ERROR, "device %s is not open!", m_devNode.c_str());
+		LOG_ERROR("device %s is not open!", m_devNode.c_str());
 		return 0;
 	}
 
@@ -168,7 +168,7 @@ char CSerial::Getc() {
 
 	// read data from device
 	if (read(m_devFd, &c, 1) != 1) {
-		CLogger::GetLogger()->LogPrintf(LL_ERROR, "can not read data from deice() %s", m_devNode.c_str());
+		LOG_ERROR("can not read data from deice() %s", m_devNode.c_str());
 		c = -1;
 	}
 
@@ -178,7 +178,7 @@ char CSerial::Getc() {
 size_t CSerial::DataAvailable() {
 	// check connection
 	if ((!m_isOpened) || (!m_devFd)) {
-		CLogger::GetLogger()->LogPrintf(LL_ERROR, "device %s is not open!", m_devNode.c_str());
+		LOG_ERROR("device %s is not open!", m_devNode.c_str());
 		return 0;
 	}
 
@@ -188,10 +188,10 @@ size_t CSerial::DataAvailable() {
 		// get count of available data to read
 		if (ioctl(m_devFd, FIONREAD, &count) < 0) {
 			//TODO: timeout problem?
-			//CLogger::GetLogger()->LogPrintf(LL_ERROR, "cant DataAvailable() %s", ex.what());
+			//LOG_ERROR("cant DataAvailable() %s", ex.what());
 		}
 	} catch (std::exception &ex) {
-		CLogger::GetLogger()->LogPrintf(LL_ERROR, "DataAvailable() %s", ex.what());
+		LOG_ERROR("DataAvailable() %s", ex.what());
 		count = 0;
 	}
 
@@ -201,7 +201,7 @@ size_t CSerial::DataAvailable() {
 void CSerial::Flush() {
     // check connection
     if ((!m_isOpened) || (!m_devFd)) {
-        CLogger::GetLogger()->LogPrintf(LL_ERROR, "device %s is not open!", m_devNode.c_str());
+        LOG_ERROR("device %s is not open!", m_devNode.c_str());
         return;
     }
 
@@ -209,6 +209,6 @@ void CSerial::Flush() {
         // flush buffer
         tcflush(m_devFd, TCIOFLUSH);
     } catch (std::exception &ex) {
-        CLogger::GetLogger()->LogPrintf(LL_ERROR, "Flush() %s", ex.what());
+        LOG_ERROR("Flush() %s", ex.what());
     }
 }
@@ -36,7 +36,7 @@ int CGSM::SendATCmd(const char *ATcmd, unsigned long tmt, unsigned long maxChars
 
     // check AT command
     if (ATcmd == NULL) {
-        CLogger::GetLogger()->LogPrintf(LL_ERROR, "AT command is missing!");
+        LOG_ERROR("AT command is missing!");
         return ret;
     }
 
@@ -71,7 +71,7 @@ int CGSM::SendATCmd(const char *ATcmd, unsigned long tmt, unsigned long maxChars
 void CGSM::_Write(const char *data, size_t len) {
     // check data to write
     if (data == NULL) {
-        CLogger::GetLogger()->LogPrintf(LL_ERROR, "data to write are missing!");
+        LOG_ERROR("data to write are missing!");
         return;
     }
 
@@ -82,7 +82,7 @@ void CGSM::_Write(const char *data, size_t len) {
 void CGSM::_WriteLn(const char *data, size_t len) {
     // check data to write
     if (data == NULL) {
-        CLogger::GetLogger()->LogPrintf(LL_ERROR, "data to write are missing!");
+        LOG_ERROR("data to write are missing!");
         return;
     }
 
@@ -95,14 +95,14 @@ void CGSM::_WriteLn(const char *data, size_t len) {
 size_t CGSM::Read(char *pOut, size_t len) {
     // check if output buffer is not null
     if (pOut == NULL) {
-        CLogger::GetLogger()->LogPrintf(LL_ERROR, "output buffer is null!");
+        LOG_ERROR("output buffer is null!");
         return 0;
     }
 
     size_t idx = 0;
     char c;
 
-    CLogger::GetLogger()->LogPrintf(LL_DEBUG, "waiting for incoming data from device");
+    LOG_DEBUG("waiting for incoming data from device");
 
     // wait while incoming data are not available
     while (!m_pSerial->DataAvailable()) usleep(100000);
@@ -119,7 +119,7 @@ size_t CGSM::Read(char *pOut, size_t len) {
     // terminate output buffer
     *(pOut + (len - 1)) = '\0';
 
-    CLogger::GetLogger()->LogPrintf(LL_DEBUG, "incoming data: %s", pOut);
+    LOG_DEBUG("incoming data: %s", pOut);
 
     return idx;
 }
@@ -170,7 +170,7 @@ int CGSM::WaitResp(unsigned long tmt, unsigned long maxCharsTmt, const char *exp
             } else {
                 // check timeout
                 if ((unsigned long)(GetTimeMSec() - tsStart) >= tmt) {
-                    CLogger::GetLogger()->LogPrintf(LL_DEBUG, "Reception timeout occurred");
+                    LOG_DEBUG("Reception timeout occurred");
                     // clean receiving buffer
                     m_commBuff[0] = '\0';
                     status = RX_ST_TIMEOUT_ERR;
@@ -194,13 +194,15 @@ int CGSM::WaitResp(unsigned long tmt, unsigned long maxCharsTmt, const char *exp
                     *pCommBuff++ = m_pSerial->Getc();
                     *pCommBuff = '\0';
                 } else {
-                    CLogger::GetLogger()->LogPrintf(LL_DEBUG, "Received data %c is out of range", m_pSerial->Getc());
+                    // byte is consumed even if it is not logged
+                    char c = m_pSerial->Getc();
+                    LOG_DEBUG("Received data %c is out of range", c);
                 }
             }
 
             // check interchar timeout
             if ((unsigned long)(GetTimeMSec() - tsStart) >= maxCharsTmt) {
-                CLogger::GetLogger()->LogPrintf(LL_DEBUG, "Receiving was finished");
+                LOG_DEBUG("Receiving was finished");
                 // terminate buffer
                 *pCommBuff++ = '\0';
                 status = RX_ST_FINISHED;
@@ -226,13 +228,13 @@ int CGSM::WaitResp(unsigned long tmt, unsigned long maxCharsTmt, const char *exp
 
 bool CGSM::CheckRcvdResp(const char *str) {
     if (str == NULL) {
-        CLogger::GetLogger()->LogPrintf(LL_ERROR, "String for comparison is missing!");
+        LOG_ERROR("String for comparison is missing!");
         return false;
     }
 
     // compare strings
     if (strstr(m_commBuff, str) == NULL) {
-        CLogger::GetLogger()->LogPrintf(LL_ERROR, "Received answer %s is different from expectation %s",
+        LOG_ERROR("Received answer %s is different from expectation %s",
             m_commBuff, str);
         return false;
     }
@@ -256,14 +258,14 @@ bool CSIM900::Init(const BaudRate baudrate, const char *device) {
 
     // init gsm class with serial
     if (!CGSM::Init(baudrate, device)) {
-        CLogger::GetLogger()->LogPrintf(LL_ERROR, "Error in GSM class initialization!");
+        LOG_ERROR("Error in GSM class initialization!");
         return m_initialized;
     }
 
     // if no-reply we turn to turn on the module
     for (retry = 0; retry < 3; retry++) {
         if ((SendATCmd(STR_AT, 500, 100, STR_OK STR_CRLF, 5) == AT_RESP_NO_RESP) && (!turnedON)) {
-            CLogger::GetLogger()->LogPrintf(LL_DEBUG, "SIM900: No response");
+            LOG_DEBUG("SIM900: No response");
 
             // turn on module
             gpioON.SetValue(true);
@@ -274,7 +276,7 @@ bool CSIM900::Init(const BaudRate baudrate, const char *device) {
             // wait for response
             WaitResp(1000, 1000);
         } else {
-            CLogger::GetLogger()->LogPrintf(LL_DEBUG, "SIM900: next step to init device");
+            LOG_DEBUG("SIM900: next step to init device");
             noResp = false;
             // wait for response
             WaitResp(1000, 1000);
@@ -283,13 +285,13 @@ bool CSIM900::Init(const BaudRate baudrate, const char *device) {
 
     // check if device is started
     if (SendATCmd(STR_AT, 500, 100, STR_OK STR_CRLF, 5)) {
-        CLogger::GetLogger()->LogPrintf(LL_DEBUG, "SIM900: started");
+        LOG_DEBUG("SIM900: started");
         turnedON = true;
     }
 
     // check started status
     if (retry == 3 && noResp) {
-        CLogger::GetLogger()->LogPrintf(LL_ERROR, "SIM900: doesn't answer");
+        LOG_ERROR("SIM900: doesn't answer");
 
         gpioON.SetValue(true);
         sleep(2);
@@ -331,7 +333,7 @@ std::string CSIM900::GetIMEI() {
     if ((status = WaitResp(5000, 50, STR_OK)) != RX_ST_FINISHED_STR_ERR) {
         // get data from device
         ret = GetCommBuff();
-        CLogger::GetLogger()->LogPrintf(LL_DEBUG, "SIM900: IMEI:%s", ret.c_str());
+        LOG_DEBUG("SIM900: IMEI:%s", ret.c_str());
     }
 
     return ret;
@@ -341,7 +343,7 @@ std::string CSIM900::GetCCI() {
 
     // check status
     if (GetCommStatus() != GSM_ST_READY) {
-        CLogger::GetLogger()->LogPrintf(LL_ERROR, "SIM900: GSM status needs to be ready!");
+        LOG_ERROR("SIM900: GSM status needs to be ready!");
         return std::string();
     }
 
@@ -377,11 +379,11 @@ bool CCtrlGSM::Init(const BaudRate baudrate, const char *device) {
 
 bool CCtrlGSM::AttachGPRS(const char *apn, const char *user, const char *pwd) {
     if (!m_initialized) {
-        CLogger::GetLogger()->LogPrintf(LL_ERROR, "GSM module is not initialized!");
+        LOG_ERROR("GSM module is not initialized!");
         return false;
     }
 
-    CLogger::GetLogger()->LogPrintf(LL_DEBUG, "CCtrlGSM: establishing connection");
+    LOG_DEBUG("CCtrlGSM: establishing connection");
 
     // some delay
     sleep(5);
@@ -392,7 +394,7 @@ bool CCtrlGSM::AttachGPRS(const char *apn, const char *user, const char *pwd) {
     m_pSIM900->WriteLn("AT+CIFSR");
     // wait and check answer
     if (m_pSIM900->WaitResp(5000, 50, STR_ERR) != RX_ST_FINISHED_STR_ERR) {
-        CLogger::GetLogger()->LogPrintf(LL_DEBUG, "CCtrlGSM: Already have an IP");
+        LOG_DEBUG("CCtrlGSM: Already have an IP");
 
         // close connection
         m_pSIM900->WriteLn("AT+CIPCLOSE");
@@ -405,14 +407,14 @@ bool CCtrlGSM::AttachGPRS(const char *apn, const char *user, const char *pwd) {
 
         m_connected = false;
     } else {
-        CLogger::GetLogger()->LogPrintf(LL_DEBUG, "CCtrlGSM: creating new connection");
+        LOG_DEBUG("CCtrlGSM: creating new connection");
 
         // close previous connection
         m_pSIM900->WriteLn("AT+CIPSHUT");
 
         // check response
         if (m_pSIM900->WaitResp(500, 50, "SHUT OK") == (RX_ST_TIMEOUT_ERR || RX_ST_FINISHED_STR_ERR)) {
-            CLogger::GetLogger()->LogPrintf(LL_ERROR, "CCtrlGSM: can not close connection!");
+            LOG_ERROR("CCtrlGSM: can not close connection!");
             m_connected = false;
             return m_connected;
         }
@@ -430,30 +432,30 @@ bool CCtrlGSM::AttachGPRS(const char *apn, const char *user, const char *pwd) {
         m_pSIM900->Write("\""+STR_CR);
         // check response
         if (m_pSIM900->WaitResp(500, 50, STR_OK) == (RX_ST_TIMEOUT_ERR || RX_ST_FINISHED_STR_ERR)) {
-            CLogger::GetLogger()->LogPrintf(LL_ERROR, "CCtrlGSM: can not connect to APN!");
+            LOG_ERROR("CCtrlGSM: can not connect to APN!");
             m_connected = false;
             return m_connected;
         }
 
-        CLogger::GetLogger()->LogPrintf(LL_DEBUG, "CCtrlGSM: connected to APN");
+        LOG_DEBUG("CCtrlGSM: connected to APN");
         sleep(5);
 
         // create connection to with GPRS
         m_pSIM900->Write("AT+CIICR");
         // check response
         if (m_pSIM900->WaitResp(10000, 50, STR_OK) == (RX_ST_TIMEOUT_ERR || RX_ST_FINISHED_STR_ERR)) {
-            CLogger::GetLogger()->LogPrintf(LL_ERROR, "CCtrlGSM: can not create connection with GPRS!");
+            LOG_ERROR("CCtrlGSM: can not create connection with GPRS!");
             m_connected = false;
             return m_connected;
         }
 
-        CLogger::GetLogger()->LogPrintf(LL_DEBUG, "CCtrlGSM: connected with GRPS");
+        LOG_DEBUG("CCtrlGSM: connected with GRPS");
 
         // get local IP address
         m_pSIM900->WriteLn("AT+CIFSR");
         // check response
         if (m_pSIM900->WaitResp(5000, 50, STR_ERR) != RX_ST_FINISHED_STR_OK) {
-            CLogger::GetLogger()->LogPrintf(LL_DEBUG, "CCtrlGSM: IP address was assigned");
+            LOG_DEBUG("CCtrlGSM: IP address was assigned");
 
             // set gsm status as attached
             m_pSIM900->SetGSMStatus(GSM_ST_ATTACHED);
@@ -463,7 +465,7 @@ bool CCtrlGSM::AttachGPRS(const char *apn, const char *user, const char *pwd) {
         }
 
         m_connected = false;
-        CLogger::GetLogger()->LogPrintf(LL_ERROR, "CCtrlGSM: no IP address after connection!");
+        LOG_ERROR("CCtrlGSM: no IP address after connection!");
 
     }
 
@@ -472,7 +474,7 @@ bool CCtrlGSM::AttachGPRS(const char *apn, const char *user, const char *pwd) {
 
 bool CCtrlGSM::DetachGPRS() {
     if (!m_initialized) {
-        CLogger::GetLogger()->LogPrintf(LL_ERROR, "CCtrlGSM: GSM module is not initialized!");
+        LOG_ERROR("CCtrlGSM: GSM module is not initialized!");
         return false;
     }
 
@@ -483,7 +485,7 @@ bool CCtrlGSM::DetachGPRS() {
     m_pSIM900->WriteLn("AT+CGATT=0");
     // check response
     if (m_pSIM900->WaitResp(5000, 50, STR_OK) != RX_ST_FINISHED_STR_ERR) {
-        CLogger::GetLogger()->LogPrintf(LL_ERROR, "CCtrlGSM: can not close connection!");
+        LOG_ERROR("CCtrlGSM: can not close connection!");
 
         // set error status
         m_pSIM900->SetGSMStatus(GSM_ST_ERROR);
@@ -496,10 +498,10 @@ bool CCtrlGSM::DetachGPRS() {
     return true;
 }
 
-bool CCtrlGSM::ConnectTCP(const char *server, unsigned int port) {
+bool CCtrlGSM::ConnectTCP(const char *server, unsigned int port, bool prompt) {
     // check if is connected
     if (!m_connected) {
-        CLogger::GetLogger()->LogPrintf(LL_ERROR, "CCtrlGSM: no GPRS connection!");
+        LOG_ERROR("CCtrlGSM: no GPRS connection!");
         return false;
     }
 
@@ -510,7 +512,7 @@ bool CCtrlGSM::ConnectTCP(const char *server, unsigned int port) {
     m_pSIM900->WriteLn(ToASCII(port));
     // check response
     if (m_pSIM900->WaitResp(1000, 200, STR_OK) == (RX_ST_TIMEOUT_ERR || RX_ST_FINISHED_STR_ERR)) {
-        CLogger::GetLogger()->LogPrintf(LL_ERROR, "CCtrlGSM: can not start TCP connection!");
+        LOG_ERROR("CCtrlGSM: can not start TCP connection!");
         return false;
     }
 
@@ -520,23 +522,26 @@ bool CCtrlGSM::ConnectTCP(const char *server, unsigned int port) {
     // check connection status
     if (!str.compare("CONNECT OK")) {
         if (m_pSIM900->WaitResp(15000, 200, STR_OK) == (RX_ST_TIMEOUT_ERR || RX_ST_FINISHED_STR_ERR)) {
-            CLogger::GetLogger()->LogPrintf(LL_ERROR, "CCtrlGSM: can not connect to server!");
-            CLogger::GetLogger()->LogPrintf(LL_DEBUG, "CCtrlGSM: server response: %s", str.c_str());
+            LOG_ERROR("CCtrlGSM: can not connect to server!");
+            LOG_DEBUG("CCtrlGSM: server response: %s", str.c_str());
             return false;
         }
     }
 
-    CLogger::GetLogger()->LogPrintf(LL_DEBUG, "CCtrlGSM: connected to server: %s", server);
+    LOG_DEBUG("CCtrlGSM: connected to server: %s", server);
     sleep(3);
 
+    // data with known length are sent by SendTCP()
+    if (!prompt) return true;
+
     // open connection for data sending
     m_pSIM900->WriteLn("AT+CIPSEND");
     if (m_pSIM900->WaitResp(5000, 200, ">") == (RX_ST_TIMEOUT_ERR || RX_ST_FINISHED_STR_ERR)) {
-        CLogger::GetLogger()->LogPrintf(LL_ERROR, "CCtrlGSM: can not open connection for data sending!");
+        LOG_ERROR("CCtrlGSM: can not open connection for data sending!");
         return false;
     }
 
-    CLogger::GetLogger()->LogPrintf(LL_DEBUG, "CCtrlGSM: opened connection for data sending");
+    LOG_DEBUG("CCtrlGSM: opened connection for data sending");
     sleep(4);
 
     return true;
@@ -545,7 +550,7 @@ bool CCtrlGSM::ConnectTCP(const char *server, unsigned int port) {
 bool CCtrlGSM::DisconnectTCP() {
     // check if is connected
     if (!m_connected) {
-        CLogger::GetLogger()->LogPrintf(LL_ERROR, "CCtrlGSM: no GPRS connection!");
+        LOG_ERROR("CCtrlGSM: no GPRS connection!");
         return false;
     }
 
@@ -565,23 +570,23 @@ bool CCtrlGSM::HttpGET(const char *server, unsigned int port, const char *path,
 
     // check server and output
     if (server == NULL || path == NULL) {
-        CLogger::GetLogger()->LogPrintf(LL_ERROR, "CCtrlGSM: server or path for connection are missing!");
+        LOG_ERROR("CCtrlGSM: server or path for connection are missing!");
         return false;
     }
 
     for (int retry = 0; retry < 3; retry++) {
         // try to connect to server
         if (ConnectTCP(server, port)) {
-            CLogger::GetLogger()->LogPrintf(LL_INFO, "CCtrlGSM: connected to server %s", server);
+            LOG_INFO("CCtrlGSM: connected to server %s", server);
             connected = true;
             break;
         }
-        CLogger::GetLogger()->LogPrintf(LL_DEBUG, "CCtrlGSM: connecting....%1", retry);
+        LOG_DEBUG("CCtrlGSM: connecting....%1", retry);
     }
 
     // check connection status
     if (!connected) {
-        CLogger::GetLogger()->LogPrintf(LL_INFO, "CCtrlGSM: not connected to server %s", server);
+        LOG_INFO("CCtrlGSM: not connected to server %s", server);
         return false;
     }
 
@@ -597,7 +602,7 @@ bool CCtrlGSM::HttpGET(const char *server, unsigned int port, const char *path,
     m_pSIM900->Write('\0');
     // check response
     if (m_pSIM900->WaitResp(10000, 10, "SEND OK") == (RX_ST_TIMEOUT_ERR || RX_ST_FINISHED_STR_ERR)) {
-        CLogger::GetLogger()->LogPrintf(LL_ERROR, "CCtrlGSM: can not start TCP connection!");
+        LOG_ERROR("CCtrlGSM: can not start TCP connection!");
         return false;
     }
 
@@ -611,3 +616,76 @@ bool CCtrlGSM::HttpGET(const char *server, unsigned int port, const char *path,
 
     return true;
 }
+
+bool CCtrlGSM::SendTCP(const char *pData, size_t len) {
+    char cmd[32];
+
+    // binary data can not be terminated by Ctrl+Z, send them in chunks with length
+    while (len) {
+        size_t chunk = (len > TCP_SEND_CHUNK) ? TCP_SEND_CHUNK : len;
+
+        snprintf(cmd, sizeof(cmd), "AT+CIPSEND=%u", (unsigned)chunk);
+        m_pSIM900->WriteLn(cmd, strlen(cmd));
+        if (m_pSIM900->WaitResp(5000, 200, ">") != RX_ST_FINISHED_STR_OK) {
+            LOG_ERROR("CCtrlGSM: can not open connection for data sending!");
+            return false;
+        }
+
+        m_pSIM900->Write(pData, chunk);
+        if (m_pSIM900->WaitResp(10000, 200, "SEND OK") != RX_ST_FINISHED_STR_OK) {
+            LOG_ERROR("CCtrlGSM: can not send data!");
+            return false;
+        }
+
+        pData += chunk;
+        len -= chunk;
+    }
+
+    return true;
+}
+
+bool CCtrlGSM::HttpPOST(const char *server, unsigned int port, const char *path, const unsigned char *pData,
+    size_t len, char *out, size_t outLen) {
+    bool connected = false;
+
+    // check server and data
+    if (server == NULL || path == NULL || (pData == NULL && len)) {
+        LOG_ERROR("CCtrlGSM: server, path or data for connection are missing!");
+        return false;
+    }
+
+    for (int retry = 0; retry < 3; retry++) {
+        // try to connect to server
+        if (ConnectTCP(server, port, false)) {
+            LOG_INFO("CCtrlGSM: connected to server %s", server);
+            connected = true;
+            break;
+        }
+        LOG_DEBUG("CCtrlGSM: connecting....%i", retry);
+    }
+
+    // check connection status
+    if (!connected) {
+        LOG_INFO("CCtrlGSM: not connected to server %s", server);
+        return false;
+    }
+
+    // request header
+    std::string header = std::string("POST ") + path + " HTTP/1.0" STR_CRLF "Host: " + server + STR_CRLF
+        "User-Agent: Rpi-DEV" STR_CRLF "Content-Type: application/octet-stream" STR_CRLF
+        "Content-Length: " + ToString(len) + STR_CRLF STR_CRLF;
+
+    bool ok = SendTCP(header.c_str(), header.size()) && SendTCP((const char*)pData, len);
+
+    // check if output data are required
+    if (ok && (out != NULL)) {
+        usleep(50000);
+        // get response from server
+        if (!m_pSIM900->Read(out, outLen)) ok = false;
+    }
+
+    DisconnectTCP();
+
+    if (ok) LOG_DEBUG("CCtrlGSM: %u bytes were posted to %s", (unsigned)len, path);
+    return ok;
+}
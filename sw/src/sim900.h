@@ -15,6 +15,8 @@
 
 // length for internal communication buffer
 #define COMM_BUFF_SIZE 200
+// max length of data sent by one AT+CIPSEND
+#define TCP_SEND_CHUNK 1024
 
 // common used strings
 #define STR_AT "AT"
@@ -133,9 +135,13 @@ public:
     bool DetachGPRS();
 
     bool HttpGET(const char *server, unsigned int port, const char *path, char *out = NULL, size_t outLen = 0);
+    // binary body, e.g. uplink picture packet
+    bool HttpPOST(const char *server, unsigned int port, const char *path, const unsigned char *pData, size_t len,
+        char *out = NULL, size_t outLen = 0);
 
 private:
-    bool ConnectTCP(const char *server, unsigned int port);
+    bool ConnectTCP(const char *server, unsigned int port, bool prompt = true);
+    bool SendTCP(const char *pData, size_t len);
     bool DisconnectTCP();
 
 private:
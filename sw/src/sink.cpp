@@ -0,0 +1,592 @@
+#include "common.h"
+#include "logger.h"
+#include <dirent.h>
+#include <errno.h>
+#include <time.h>
+
+#include "sink.h"
+
+// absolute time for timed wait
+static void GetDeadline(struct timespec &ts, unsigned waitMs) {
+    clock_gettime(CLOCK_REALTIME, &ts);
+    ts.tv_sec += waitMs / 1000;
+    ts.tv_nsec += (waitMs % 1000) * 1000000L;
+    if (ts.tv_nsec >= 1000000000L) {
+        ts.tv_sec++;
+        ts.tv_nsec -= 1000000000L;
+    }
+}
+
+bool CPictureSink::SyncDir(const std::string &path) {
+    int fd = open(path.c_str(), O_RDONLY | O_DIRECTORY);
+    if (fd < 0) return false;
+
+    bool ok = (fsync(fd) == 0);
+    __sync_fetch_and_add(&m_syncs, 1);
+    if (close(fd) != 0) ok = false;
+    return ok;
+}
+
+CFileSink::CFileSink() :
+    CPictureSink(),
+    m_mode(DEF_DURABILITY),
+    m_groupFiles(SINK_DEF_GROUP_FILES),
+    m_groupTime(SINK_DEF_GROUP_TIME),
+    m_pendingTime(0),
+    m_running(false),
+    m_stop(false) {
+    pthread_mutex_init(&m_lock, NULL);
+    pthread_cond_init(&m_cond, NULL);
+}
+
+CFileSink::~CFileSink() {
+    Close();
+    pthread_cond_destroy(&m_cond);
+    pthread_mutex_destroy(&m_lock);
+}
+
+void CFileSink::SetDurability(Durability mode, unsigned groupFiles, unsigned groupTime) {
+    // pictures of the old group are committed first
+    Close();
+
+    m_mode = mode;
+    m_groupFiles = groupFiles ? groupFiles : 1;
+    m_groupTime = groupTime;
+
+    if (!m_path.empty() && (m_mode == DM_GROUP)) StartCommitThread();
+}
+
+bool CFileSink::Init(const std::string &path) {
+    Close();
+    m_path = path;
+
+    // not committed pictures of the last run
+    Reconcile();
+
+    return (m_mode == DM_GROUP) ? StartCommitThread() : true;
+}
+
+std::string CFileSink::GetTempPath(const std::string &fileName) {
+    // hidden name in the same directory, rename is atomic only within one file system
+    size_t slash = fileName.rfind('/');
+    if (slash == std::string::npos) return m_path + SINK_TMP_PREFIX + fileName;
+    return m_path + fileName.substr(0, slash + 1) + SINK_TMP_PREFIX + fileName.substr(slash + 1);
+}
+
+bool CFileSink::Write(unsigned idx, const std::string &fileName, const std::vector<unsigned char> &data,
+        uint64_t timeMs) {
+    std::string path = m_path + fileName;
+    std::string tmpPath = GetTempPath(fileName);
+    int fd;
+
+    m_lastName = fileName;
+    m_lastOffset = 0;
+
+    // open temporary file, the picture gets its name only when complete
+    if ((fd = open(tmpPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644)) < 0) {
+        LOG_ERROR("can not open picture \"%s\" for writing!", fileName.c_str());
+        return false;
+    }
+
+    // the oldest pictures are removed in background when quota is exceeded, not this one until renamed
+    if (m_pStorage != NULL) m_pStorage->OpenFile(fileName, data.size(), 0, timeMs);
+    CStorageManager::Preallocate(fd, data.size());
+
+    // write encoded data
+    bool ok = true;
+    for (size_t done = 0; done < data.size(); ) {
+        ssize_t n = write(fd, &data[done], data.size() - done);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            ok = false;
+            break;
+        }
+        done += n;
+    }
+
+    if (ok && (m_mode == DM_GROUP) && m_running) {
+        // fd is kept open until the group is synced
+        SPendingFile file;
+        file.fd = fd;
+        file.tmpPath = tmpPath;
+        file.path = path;
+        file.fileName = fileName;
+        file.size = data.size();
+
+        pthread_mutex_lock(&m_lock);
+        if (m_pending.empty()) m_pendingTime = GetTimeMSec();
+        m_pending.push_back(file);
+        bool full = (m_pending.size() >= m_groupFiles);
+        // the first picture starts group timer
+        if (m_pending.size() == 1) pthread_cond_signal(&m_cond);
+        pthread_mutex_unlock(&m_lock);
+
+        LOG_DEBUG("picture \"%s\" was written", fileName.c_str());
+
+        // full group is committed by writer, open files are bounded while commit thread syncs the last group
+        if (full) return Commit();
+        return true;
+    }
+
+    if (ok && (m_mode != DM_NONE)) {
+        ok = (fdatasync(fd) == 0);
+        __sync_fetch_and_add(&m_syncs, 1);
+    }
+    if (close(fd) != 0) ok = false;
+    if (ok) ok = (rename(tmpPath.c_str(), path.c_str()) == 0);
+    if (ok && (m_mode != DM_NONE)) ok = SyncDir(m_path);
+    if (m_pStorage != NULL) m_pStorage->CloseFile(fileName, ok ? data.size() : 0);
+
+    if (!ok) {
+        LOG_ERROR("can not save picture \"%s\"!", fileName.c_str());
+        unlink(tmpPath.c_str());
+        return false;
+    }
+
+    LOG_DEBUG("picture \"%s\" was saved", fileName.c_str());
+    return true;
+}
+
+bool CFileSink::Commit() {
+    std::vector<SPendingFile> files;
+
+    pthread_mutex_lock(&m_lock);
+    files.swap(m_pending);
+    pthread_mutex_unlock(&m_lock);
+
+    if (files.empty()) return true;
+
+    // start writeback of all files at once, then wait for each
+    for (size_t i = 0; i < files.size(); i++) sync_file_range(files[i].fd, 0, 0, SYNC_FILE_RANGE_WRITE);
+
+    bool ok = true;
+    unsigned failed = 0;
+    for (size_t i = 0; i < files.size(); i++) {
+        bool fileOk = (fdatasync(files[i].fd) == 0);
+        __sync_fetch_and_add(&m_syncs, 1);
+        if (close(files[i].fd) != 0) fileOk = false;
+        if (fileOk) fileOk = (rename(files[i].tmpPath.c_str(), files[i].path.c_str()) == 0);
+
+        if (!fileOk) {
+            LOG_ERROR("can not commit picture %s!", files[i].path.c_str());
+            unlink(files[i].tmpPath.c_str());
+            failed++;
+        }
+
+        // picture can be evicted from now
+        if (m_pStorage != NULL) m_pStorage->CloseFile(files[i].fileName, fileOk ? files[i].size : 0);
+    }
+
+    // one directory fsync for the whole group
+    if (!SyncDir(m_path)) {
+        LOG_ERROR("can not sync directory %s!", m_path.c_str());
+        ok = false;
+    }
+
+    LOG_DEBUG("%u pictures were committed", (unsigned)files.size() - failed);
+    return ok && !failed;
+}
+
+void CFileSink::Close() {
+    StopCommitThread();
+    Commit();
+}
+
+bool CFileSink::Reconcile() {
+    struct dirent *pEntry;
+    unsigned done = 0, removed = 0;
+    size_t prefixLen = strlen(SINK_TMP_PREFIX);
+
+    DIR *pDir = opendir(m_path.c_str());
+    if (pDir == NULL) {
+        LOG_ERROR("can not open directory %s!", m_path.c_str());
+        return false;
+    }
+
+    while ((pEntry = readdir(pDir)) != NULL) {
+        if (strncmp(pEntry->d_name, SINK_TMP_PREFIX, prefixLen)) continue;
+
+        std::string tmpPath = m_path + pEntry->d_name;
+        std::string path = m_path + (pEntry->d_name + prefixLen);
+        unsigned char head[2], tail[2];
+        bool complete = false;
+
+        // complete JPEG from SOI to EOI marker is kept, anything else was torn by power loss
+        int fd = open(tmpPath.c_str(), O_RDONLY);
+        if (fd >= 0) {
+            off_t size = lseek(fd, 0, SEEK_END);
+            complete = (size > 4) && (pread(fd, head, 2, 0) == 2) && (pread(fd, tail, 2, size - 2) == 2) &&
+                    (head[0] == 0xff) && (head[1] == 0xd8) && (tail[0] == 0xff) && (tail[1] == 0xd9) &&
+                    (fdatasync(fd) == 0);
+            close(fd);
+        }
+
+        if (complete && (access(path.c_str(), F_OK) < 0) && (rename(tmpPath.c_str(), path.c_str()) == 0)) done++;
+        else {
+            unlink(tmpPath.c_str());
+            removed++;
+        }
+    }
+    closedir(pDir);
+
+    if (done || removed) {
+        SyncDir(m_path);
+        LOG_WARNING("%u interrupted pictures were completed, %u removed", done,
+                removed);
+    }
+
+    return true;
+}
+
+bool CFileSink::StartCommitThread() {
+    if (m_running) return true;
+
+    m_stop = false;
+    if (pthread_create(&m_thread, NULL, RunCommit, this)) {
+        LOG_ERROR("can not start commit thread, pictures are synced one by one!");
+        m_mode = DM_FILE;
+        return true;
+    }
+    m_running = true;
+
+    return true;
+}
+
+void CFileSink::StopCommitThread() {
+    if (!m_running) return;
+
+    pthread_mutex_lock(&m_lock);
+    m_stop = true;
+    pthread_cond_signal(&m_cond);
+    pthread_mutex_unlock(&m_lock);
+
+    pthread_join(m_thread, NULL);
+    m_running = false;
+}
+
+void* CFileSink::RunCommit(void *pArg) {
+    ((CFileSink*)pArg)->CommitLoop();
+    return NULL;
+}
+
+void CFileSink::CommitLoop() {
+    pthread_mutex_lock(&m_lock);
+
+    while (!m_stop) {
+        // group is full or its first picture waits too long
+        bool commit = !m_pending.empty() && ((m_pending.size() >= m_groupFiles) ||
+                (GetTimeMSec() - m_pendingTime >= m_groupTime));
+
+        if (m_pending.empty()) {
+            pthread_cond_wait(&m_cond, &m_lock);
+            continue;
+        }
+
+        if (!commit) {
+            struct timespec ts;
+            GetDeadline(ts, m_groupTime - (GetTimeMSec() - m_pendingTime));
+            pthread_cond_timedwait(&m_cond, &m_lock, &ts);
+            continue;
+        }
+
+        // pictures are synced without lock, writer continues with the next group
+        pthread_mutex_unlock(&m_lock);
+        Commit();
+        pthread_mutex_lock(&m_lock);
+    }
+
+    pthread_mutex_unlock(&m_lock);
+}
+
+CMjpegSink::CMjpegSink(const std::string &prefix) :
+    CPictureSink(),
+    m_prefix(prefix),
+    m_maxSize(MJPEG_DEF_MAX_SIZE),
+    m_maxTime(MJPEG_DEF_MAX_TIME) {
+}
+
+CMjpegSink::~CMjpegSink() {
+    Close();
+}
+
+void CMjpegSink::SetRotation(uint64_t maxSize, unsigned maxTime) {
+    m_maxSize = maxSize;
+    m_maxTime = maxTime;
+}
+
+bool CMjpegSink::Init(const std::string &path) {
+    Close();
+    m_path = path;
+    return true;
+}
+
+void CMjpegSink::CloseWriter(unsigned idx) {
+    CMjpegWriter &writer = m_writers[idx];
+    if (!writer.IsOpen()) return;
+
+    // index trailer is added and unused preallocated blocks are released
+    bool ok = writer.Close();
+    if (m_pStorage != NULL) m_pStorage->CloseFile(m_names[idx], ok ? writer.GetSize() : 0);
+}
+
+bool CMjpegSink::Rotate(unsigned idx, uint64_t timeMs) {
+    CMjpegWriter &writer = m_writers[idx];
+    char name[64];
+    struct tm tmAct;
+    time_t t = timeMs / 1000;
+
+    CloseWriter(idx);
+
+    // container is named by its first frame, smaller outputs get output index
+    localtime_r(&t, &tmAct);
+    size_t len = strftime(name, sizeof(name), "-%Y%m%d-%H%M%S", &tmAct);
+    if (idx) snprintf(name + len, sizeof(name) - len, "-%u", idx);
+
+    m_names[idx] = m_prefix + name + MJPEG_EXT;
+
+    // second container within the same second
+    for (unsigned i = 1; (access((m_path + m_names[idx]).c_str(), F_OK) == 0) && (i < 100); i++)
+        m_names[idx] = m_prefix + name + "." + ToString(i) + MJPEG_EXT;
+
+    // blocks for the whole container are reserved at once
+    if (!writer.Open(m_path + m_names[idx], m_maxSize)) return false;
+
+    // open container is not removed, its reserved blocks count for quota
+    if (m_pStorage != NULL) m_pStorage->OpenFile(m_names[idx], writer.GetSize(), m_maxSize, timeMs);
+    return true;
+}
+
+bool CMjpegSink::Write(unsigned idx, const std::string &fileName, const std::vector<unsigned char> &data,
+        uint64_t timeMs) {
+    if (idx >= MJPEG_SINK_OUTPUTS) {
+        LOG_ERROR("output %u of \"%s\" can not be stored!", idx, fileName.c_str());
+        return false;
+    }
+
+    CMjpegWriter &writer = m_writers[idx];
+
+    // start a new container when the actual one is full or old
+    bool rotate = !writer.IsOpen() ||
+            (m_maxSize && (writer.GetSize() + data.size() > m_maxSize)) ||
+            (m_maxTime && writer.GetCount() && (timeMs - writer.GetStartTime() >= (uint64_t)m_maxTime * 1000));
+
+    if (rotate && !Rotate(idx, timeMs)) return false;
+
+    uint64_t size = writer.GetSize();
+    if (!writer.Write(data.empty() ? NULL : &data[0], data.size(), timeMs)) return false;
+
+    m_lastName = m_names[idx];
+    m_lastOffset = size + sizeof(SMjpegChunk);
+
+    // frame grows the container
+    if (m_pStorage != NULL) m_pStorage->Add(m_names[idx], writer.GetSize() - size, timeMs, true);
+
+    LOG_DEBUG("picture \"%s\" was appended", fileName.c_str());
+    return true;
+}
+
+void CMjpegSink::Close() {
+    for (unsigned i = 0; i < MJPEG_SINK_OUTPUTS; i++) CloseWriter(i);
+}
+
+CSegmentSink::CSegmentSink() :
+    CPictureSink(),
+    m_seq(0),
+    m_segmentSize(SEGMENT_DEF_SIZE),
+    m_mode(DEF_DURABILITY),
+    m_groupFiles(SINK_DEF_GROUP_FILES),
+    m_groupTime(SINK_DEF_GROUP_TIME),
+    m_unsynced(0),
+    m_syncTime(0),
+    m_running(false),
+    m_stop(false) {
+    pthread_mutex_init(&m_lock, NULL);
+    pthread_cond_init(&m_cond, NULL);
+}
+
+CSegmentSink::~CSegmentSink() {
+    Close();
+    pthread_cond_destroy(&m_cond);
+    pthread_mutex_destroy(&m_lock);
+}
+
+void CSegmentSink::SetDurability(Durability mode, unsigned groupFiles, unsigned groupTime) {
+    StopSyncThread();
+
+    pthread_mutex_lock(&m_lock);
+    m_mode = mode;
+    m_groupFiles = groupFiles ? groupFiles : 1;
+    m_groupTime = groupTime;
+    // pictures of the old group
+    Sync();
+    pthread_mutex_unlock(&m_lock);
+
+    if (!m_path.empty() && (m_mode == DM_GROUP)) StartSyncThread();
+}
+
+bool CSegmentSink::Init(const std::string &path) {
+    struct dirent *pEntry;
+    size_t prefixLen = strlen(SEGMENT_PREFIX);
+
+    Close();
+    m_path = path;
+    m_seq = 0;
+
+    DIR *pDir = opendir(m_path.c_str());
+    if (pDir == NULL) {
+        LOG_ERROR("can not open directory %s!", m_path.c_str());
+        return false;
+    }
+
+    // continue after the newest segment, segments are never reopened
+    while ((pEntry = readdir(pDir)) != NULL) {
+        if (strncmp(pEntry->d_name, SEGMENT_PREFIX, prefixLen)) continue;
+        unsigned seq = strtoul(pEntry->d_name + prefixLen, NULL, 10);
+        if (seq >= m_seq) m_seq = seq + 1;
+    }
+    closedir(pDir);
+
+    return (m_mode == DM_GROUP) ? StartSyncThread() : true;
+}
+
+bool CSegmentSink::Rotate() {
+    char name[64];
+
+    // the old segment is synced and shrunk
+    CloseSegment();
+
+    snprintf(name, sizeof(name), SEGMENT_PREFIX "%08u" SEGMENT_EXT, m_seq++);
+    m_name = name;
+
+    if (!m_writer.Open(m_path + m_name, m_segmentSize)) return false;
+
+    // preallocated size counts for quota, the whole segment is evicted at once after it is closed
+    if (m_pStorage != NULL) m_pStorage->OpenFile(m_name, m_writer.GetSize(), m_segmentSize, GetWallTimeMSec());
+
+    // pictures synced into the segment are lost without its directory entry
+    if ((m_mode != DM_NONE) && !SyncDir(m_path)) {
+        LOG_ERROR("can not sync directory %s!", m_path.c_str());
+        CloseSegment();
+        return false;
+    }
+
+    m_unsynced = 0;
+    m_syncTime = GetTimeMSec();
+    return true;
+}
+
+bool CSegmentSink::Sync() {
+    if (!m_unsynced) return true;
+
+    bool ok = m_writer.Sync();
+    __sync_fetch_and_add(&m_syncs, 1);
+
+    m_unsynced = 0;
+    m_syncTime = GetTimeMSec();
+    return ok;
+}
+
+bool CSegmentSink::Write(unsigned idx, const std::string &fileName, const std::vector<unsigned char> &data,
+        uint64_t timeMs) {
+    pthread_mutex_lock(&m_lock);
+
+    // new segment when the picture does not fit
+    if ((!m_writer.IsOpen() || m_writer.IsFull(data.size(), fileName.size())) && !Rotate()) {
+        pthread_mutex_unlock(&m_lock);
+        return false;
+    }
+
+    uint64_t offset;
+    if (!m_writer.Append(idx, fileName, data.empty() ? NULL : &data[0], data.size(), timeMs, offset)) {
+        pthread_mutex_unlock(&m_lock);
+        LOG_ERROR("can not save picture \"%s\"!", fileName.c_str());
+        return false;
+    }
+
+    m_lastName = m_name;
+    m_lastOffset = offset;
+    // the first picture starts group timer
+    if (!m_unsynced++) pthread_cond_signal(&m_cond);
+
+    // data sync only, segment size does not change in preallocated space
+    bool ok = true;
+    if ((m_mode == DM_FILE) || ((m_mode == DM_GROUP) &&
+            ((m_unsynced >= m_groupFiles) || (GetTimeMSec() - m_syncTime >= m_groupTime)))) ok = Sync();
+
+    pthread_mutex_unlock(&m_lock);
+
+    LOG_DEBUG("picture \"%s\" was appended", fileName.c_str());
+    return ok;
+}
+
+void CSegmentSink::CloseSegment() {
+    if (!m_writer.IsOpen()) return;
+
+    bool ok = m_writer.Close();
+    __sync_fetch_and_add(&m_syncs, 1);
+    m_unsynced = 0;
+    if (m_pStorage != NULL) m_pStorage->CloseFile(m_name, ok ? m_writer.GetSize() : 0);
+}
+
+void CSegmentSink::Close() {
+    StopSyncThread();
+
+    pthread_mutex_lock(&m_lock);
+    CloseSegment();
+    pthread_mutex_unlock(&m_lock);
+}
+
+bool CSegmentSink::StartSyncThread() {
+    if (m_running) return true;
+
+    m_stop = false;
+    if (pthread_create(&m_thread, NULL, RunSync, this)) {
+        LOG_ERROR("can not start sync thread, pictures are synced one by one!");
+        m_mode = DM_FILE;
+        return true;
+    }
+    m_running = true;
+
+    return true;
+}
+
+void CSegmentSink::StopSyncThread() {
+    if (!m_running) return;
+
+    pthread_mutex_lock(&m_lock);
+    m_stop = true;
+    pthread_cond_signal(&m_cond);
+    pthread_mutex_unlock(&m_lock);
+
+    pthread_join(m_thread, NULL);
+    m_running = false;
+}
+
+void* CSegmentSink::RunSync(void *pArg) {
+    ((CSegmentSink*)pArg)->SyncLoop();
+    return NULL;
+}
+
+void CSegmentSink::SyncLoop() {
+    pthread_mutex_lock(&m_lock);
+
+    while (!m_stop) {
+        if (!m_unsynced || !m_writer.IsOpen()) {
+            pthread_cond_wait(&m_cond, &m_lock);
+            continue;
+        }
+
+        // the last pictures are synced in time also when capture stops
+        unsigned elapsed = GetTimeMSec() - m_syncTime;
+        if (elapsed < m_groupTime) {
+            struct timespec ts;
+            GetDeadline(ts, m_groupTime - elapsed);
+            pthread_cond_timedwait(&m_cond, &m_lock, &ts);
+            continue;
+        }
+
+        if (!Sync()) LOG_ERROR("can not sync segment %s!", m_name.c_str());
+    }
+
+    pthread_mutex_unlock(&m_lock);
+}
@@ -0,0 +1,197 @@
+#ifndef SINK_H_
+#define SINK_H_
+
+#include <pthread.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include "mjpeg.h"
+#include "segment.h"
+#include "storage.h"
+
+// destination of encoded pictures
+class CPictureSink {
+public:
+    CPictureSink() : m_pStorage(NULL), m_lastOffset(0), m_syncs(0) {}
+    virtual ~CPictureSink() {}
+
+    // written files are registered for quota, NULL = unmanaged directory
+    inline void SetStorage(CStorageManager *pStorage) { m_pStorage = pStorage; }
+    // where the last written picture is, name relative to sink path
+    inline const std::string& GetLastName() { return m_lastName; }
+    inline uint64_t GetLastOffset() { return m_lastOffset; }
+    // fsync/fdatasync calls made so far
+    inline unsigned GetSyncCount() { return m_syncs; }
+
+    virtual bool Init(const std::string &path) = 0;
+    // store one encoded output, idx 0 = full size
+    virtual bool Write(unsigned idx, const std::string &fileName, const std::vector<unsigned char> &data,
+            uint64_t timeMs) = 0;
+    // finish open files, e.g. on shutdown
+    virtual void Close() {}
+
+protected:
+    // new names are durable only after directory fsync
+    bool SyncDir(const std::string &path);
+
+protected:
+    CStorageManager *m_pStorage;
+    std::string m_lastName;
+    uint64_t m_lastOffset;
+    unsigned m_syncs;
+};
+
+// when written pictures survive power loss
+typedef enum Durability {
+    DM_NONE = 0,    // rename only, data are left to the kernel
+    DM_FILE,        // fsync of every picture and directory
+    DM_GROUP,       // pictures are renamed in groups, writeback of the group is started at once and every file
+                    // is fdatasync'ed, only the directory fsync is shared, pictures are not durable until commit
+    DM_COUNT
+} Durability;
+
+#ifndef DEF_DURABILITY
+#define DEF_DURABILITY DM_GROUP
+#endif
+
+// group commit after given count of pictures or time [ms] from the first one,
+// full group is committed by the writing thread itself
+#define SINK_DEF_GROUP_FILES 16
+#define SINK_DEF_GROUP_TIME 2000
+// picture is written under hidden temporary name and renamed when complete
+#define SINK_TMP_PREFIX ".part-"
+
+// one file per picture
+class CFileSink : public CPictureSink {
+public:
+    CFileSink();
+    virtual ~CFileSink();
+
+    void SetDurability(Durability mode, unsigned groupFiles = SINK_DEF_GROUP_FILES,
+            unsigned groupTime = SINK_DEF_GROUP_TIME);
+    inline Durability GetDurability() { return m_mode; }
+
+    // temporary files left by power loss are completed or removed
+    virtual bool Init(const std::string &path);
+    virtual bool Write(unsigned idx, const std::string &fileName, const std::vector<unsigned char> &data,
+            uint64_t timeMs);
+    // commits pending group
+    virtual void Close();
+
+    // rename pending pictures of the group
+    bool Commit();
+
+private:
+    // written picture waiting for group commit
+    struct SPendingFile {
+        int fd;
+        std::string tmpPath;
+        std::string path;
+        std::string fileName;
+        uint64_t size;
+    };
+
+    std::string GetTempPath(const std::string &fileName);
+    bool Reconcile();
+    bool StartCommitThread();
+    void StopCommitThread();
+    static void* RunCommit(void *pArg);
+    void CommitLoop();
+
+private:
+    std::string m_path;
+    Durability m_mode;
+    unsigned m_groupFiles;
+    unsigned m_groupTime;
+    std::vector<SPendingFile> m_pending;
+    unsigned m_pendingTime;
+    bool m_running;
+    bool m_stop;
+    pthread_t m_thread;
+    pthread_mutex_t m_lock;
+    pthread_cond_t m_cond;
+};
+
+// max count of output sizes kept in separate containers
+#define MJPEG_SINK_OUTPUTS 4
+// default container rotation
+#define MJPEG_DEF_MAX_SIZE (64 * 1024 * 1024)
+#define MJPEG_DEF_MAX_TIME (24 * 60 * 60)
+// container extension
+#define MJPEG_EXT ".mjpg"
+
+// timelapse frames appended into rolling containers, one per output size
+class CMjpegSink : public CPictureSink {
+public:
+    CMjpegSink(const std::string &prefix = "timelapse");
+    virtual ~CMjpegSink();
+
+    // rotate by size [B] or age [s], 0 disables the limit
+    void SetRotation(uint64_t maxSize, unsigned maxTime);
+
+    virtual bool Init(const std::string &path);
+    virtual bool Write(unsigned idx, const std::string &fileName, const std::vector<unsigned char> &data,
+            uint64_t timeMs);
+    virtual void Close();
+
+private:
+    bool Rotate(unsigned idx, uint64_t timeMs);
+    void CloseWriter(unsigned idx);
+
+private:
+    std::string m_path;
+    std::string m_prefix;
+    uint64_t m_maxSize;
+    unsigned m_maxTime;
+    CMjpegWriter m_writers[MJPEG_SINK_OUTPUTS];
+    // container names relative to m_path
+    std::string m_names[MJPEG_SINK_OUTPUTS];
+};
+
+// all outputs appended into large preallocated segments, evicted by whole segments
+class CSegmentSink : public CPictureSink {
+public:
+    CSegmentSink();
+    virtual ~CSegmentSink();
+
+    // size of new segments [B]
+    inline void SetSegmentSize(uint64_t size) { m_segmentSize = size; }
+    // DM_GROUP syncs the segment after given count of pictures or time [ms], also when no picture follows
+    void SetDurability(Durability mode, unsigned groupFiles = SINK_DEF_GROUP_FILES,
+            unsigned groupTime = SINK_DEF_GROUP_TIME);
+
+    virtual bool Init(const std::string &path);
+    virtual bool Write(unsigned idx, const std::string &fileName, const std::vector<unsigned char> &data,
+            uint64_t timeMs);
+    virtual void Close();
+
+private:
+    bool Rotate();
+    void CloseSegment();
+    bool Sync();
+    bool StartSyncThread();
+    void StopSyncThread();
+    static void* RunSync(void *pArg);
+    void SyncLoop();
+
+private:
+    std::string m_path;
+    std::string m_name;
+    unsigned m_seq;
+    uint64_t m_segmentSize;
+    Durability m_mode;
+    unsigned m_groupFiles;
+    unsigned m_groupTime;
+    unsigned m_unsynced;
+    unsigned m_syncTime;
+    CSegmentWriter m_writer;
+    bool m_running;
+    bool m_stop;
+    pthread_t m_thread;
+    // writer is shared with sync thread
+    pthread_mutex_t m_lock;
+    pthread_cond_t m_cond;
+};
+
+#endif // SINK_H_
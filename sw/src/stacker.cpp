@@ -0,0 +1,167 @@
+#include "common.h"
+#include "logger.h"
+#include <algorithm>
+
+#include "framesource.h"
+#include "imgproc.h"
+#include "stacker.h"
+
+CFrameStacker::CFrameStacker() :
+    m_blocksX(0),
+    m_blocksY(0),
+    m_rejectDiff(STACK_DEF_REJECT_DIFF),
+    m_frames(0),
+    m_rejected(0) {
+}
+
+CFrameStacker::~CFrameStacker() {
+    m_ref.release();
+}
+
+bool CFrameStacker::Begin(cv::Mat &reference, PixelFormat format) {
+    m_ref.release();
+    m_planes.clear();
+    m_frames = 0;
+
+    // only BGR and continuous I420 frames are supported
+    bool planar = (format == PF_I420);
+    if (!CheckFrame(reference, format)) {
+        LOG_ERROR("frame stacker needs BGR or YUV420 frame!");
+        return false;
+    }
+
+    cv::Size size = GetFrameSize(reference, format);
+    m_blocksX = (size.width + STACK_BLOCK - 1) / STACK_BLOCK;
+    m_blocksY = (size.height + STACK_BLOCK - 1) / STACK_BLOCK;
+
+    SStackPlane plane;
+    plane.offset = 0;
+    plane.accOffset = 0;
+    if (planar) {
+        // Y plane, then U and V with half resolution and half blocks
+        plane.stride = size.width;
+        plane.width = size.width;
+        plane.height = size.height;
+        plane.blockWidth = STACK_BLOCK;
+        plane.blockHeight = STACK_BLOCK;
+        m_planes.push_back(plane);
+
+        for (int i = 0; i < 2; i++) {
+            plane.offset += (size_t)plane.width * plane.height;
+            plane.accOffset = plane.offset;
+            plane.stride = size.width / 2;
+            plane.width = size.width / 2;
+            plane.height = size.height / 2;
+            plane.blockWidth = STACK_BLOCK / 2;
+            plane.blockHeight = STACK_BLOCK / 2;
+            m_planes.push_back(plane);
+        }
+    } else {
+        // interleaved channels of a block are one byte run
+        plane.stride = reference.step;
+        plane.width = size.width * 3;
+        plane.height = size.height;
+        plane.blockWidth = STACK_BLOCK * 3;
+        plane.blockHeight = STACK_BLOCK;
+        m_planes.push_back(plane);
+    }
+
+    // reference starts the sums of all blocks
+    const SStackPlane &last = m_planes.back();
+    m_acc.assign(last.accOffset + (size_t)last.width * last.height, 0);
+    for (size_t p = 0; p < m_planes.size(); p++) {
+        const SStackPlane &pl = m_planes[p];
+        for (int y = 0; y < pl.height; y++) {
+            AccumulateU8(reference.data + pl.offset + y * pl.stride, &m_acc[pl.accOffset + (size_t)y * pl.width],
+                    pl.width);
+        }
+    }
+
+    m_counts.assign(m_blocksX * m_blocksY, 1);
+    m_accept.resize(m_blocksX * m_blocksY);
+    m_ref = reference;
+    m_frames = 1;
+    m_rejected = 0;
+
+    return true;
+}
+
+bool CFrameStacker::Add(const cv::Mat &frame) {
+    if (m_ref.empty() || (m_frames >= STACK_MAX_FRAMES)) return false;
+
+    if ((frame.type() != m_ref.type()) || (frame.size() != m_ref.size()) || (frame.step != m_ref.step)) {
+        LOG_ERROR("stacked frame has different format!");
+        return false;
+    }
+
+    // blocks of luma (or packed pixels) that moved against the reference are left out
+    const SStackPlane &first = m_planes[0];
+    for (int by = 0; by < m_blocksY; by++) {
+        int y = by * first.blockHeight;
+        int height = std::min(first.blockHeight, first.height - y);
+        for (int bx = 0; bx < m_blocksX; bx++) {
+            int x = bx * first.blockWidth;
+            int width = std::min(first.blockWidth, first.width - x);
+            size_t offset = first.offset + y * first.stride + x;
+
+            unsigned sad = BlockSAD(frame.data + offset, m_ref.data + offset, first.stride, width, height);
+            unsigned char accept = (sad <= m_rejectDiff * width * height) ? 1 : 0;
+            m_accept[by * m_blocksX + bx] = accept;
+            m_counts[by * m_blocksX + bx] += accept;
+            if (!accept) m_rejected++;
+        }
+    }
+
+    // add runs of accepted blocks row by row
+    for (size_t p = 0; p < m_planes.size(); p++) {
+        const SStackPlane &pl = m_planes[p];
+        for (int y = 0; y < pl.height; y++) {
+            const unsigned char *pAccept = &m_accept[(y / pl.blockHeight) * m_blocksX];
+            const unsigned char *pSrc = frame.data + pl.offset + y * pl.stride;
+            uint16_t *pAcc = &m_acc[pl.accOffset + (size_t)y * pl.width];
+
+            for (int bx = 0; bx < m_blocksX; ) {
+                if (!pAccept[bx]) {
+                    bx++;
+                    continue;
+                }
+                int start = bx;
+                while ((bx < m_blocksX) && pAccept[bx]) bx++;
+
+                int x = start * pl.blockWidth;
+                int len = std::min(bx * pl.blockWidth, pl.width) - x;
+                if (len > 0) AccumulateU8(pSrc + x, pAcc + x, len);
+            }
+        }
+    }
+
+    m_frames++;
+    return true;
+}
+
+void CFrameStacker::Finish() {
+    if (m_ref.empty()) return;
+
+    // average runs of blocks with the same frame count, blocks of reference only are kept
+    for (size_t p = 0; p < m_planes.size(); p++) {
+        const SStackPlane &pl = m_planes[p];
+        for (int y = 0; y < pl.height; y++) {
+            const unsigned char *pCount = &m_counts[(y / pl.blockHeight) * m_blocksX];
+            unsigned char *pDst = m_ref.data + pl.offset + y * pl.stride;
+            const uint16_t *pAcc = &m_acc[pl.accOffset + (size_t)y * pl.width];
+
+            for (int bx = 0; bx < m_blocksX; ) {
+                int start = bx;
+                unsigned count = pCount[bx];
+                while ((bx < m_blocksX) && (pCount[bx] == count)) bx++;
+                if (count <= 1) continue;
+
+                int x = start * pl.blockWidth;
+                int len = std::min(bx * pl.blockWidth, pl.width) - x;
+                if (len > 0) AverageU16(pAcc + x, count, pDst + x, len);
+            }
+        }
+    }
+
+    m_ref.release();
+}
@@ -0,0 +1,62 @@
+#ifndef STACKER_H_
+#define STACKER_H_
+
+#include <stdint.h>
+#include <vector>
+#include <opencv2/core.hpp>
+
+#include "framesource.h"
+
+// max count of averaged frames, sums stay exact in 16 bits
+#define STACK_MAX_FRAMES 16
+// block size in luma pixels, blocks that moved are not averaged
+#define STACK_BLOCK 16
+// default mean absolute difference of moved block, noise of sigma s adds about 1.1 * s
+#define STACK_DEF_REJECT_DIFF 24
+
+// byte plane of frame, I420 has three, BGR one
+struct SStackPlane {
+    size_t offset;      // from frame data [B]
+    size_t stride;
+    size_t accOffset;   // from the first accumulator, stride is width
+    int width;          // [B]
+    int height;
+    int blockWidth;     // [B]
+    int blockHeight;
+};
+
+// temporal denoise, following frames are averaged into the reference one block by block
+class CFrameStacker {
+public:
+    CFrameStacker();
+    ~CFrameStacker();
+
+    // mean absolute difference to reference over which a block is not averaged
+    inline void SetRejectDiff(unsigned diff) { m_rejectDiff = diff; }
+
+    // reference frame gets the average by Finish()
+    bool Begin(cv::Mat &reference, PixelFormat format);
+    // frame of the same format, false when it does not fit or stack is full
+    bool Add(const cv::Mat &frame);
+    void Finish();
+
+    inline unsigned GetFrameCount() { return m_frames; }
+    inline unsigned GetBlockCount() { return m_blocksX * m_blocksY; }
+    // blocks left out of the stack so far
+    inline unsigned GetRejected() { return m_rejected; }
+
+private:
+    cv::Mat m_ref;
+    std::vector<SStackPlane> m_planes;
+    std::vector<uint16_t> m_acc;
+    // count of averaged frames per block
+    std::vector<unsigned char> m_counts;
+    std::vector<unsigned char> m_accept;
+    int m_blocksX;
+    int m_blocksY;
+    unsigned m_rejectDiff;
+    unsigned m_frames;
+    unsigned m_rejected;
+};
+
+#endif // STACKER_H_
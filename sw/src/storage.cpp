@@ -0,0 +1,529 @@
+#include "common.h"
+#include "logger.h"
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <algorithm>
+#include <vector>
+
+#include "storage.h"
+
+// directory entry found by scan
+struct SScanEntry {
+    SStorageEntry entry;
+    time_t mtime;
+
+    bool operator<(const SScanEntry &other) const {
+        return (mtime != other.mtime) ? (mtime < other.mtime) : (entry.name < other.entry.name);
+    }
+};
+
+static void FillRecord(SStorageRecord &record, StorageRecordType type, const SStorageEntry &entry) {
+    memset(&record, 0, sizeof(record));
+    record.type = type;
+    record.size = entry.size;
+    record.prealloc = entry.prealloc;
+    record.timeMs = entry.timeMs;
+    strncpy(record.name, entry.name.c_str(), STORAGE_NAME_LEN);
+}
+
+// space taken by file incl. preallocated blocks
+static uint64_t DiskSize(const SStorageEntry &entry) {
+    return std::max(entry.size, entry.prealloc);
+}
+
+static bool IdLess(const SStorageEntry &entry, uint64_t id) {
+    return entry.id < id;
+}
+
+CStorageManager::CStorageManager() :
+    m_maxBytes(0),
+    m_maxFiles(0),
+    m_evictCallback(NULL),
+    m_pEvictArg(NULL),
+    m_openCount(0),
+    m_nextId(0),
+    m_bytes(0),
+    m_records(0),
+    m_compactRetry(0),
+    m_compacting(false),
+    m_pManifest(NULL),
+    m_running(false),
+    m_stop(false) {
+    pthread_mutex_init(&m_lock, NULL);
+    pthread_cond_init(&m_cond, NULL);
+}
+
+CStorageManager::~CStorageManager() {
+    Stop();
+    pthread_cond_destroy(&m_cond);
+    pthread_mutex_destroy(&m_lock);
+}
+
+void CStorageManager::SetQuota(uint64_t maxBytes, unsigned maxFiles) {
+    pthread_mutex_lock(&m_lock);
+    m_maxBytes = maxBytes;
+    m_maxFiles = maxFiles;
+    pthread_cond_signal(&m_cond);
+    pthread_mutex_unlock(&m_lock);
+}
+
+bool CStorageManager::Start(const std::string &path) {
+    Stop();
+
+    m_path = path;
+    m_index.clear();
+    m_names.clear();
+    m_openCount = 0;
+    m_nextId = 0;
+    m_bytes = 0;
+    m_records = 0;
+
+    // manifest is missing on the first run or was damaged
+    if (!LoadManifest()) {
+        m_index.clear();
+        m_names.clear();
+        m_openCount = 0;
+        m_bytes = 0;
+        if (!ScanDirectory() || !WriteManifest(m_index, m_pManifest)) return false;
+        m_records = m_index.size();
+
+        std::string path = m_path + STORAGE_MANIFEST;
+        if (rename((path + ".tmp").c_str(), path.c_str()) < 0) {
+            LOG_ERROR("can not replace storage manifest!");
+            fclose(m_pManifest);
+            m_pManifest = NULL;
+            return false;
+        }
+        SyncDir();
+    }
+    m_compactRetry = 0;
+
+    if (m_pManifest == NULL) {
+        LOG_ERROR("can not open storage manifest!");
+        return false;
+    }
+
+    m_stop = false;
+    if (pthread_create(&m_thread, NULL, RunEvict, this)) {
+        LOG_ERROR("can not start storage thread!");
+        fclose(m_pManifest);
+        m_pManifest = NULL;
+        return false;
+    }
+    m_running = true;
+
+    LOG_DEBUG("storage: %u files, %llu bytes", (unsigned)m_index.size(),
+            (unsigned long long)m_bytes);
+    return true;
+}
+
+void CStorageManager::Stop() {
+    if (!m_running) return;
+
+    pthread_mutex_lock(&m_lock);
+    m_stop = true;
+    pthread_cond_signal(&m_cond);
+    pthread_mutex_unlock(&m_lock);
+
+    pthread_join(m_thread, NULL);
+    m_running = false;
+
+    if (m_pManifest != NULL) {
+        fflush(m_pManifest);
+        fsync(fileno(m_pManifest));
+        fclose(m_pManifest);
+    }
+    m_pManifest = NULL;
+}
+
+bool CStorageManager::LoadManifest() {
+    std::string path = m_path + STORAGE_MANIFEST;
+    std::vector<SStorageRecord> records;
+    char magic[STORAGE_MAGIC_LEN];
+    struct stat st;
+
+    FILE *pFile = fopen(path.c_str(), "r+b");
+    if (pFile == NULL) {
+        LOG_WARNING("storage manifest is missing, scanning %s", m_path.c_str());
+        return false;
+    }
+
+    // check header
+    if ((fread(magic, sizeof(magic), 1, pFile) != 1) || memcmp(magic, STORAGE_MAGIC, STORAGE_MAGIC_LEN) ||
+            (fstat(fileno(pFile), &st) < 0)) {
+        LOG_WARNING("storage manifest is not valid, scanning %s", m_path.c_str());
+        fclose(pFile);
+        return false;
+    }
+
+    // all records by one read
+    size_t count = (st.st_size - STORAGE_MAGIC_LEN) / sizeof(SStorageRecord);
+    records.resize(count);
+    if (count && (fread(&records[0], sizeof(SStorageRecord) * count, 1, pFile) != 1)) {
+        LOG_WARNING("can not read storage manifest, scanning %s", m_path.c_str());
+        fclose(pFile);
+        return false;
+    }
+
+    // drop torn record written on power loss, appends continue on the record boundary
+    off_t end = STORAGE_MAGIC_LEN + count * sizeof(SStorageRecord);
+    if (st.st_size != end) (void)ftruncate(fileno(pFile), end);
+
+    for (size_t i = 0; i < count; i++) {
+        const SStorageRecord &record = records[i];
+        SStorageEntry entry;
+
+        if (record.type >= SRT_COUNT) continue;
+
+        entry.name.assign(record.name, strnlen(record.name, STORAGE_NAME_LEN));
+        entry.size = record.size;
+        entry.prealloc = record.prealloc;
+        entry.timeMs = record.timeMs;
+        Apply((StorageRecordType)record.type, entry);
+    }
+
+    // files open at power loss are not written anymore, their preallocation is still counted
+    for (size_t i = 0; i < m_index.size(); i++) m_index[i].open = false;
+    m_openCount = 0;
+
+    m_records = count;
+    fseeko(pFile, 0, SEEK_END);
+    m_pManifest = pFile;
+    return true;
+}
+
+bool CStorageManager::ScanDirectory() {
+    std::vector<SScanEntry> files;
+    struct dirent *pEntry;
+    struct stat st;
+
+    DIR *pDir = opendir(m_path.c_str());
+    if (pDir == NULL) {
+        LOG_ERROR("can not open directory %s!", m_path.c_str());
+        return false;
+    }
+
+    // regular files, hidden ones (e.g. manifest) are not managed
+    while ((pEntry = readdir(pDir)) != NULL) {
+        if (pEntry->d_name[0] == '.') continue;
+        if (strlen(pEntry->d_name) > STORAGE_NAME_LEN) continue;
+
+        std::string path = m_path + pEntry->d_name;
+        if ((stat(path.c_str(), &st) < 0) || !S_ISREG(st.st_mode)) continue;
+
+        SScanEntry file;
+        file.entry.name = pEntry->d_name;
+        file.entry.size = st.st_size;
+        // allocated blocks incl. ones kept over file size
+        file.entry.prealloc = (uint64_t)st.st_blocks * 512;
+        file.entry.timeMs = (uint64_t)st.st_mtime * 1000;
+        file.entry.open = false;
+        file.mtime = st.st_mtime;
+        files.push_back(file);
+    }
+    closedir(pDir);
+
+    // the oldest first
+    std::sort(files.begin(), files.end());
+    for (size_t i = 0; i < files.size(); i++) {
+        files[i].entry.id = m_nextId++;
+        m_names[files[i].entry.name] = files[i].entry.id;
+        m_index.push_back(files[i].entry);
+        m_bytes += DiskSize(files[i].entry);
+    }
+
+    return true;
+}
+
+bool CStorageManager::WriteManifest(const std::deque<SStorageEntry> &index, FILE *&pFile) {
+    std::string tmpPath = m_path + STORAGE_MANIFEST ".tmp";
+    SStorageRecord record;
+
+    if ((pFile = fopen(tmpPath.c_str(), "wb")) == NULL) {
+        LOG_ERROR("can not create storage manifest!");
+        return false;
+    }
+
+    // one record per live file, open files stay open
+    bool ok = (fwrite(STORAGE_MAGIC, STORAGE_MAGIC_LEN, 1, pFile) == 1);
+    for (size_t i = 0; ok && (i < index.size()); i++) {
+        FillRecord(record, index[i].open ? SRT_OPEN : SRT_ADD, index[i]);
+        ok = (fwrite(&record, sizeof(record), 1, pFile) == 1);
+    }
+    if (ok) ok = (fflush(pFile) == 0) && (fsync(fileno(pFile)) == 0);
+
+    // temporary file is renamed over the manifest by caller
+    if (!ok) {
+        LOG_ERROR("can not write storage manifest!");
+        fclose(pFile);
+        pFile = NULL;
+        unlink(tmpPath.c_str());
+        return false;
+    }
+
+    return true;
+}
+
+bool CStorageManager::AppendRecord(StorageRecordType type, const SStorageEntry &entry) {
+    SStorageRecord record;
+
+    FillRecord(record, type, entry);
+    m_records++;
+
+    // manifest is being rewritten, record goes into the new one too
+    if (m_compacting) m_backlog.push_back(record);
+
+    // fsync is left to Stop(), lost records only keep a few files longer
+    if ((fwrite(&record, sizeof(record), 1, m_pManifest) != 1) || (fflush(m_pManifest) != 0)) {
+        LOG_ERROR("can not append to storage manifest!");
+        return false;
+    }
+
+    return true;
+}
+
+bool CStorageManager::Compact() {
+    std::deque<SStorageEntry> index;
+    FILE *pFile;
+
+    // snapshot, the new manifest is written without lock
+    pthread_mutex_lock(&m_lock);
+    index = m_index;
+    m_backlog.clear();
+    m_compacting = true;
+    pthread_mutex_unlock(&m_lock);
+
+    bool ok = WriteManifest(index, pFile);
+
+    pthread_mutex_lock(&m_lock);
+    m_compacting = false;
+
+    // records appended since snapshot
+    if (ok && !m_backlog.empty())
+        ok = (fwrite(&m_backlog[0], sizeof(SStorageRecord) * m_backlog.size(), 1, pFile) == 1) &&
+                (fflush(pFile) == 0);
+
+    std::string path = m_path + STORAGE_MANIFEST;
+    if (ok && (rename((path + ".tmp").c_str(), path.c_str()) == 0)) {
+        fclose(m_pManifest);
+        m_pManifest = pFile;
+        m_records = index.size() + m_backlog.size();
+        // new manifest name survives power loss
+        if (!SyncDir()) LOG_WARNING("can not sync directory %s", m_path.c_str());
+    } else {
+        if (pFile != NULL) {
+            LOG_ERROR("can not replace storage manifest!");
+            fclose(pFile);
+            unlink((path + ".tmp").c_str());
+        }
+        // try again later, not in a loop
+        m_compactRetry = m_records + STORAGE_COMPACT_MIN;
+        ok = false;
+    }
+
+    m_backlog.clear();
+    pthread_mutex_unlock(&m_lock);
+
+    return ok;
+}
+
+size_t CStorageManager::Find(const std::string &name) {
+    std::map<std::string, uint64_t>::iterator it = m_names.find(name);
+    if (it == m_names.end()) return m_index.size();
+
+    // index is ordered by ID, also after eviction from the middle
+    std::deque<SStorageEntry>::iterator pos = std::lower_bound(m_index.begin(), m_index.end(), it->second, IdLess);
+    if ((pos == m_index.end()) || (pos->id != it->second)) return m_index.size();
+    return pos - m_index.begin();
+}
+
+void CStorageManager::Resize(SStorageEntry &entry, uint64_t size, uint64_t prealloc) {
+    m_bytes -= DiskSize(entry);
+    entry.size = size;
+    entry.prealloc = prealloc;
+    m_bytes += DiskSize(entry);
+}
+
+void CStorageManager::Remove(size_t pos) {
+    const SStorageEntry &entry = m_index[pos];
+
+    m_bytes -= DiskSize(entry);
+    m_names.erase(entry.name);
+    if (entry.open) m_openCount--;
+
+    // the oldest file in O(1)
+    if (!pos) m_index.pop_front();
+    else m_index.erase(m_index.begin() + pos);
+}
+
+void CStorageManager::Apply(StorageRecordType type, const SStorageEntry &entry) {
+    size_t pos = Find(entry.name);
+    SStorageEntry *pEntry = (pos < m_index.size()) ? &m_index[pos] : NULL;
+
+    switch (type) {
+    case SRT_ADD:
+    case SRT_OPEN:
+        // file being written keeps its place
+        if ((pEntry != NULL) && pEntry->open) {
+            Resize(*pEntry, entry.size, (type == SRT_OPEN) ? entry.prealloc : pEntry->prealloc);
+            return;
+        }
+        // rewritten file (e.g. fixed name) is the newest one, its old entry must not be evicted later
+        if (pEntry != NULL) Remove(pos);
+        break;
+    case SRT_APPEND:
+        if (pEntry == NULL) break;
+        Resize(*pEntry, pEntry->size + entry.size, pEntry->prealloc);
+        return;
+    case SRT_CLOSE:
+        if ((pEntry == NULL) || !pEntry->open) return;
+        // final size without preallocated blocks
+        pEntry->open = false;
+        m_openCount--;
+        Resize(*pEntry, entry.size, 0);
+        return;
+    case SRT_EVICT:
+        // usually the oldest file, open one is skipped by eviction
+        if (pEntry != NULL) Remove(pos);
+        return;
+    default:
+        return;
+    }
+
+    // new file
+    SStorageEntry item = entry;
+    item.id = m_nextId++;
+    item.open = (type == SRT_OPEN);
+    m_index.push_back(item);
+    m_bytes += DiskSize(item);
+    m_names[item.name] = item.id;
+    if (item.open) m_openCount++;
+}
+
+bool CStorageManager::Register(StorageRecordType type, const std::string &name, uint64_t size, uint64_t prealloc,
+        uint64_t timeMs) {
+    if (!m_running) return false;
+
+    // manifest record has fixed size
+    if (name.size() > STORAGE_NAME_LEN) {
+        LOG_ERROR("storage can not manage file \"%s\"!", name.c_str());
+        return false;
+    }
+
+    pthread_mutex_lock(&m_lock);
+
+    SStorageEntry entry;
+    entry.name = name;
+    entry.size = size;
+    entry.prealloc = prealloc;
+    entry.timeMs = timeMs;
+    entry.id = 0;
+    entry.open = false;
+
+    Apply(type, entry);
+    bool ok = AppendRecord(type, entry);
+
+    // eviction is left to storage thread
+    if (IsOverQuota() || NeedCompact()) pthread_cond_signal(&m_cond);
+
+    pthread_mutex_unlock(&m_lock);
+    return ok;
+}
+
+bool CStorageManager::Add(const std::string &name, uint64_t size, uint64_t timeMs, bool append) {
+    return Register(append ? SRT_APPEND : SRT_ADD, name, size, 0, timeMs);
+}
+
+bool CStorageManager::OpenFile(const std::string &name, uint64_t size, uint64_t prealloc, uint64_t timeMs) {
+    return Register(SRT_OPEN, name, size, prealloc, timeMs);
+}
+
+bool CStorageManager::CloseFile(const std::string &name, uint64_t size) {
+    return Register(SRT_CLOSE, name, size, 0, 0);
+}
+
+void CStorageManager::Preallocate(int fd, uint64_t size, bool keepSize) {
+    if (!size) return;
+
+    // continuous blocks instead of growing file by every write
+    if (fallocate(fd, keepSize ? FALLOC_FL_KEEP_SIZE : 0, 0, size) < 0) {
+        // e.g. FAT card, file is only not preallocated
+        if ((errno != EOPNOTSUPP) && (errno != ENOSYS))
+            LOG_WARNING("can not preallocate %llu bytes: %s",
+                    (unsigned long long)size, strerror(errno));
+    }
+}
+
+bool CStorageManager::SyncDir() {
+    // renamed manifest is durable only after directory fsync
+    int fd = open(m_path.c_str(), O_RDONLY | O_DIRECTORY);
+    if (fd < 0) return false;
+
+    bool ok = (fsync(fd) == 0);
+    if (close(fd) != 0) ok = false;
+    return ok;
+}
+
+void CStorageManager::GetUsage(uint64_t &bytes, unsigned &files) {
+    pthread_mutex_lock(&m_lock);
+    bytes = m_bytes;
+    files = m_index.size();
+    pthread_mutex_unlock(&m_lock);
+}
+
+bool CStorageManager::IsOverQuota() {
+    // open files are not removed
+    if (m_index.size() <= m_openCount) return false;
+    return (m_maxBytes && (m_bytes > m_maxBytes)) || (m_maxFiles && (m_index.size() > m_maxFiles));
+}
+
+bool CStorageManager::NeedCompact() {
+    size_t dead = m_records - m_index.size();
+    return !m_compacting && (m_records >= m_compactRetry) && (dead > STORAGE_COMPACT_MIN) && (dead > m_index.size());
+}
+
+void* CStorageManager::RunEvict(void *pArg) {
+    ((CStorageManager*)pArg)->EvictLoop();
+    return NULL;
+}
+
+void CStorageManager::EvictLoop() {
+    pthread_mutex_lock(&m_lock);
+
+    while (!m_stop) {
+        if (!IsOverQuota() && !NeedCompact()) {
+            pthread_cond_wait(&m_cond, &m_lock);
+            continue;
+        }
+
+        if (IsOverQuota()) {
+            // the oldest file which is not written anymore
+            size_t pos = 0;
+            while (m_index[pos].open) pos++;
+            SStorageEntry entry = m_index[pos];
+            Remove(pos);
+            pthread_mutex_unlock(&m_lock);
+
+            // file is removed without lock, missing file was removed by someone else
+            std::string path = m_path + entry.name;
+            if ((unlink(path.c_str()) < 0) && (errno != ENOENT))
+                LOG_ERROR("can not remove %s: %s", entry.name.c_str(),
+                        strerror(errno));
+            else LOG_DEBUG("storage: %s was removed", entry.name.c_str());
+            if (m_evictCallback != NULL) m_evictCallback(entry.name, m_pEvictArg);
+
+            // record after unlink, after power loss replayed eviction finds the file missing at worst
+            pthread_mutex_lock(&m_lock);
+            AppendRecord(SRT_EVICT, entry);
+            continue;
+        }
+
+        pthread_mutex_unlock(&m_lock);
+        Compact();
+        pthread_mutex_lock(&m_lock);
+    }
+
+    pthread_mutex_unlock(&m_lock);
+}
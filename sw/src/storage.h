@@ -0,0 +1,126 @@
+#ifndef STORAGE_H_
+#define STORAGE_H_
+
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <deque>
+#include <map>
+#include <string>
+#include <vector>
+
+// manifest file in picture directory
+#define STORAGE_MANIFEST ".storage"
+#define STORAGE_MAGIC "CAMSTOR2"
+#define STORAGE_MAGIC_LEN 8
+// max length of file name relative to picture directory
+#define STORAGE_NAME_LEN 63
+// manifest is rewritten when it has more dead records than this and than live ones
+#define STORAGE_COMPACT_MIN 1024
+
+typedef enum StorageRecordType {
+    SRT_ADD = 0,    // file was written, rewritten file becomes the newest one, open file keeps its entry
+    SRT_APPEND,     // size is added to open file, e.g. frame appended into container
+    SRT_EVICT,      // file was removed
+    SRT_OPEN,       // file is being written, it is not removed until closed
+    SRT_CLOSE,      // open file was finished with final size, preallocation is released
+    SRT_COUNT
+} StorageRecordType;
+
+// fixed size manifest record, torn record at the end is dropped on load
+struct SStorageRecord {
+    uint8_t type;           // StorageRecordType
+    uint8_t reserved[7];
+    uint64_t size;
+    uint64_t prealloc;      // blocks reserved over size
+    uint64_t timeMs;
+    char name[STORAGE_NAME_LEN + 1];
+};
+
+// stored file, index is ordered from the oldest one
+struct SStorageEntry {
+    std::string name;
+    uint64_t size;
+    uint64_t prealloc;      // file takes max(size, prealloc) on disk
+    uint64_t timeMs;
+    uint64_t id;            // increasing with position in index
+    bool open;
+};
+
+// called by storage thread after a file was removed, e.g. to drop it from picture index
+typedef void (*StorageCallback)(const std::string &name, void *pArg);
+
+// keeps picture directory under byte and file count quota, the oldest files are removed first
+// files are removed by own thread, Add() never waits for it
+class CStorageManager {
+public:
+    CStorageManager();
+    ~CStorageManager();
+
+    // 0 = no limit, can be changed while running
+    void SetQuota(uint64_t maxBytes, unsigned maxFiles);
+    inline bool HasQuota() { return m_maxBytes || m_maxFiles; }
+    // set before Start()
+    inline void SetEvictCallback(StorageCallback callback, void *pArg) { m_evictCallback = callback; m_pEvictArg = pArg; }
+
+    // index is loaded from manifest, directory is scanned only when manifest is missing
+    bool Start(const std::string &path);
+    void Stop();
+    inline bool IsRunning() { return m_running; }
+
+    // register file before it is written, appended bytes grow the open file of the same name
+    bool Add(const std::string &name, uint64_t size, uint64_t timeMs, bool append = false);
+    // file written over time (e.g. container or group committed picture) is not removed until it is closed,
+    // preallocated blocks (also FALLOC_FL_KEEP_SIZE ones) count for quota
+    bool OpenFile(const std::string &name, uint64_t size, uint64_t prealloc, uint64_t timeMs);
+    bool CloseFile(const std::string &name, uint64_t size);
+    // reserve blocks of a new file, fd is kept open by caller
+    static void Preallocate(int fd, uint64_t size, bool keepSize = false);
+
+    void GetUsage(uint64_t &bytes, unsigned &files);
+
+private:
+    bool LoadManifest();
+    bool ScanDirectory();
+    bool Register(StorageRecordType type, const std::string &name, uint64_t size, uint64_t prealloc,
+            uint64_t timeMs);
+    void Apply(StorageRecordType type, const SStorageEntry &entry);
+    // position of live file in index, index size if there is none
+    size_t Find(const std::string &name);
+    void Resize(SStorageEntry &entry, uint64_t size, uint64_t prealloc);
+    void Remove(size_t pos);
+    bool WriteManifest(const std::deque<SStorageEntry> &index, FILE *&pFile);
+    bool AppendRecord(StorageRecordType type, const SStorageEntry &entry);
+    bool SyncDir();
+    bool Compact();
+    bool IsOverQuota();
+    bool NeedCompact();
+    static void* RunEvict(void *pArg);
+    void EvictLoop();
+
+private:
+    std::string m_path;
+    uint64_t m_maxBytes;
+    unsigned m_maxFiles;
+    StorageCallback m_evictCallback;
+    void *m_pEvictArg;
+    std::deque<SStorageEntry> m_index;
+    // live files by name, value is entry ID, a file name is never indexed twice
+    std::map<std::string, uint64_t> m_names;
+    size_t m_openCount;
+    uint64_t m_nextId;
+    uint64_t m_bytes;
+    // records in manifest, the surplus over index size is compacted away
+    size_t m_records;
+    size_t m_compactRetry;
+    bool m_compacting;
+    std::vector<SStorageRecord> m_backlog;
+    FILE *m_pManifest;
+    bool m_running;
+    bool m_stop;
+    pthread_t m_thread;
+    pthread_mutex_t m_lock;
+    pthread_cond_t m_cond;
+};
+
+#endif // STORAGE_H_
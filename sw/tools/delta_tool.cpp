@@ -0,0 +1,72 @@
+#include "common.h"
+#include <vector>
+
+#include <opencv2/highgui.hpp>
+
+#include "delta.h"
+
+static bool ReadFile(const char *path, std::vector<unsigned char> &data) {
+    FILE *pFile = fopen(path, "rb");
+    if (pFile == NULL) return false;
+
+    fseek(pFile, 0, SEEK_END);
+    long size = ftell(pFile);
+    rewind(pFile);
+
+    data.resize(size > 0 ? size : 0);
+    bool ok = data.empty() || (fread(&data[0], data.size(), 1, pFile) == 1);
+    fclose(pFile);
+    return ok;
+}
+
+// usage: delta-tool <output dir> <packet file>...
+// packet files are processed in given order, one file can hold more packets
+int main(int argc, char *argv[]) {
+    CDeltaDecoder decoder;
+    std::vector<unsigned char> data;
+    unsigned frames = 0, failed = 0;
+
+    if (argc < 3) {
+        printf("usage: delta-tool <output dir> <packet file>...\n");
+        return 1;
+    }
+
+    std::string dir = std::string(argv[1]) + "/";
+
+    for (int i = 2; i < argc; i++) {
+        if (!ReadFile(argv[i], data)) {
+            fprintf(stderr, "can not read %s\n", argv[i]);
+            failed++;
+            continue;
+        }
+
+        size_t offset = 0;
+        while (offset < data.size()) {
+            SDeltaHeader header;
+            cv::Mat image;
+
+            size_t len = decoder.Decode(&data[offset], data.size() - offset, image, header);
+            if (!len) {
+                fprintf(stderr, "%s: invalid packet at offset %u\n", argv[i], (unsigned)offset);
+                failed++;
+                break;
+            }
+            offset += len;
+
+            // rebuilt frame named by packet sequence number
+            std::string path = dir + "frame-" + ToString(header.seq) + ".jpg";
+            if (!cv::imwrite(path, image)) {
+                fprintf(stderr, "can not write %s\n", path.c_str());
+                failed++;
+                continue;
+            }
+
+            printf("%6u %s base %6u %ux%u %8u bytes -> %s\n", header.seq, (header.type == DPT_KEY) ? "key  " : "delta",
+                    header.baseSeq, header.width, header.height, (unsigned)len, path.c_str());
+            frames++;
+        }
+    }
+
+    printf("%u frames rebuilt, %u errors\n", frames, failed);
+    return failed ? 1 : 0;
+}
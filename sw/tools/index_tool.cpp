@@ -0,0 +1,185 @@
+#include "common.h"
+#include <time.h>
+
+#include "index.h"
+
+static void Usage() {
+    printf("usage: index-tool <index> [options]\n");
+    printf("  --from <time>       records taken at or after time\n");
+    printf("  --to <time>         records taken before time\n");
+    printf("  --daily <HH:MM-HH:MM>  time of day window, local time\n");
+    printf("  --min-sensor <val>  first sensor reading at least val\n");
+    printf("  --max-sensor <val>  first sensor reading at most val\n");
+    printf("  --min-motion <val>  motion score at least val (0..1)\n");
+    printf("  --min-sharpness <val>  sharpness score at least val\n");
+    printf("  --output <idx>      only given output size, 0 = full size\n");
+    printf("  --count             print only count of matching records\n");
+    printf("time is \"YYYY-mm-dd HH:MM:SS\" local time or milliseconds since epoch\n");
+}
+
+static bool ParseTime(const char *pText, uint64_t &timeMs) {
+    struct tm tmAct;
+    char *pEnd;
+
+    memset(&tmAct, 0, sizeof(tmAct));
+    pEnd = strptime(pText, "%Y-%m-%d %H:%M:%S", &tmAct);
+    if ((pEnd != NULL) && (*pEnd == '\0')) {
+        tmAct.tm_isdst = -1;
+        timeMs = (uint64_t)mktime(&tmAct) * 1000;
+        return true;
+    }
+
+    timeMs = strtoull(pText, &pEnd, 10);
+    return (pEnd != pText) && (*pEnd == '\0');
+}
+
+static bool ParseDaily(const char *pText, int &from, int &to) {
+    int h1, m1, h2, m2;
+
+    if (sscanf(pText, "%d:%d-%d:%d", &h1, &m1, &h2, &m2) != 4) return false;
+    from = h1 * 60 + m1;
+    to = h2 * 60 + m2;
+    return (from >= 0) && (from < 24 * 60) && (to >= 0) && (to <= 24 * 60);
+}
+
+static void FormatTime(uint64_t timeMs, char *pText, size_t len) {
+    struct tm tmAct;
+    time_t t = timeMs / 1000;
+
+    localtime_r(&t, &tmAct);
+    size_t n = strftime(pText, len, "%Y-%m-%d %H:%M:%S", &tmAct);
+    snprintf(pText + n, len - n, ".%03u", (unsigned)(timeMs % 1000));
+}
+
+// filters applied during range scan
+struct SFilter {
+    int dailyFrom;      // minutes of day, -1 = off
+    int dailyTo;
+    bool minSensor;
+    float minSensorVal;
+    bool maxSensor;
+    float maxSensorVal;
+    int minMotion;      // per mille, -1 = off
+    float minSharpness; // -1 = off
+    int output;         // -1 = all
+};
+
+static bool Match(const SIndexRecord &record, const SFilter &filter) {
+    if ((filter.output >= 0) && (record.output != filter.output)) return false;
+    if ((filter.minMotion >= 0) && (record.motion < filter.minMotion)) return false;
+    if ((filter.minSharpness >= 0) && (record.sharpness < filter.minSharpness)) return false;
+
+    if (filter.minSensor || filter.maxSensor) {
+        if (!record.sensorCount) return false;
+        if (filter.minSensor && (record.sensors[0] < filter.minSensorVal)) return false;
+        if (filter.maxSensor && (record.sensors[0] > filter.maxSensorVal)) return false;
+    }
+
+    if (filter.dailyFrom >= 0) {
+        struct tm tmAct;
+        time_t t = record.timeMs / 1000;
+
+        localtime_r(&t, &tmAct);
+        int minute = tmAct.tm_hour * 60 + tmAct.tm_min;
+        // window can go over midnight
+        bool inside = (filter.dailyFrom <= filter.dailyTo) ?
+                ((minute >= filter.dailyFrom) && (minute < filter.dailyTo)) :
+                ((minute >= filter.dailyFrom) || (minute < filter.dailyTo));
+        if (!inside) return false;
+    }
+
+    return true;
+}
+
+static void Print(const SIndexRecord &record) {
+    char text[32];
+
+    FormatTime(record.timeMs, text, sizeof(text));
+    printf("%s %u %8u", text, record.output, record.size);
+
+    if (record.motion == INDEX_NO_MOTION) printf("      -");
+    else printf(" %6.3f", record.motion / 1000.0);
+
+    if (record.luma == INDEX_NO_QUALITY) printf("       -   -");
+    else printf(" %7.1f %3d", record.sharpness, record.luma);
+
+    for (unsigned i = 0; i < record.sensorCount && i < INDEX_SENSORS; i++) printf(" %7.2f", record.sensors[i]);
+
+    printf(" %.*s", INDEX_NAME_LEN, record.name);
+    if (record.offset) printf("@%llu", (unsigned long long)record.offset);
+    printf("\n");
+}
+
+int main(int argc, char *argv[]) {
+    CPictureIndex index;
+    uint64_t fromMs = 0, toMs = 0;
+    bool countOnly = false;
+    SFilter filter;
+
+    filter.dailyFrom = -1;
+    filter.dailyTo = -1;
+    filter.minSensor = false;
+    filter.minSensorVal = 0;
+    filter.maxSensor = false;
+    filter.maxSensorVal = 0;
+    filter.minMotion = -1;
+    filter.minSharpness = -1;
+    filter.output = -1;
+
+    if (argc < 2) {
+        Usage();
+        return 1;
+    }
+
+    for (int i = 2; i < argc; i++) {
+        bool hasValue = (i + 1 < argc);
+        bool ok = true;
+
+        if (!strcmp(argv[i], "--count")) {
+            countOnly = true;
+            continue;
+        }
+
+        if (!hasValue) ok = false;
+        else if (!strcmp(argv[i], "--from")) ok = ParseTime(argv[++i], fromMs);
+        else if (!strcmp(argv[i], "--to")) ok = ParseTime(argv[++i], toMs);
+        else if (!strcmp(argv[i], "--daily")) ok = ParseDaily(argv[++i], filter.dailyFrom, filter.dailyTo);
+        else if (!strcmp(argv[i], "--min-sensor")) {
+            filter.minSensor = true;
+            filter.minSensorVal = atof(argv[++i]);
+        } else if (!strcmp(argv[i], "--max-sensor")) {
+            filter.maxSensor = true;
+            filter.maxSensorVal = atof(argv[++i]);
+        } else if (!strcmp(argv[i], "--min-motion")) filter.minMotion = (int)(atof(argv[++i]) * 1000 + 0.5);
+        else if (!strcmp(argv[i], "--min-sharpness")) filter.minSharpness = atof(argv[++i]);
+        else if (!strcmp(argv[i], "--output")) filter.output = atoi(argv[++i]);
+        else ok = false;
+
+        if (!ok) {
+            fprintf(stderr, "invalid option %s\n", argv[i]);
+            Usage();
+            return 1;
+        }
+    }
+
+    if (!index.Open(argv[1])) {
+        fprintf(stderr, "can not open %s\n", argv[1]);
+        return 1;
+    }
+
+    // time range by binary search, other filters by scan of the range
+    size_t first, last;
+    unsigned matched = 0;
+    index.FindRange(fromMs, toMs ? toMs : (uint64_t)-1, first, last);
+
+    for (size_t i = first; i < last; i++) {
+        const SIndexRecord &record = index.GetRecord(i);
+        if (!Match(record, filter)) continue;
+
+        matched++;
+        if (!countOnly) Print(record);
+    }
+
+    printf("%u of %u records\n", matched, (unsigned)index.GetCount());
+    return 0;
+}
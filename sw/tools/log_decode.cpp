@@ -0,0 +1,194 @@
+#include "common.h"
+#include <time.h>
+#include <map>
+
+#include "logger.h"
+
+// format strings of LOG_* call sites, generated at build time
+struct SLogFormat {
+    const char *pFile;
+    const char *pFormat;
+};
+
+static const SLogFormat c_formats[] = {
+#include "log_formats.inc"
+    { NULL, NULL }
+};
+
+typedef std::map<uint32_t, const SLogFormat*> FormatMap;
+
+static void Usage() {
+    printf("usage: log-decode <binary log> [options]\n");
+    printf("  --level <level>     only records up to level (3 = error .. 6 = debug)\n");
+    printf("  --no-time           text lines without time\n");
+}
+
+static void BuildFormats(FormatMap &formats) {
+    for (const SLogFormat *pFormat = c_formats; pFormat->pFormat != NULL; pFormat++) {
+        uint32_t id = LogFormatId(pFormat->pFormat);
+        FormatMap::iterator it = formats.find(id);
+        if ((it != formats.end()) && strcmp(it->second->pFormat, pFormat->pFormat)) {
+            fprintf(stderr, "warning: format ID %08x of %s \"%s\" collides with %s \"%s\"\n", id,
+                    pFormat->pFile, pFormat->pFormat, it->second->pFile, it->second->pFormat);
+            continue;
+        }
+        formats[id] = pFormat;
+    }
+}
+
+// raw argument of the record, false when record is shorter
+template <typename T>
+static bool GetArg(const char *&pArg, const char *pEnd, T &value) {
+    if (pArg + sizeof(value) > pEnd) return false;
+    memcpy(&value, pArg, sizeof(value));
+    pArg += sizeof(value);
+    return true;
+}
+
+static bool GetString(const char *&pArg, const char *pEnd, std::string &text) {
+    uint16_t len;
+    if (!GetArg(pArg, pEnd, len) || (pArg + len > pEnd)) return false;
+    text.assign(pArg, len);
+    pArg += len;
+    return true;
+}
+
+// printf of format with arguments read from record
+static bool FormatMessage(const char *pFormat, const char *pArg, const char *pEnd, std::string &text) {
+    const char *p = pFormat;
+    std::string spec;
+    char value[256];
+
+    for (;;) {
+        // literal text up to the next conversion
+        while (*p) {
+            if (*p == '%') {
+                if (p[1] != '%') break;
+                p++;
+            }
+            text.push_back(*p++);
+        }
+        if (!*p) break;
+
+        LogArgType type = NextLogArg(&p, &spec);
+        int32_t i32;
+        int64_t i64;
+        uint64_t u64;
+        double d;
+        std::string str;
+
+        switch (type) {
+        case LBA_INT:
+            if (!GetArg(pArg, pEnd, i32)) return false;
+            snprintf(value, sizeof(value), spec.c_str(), i32);
+            break;
+        case LBA_LONG:
+        case LBA_LLONG:
+        case LBA_SIZE:
+            // 64 bit on any host
+            if (!GetArg(pArg, pEnd, i64)) return false;
+            spec.insert(spec.size() - 1, "ll");
+            snprintf(value, sizeof(value), spec.c_str(), (long long)i64);
+            break;
+        case LBA_DOUBLE:
+            if (!GetArg(pArg, pEnd, d)) return false;
+            snprintf(value, sizeof(value), spec.c_str(), d);
+            break;
+        case LBA_STRING:
+            if (!GetString(pArg, pEnd, str)) return false;
+            snprintf(value, sizeof(value), spec.c_str(), str.c_str());
+            break;
+        case LBA_PTR:
+            if (!GetArg(pArg, pEnd, u64)) return false;
+            snprintf(value, sizeof(value), "0x%llx", (unsigned long long)u64);
+            break;
+        default:
+            return false;
+        }
+        text.append(value);
+    }
+
+    return pArg == pEnd;
+}
+
+int main(int argc, char **argv) {
+    int maxLevel = LL_DEBUG;
+    bool logTime = true;
+
+    if (argc < 2) {
+        Usage();
+        return 1;
+    }
+    for (int i = 2; i < argc; i++) {
+        if (!strcmp(argv[i], "--level") && (i + 1 < argc)) {
+            maxLevel = atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "--no-time")) {
+            logTime = false;
+        } else {
+            Usage();
+            return 1;
+        }
+    }
+
+    FILE *pFile = fopen(argv[1], "rb");
+    if (pFile == NULL) {
+        fprintf(stderr, "can not open %s\n", argv[1]);
+        return 1;
+    }
+
+    SLogBinHeader header;
+    if ((fread(&header, sizeof(header), 1, pFile) != 1) || memcmp(header.magic, LOG_BIN_MAGIC, LOG_BIN_MAGIC_LEN)) {
+        fprintf(stderr, "%s is not binary log\n", argv[1]);
+        fclose(pFile);
+        return 1;
+    }
+    header.prefix[LOG_BIN_PREFIX_LEN] = '\0';
+
+    FormatMap formats;
+    BuildFormats(formats);
+
+    SLogBinRecord record;
+    char args[LOG_BIN_MAX_RECORD];
+    char prefix[MAX_MSG_LEN];
+    unsigned count = 0, unknown = 0;
+
+    while (fread(&record, sizeof(record), 1, pFile) == 1) {
+        if ((record.argSize > sizeof(args)) || (fread(args, record.argSize, 1, pFile) != (record.argSize ? 1u : 0u))) {
+            fprintf(stderr, "warning: record %u is truncated\n", count);
+            break;
+        }
+        count++;
+        if ((record.level >= LL_COUNT) || (record.level > maxLevel)) continue;
+
+        // record time from monotonic clock and wall clock of header
+        struct tm tmAct;
+        int64_t timeUs = (int64_t)header.wallUs + ((int64_t)(record.monoNs - header.monoNs)) / 1000;
+        time_t t = timeUs / 1000000;
+        localtime_r(&t, &tmAct);
+        FormatLogPrefix(prefix, sizeof(prefix), header.prefix, record.level, logTime ? &tmAct : NULL,
+                (timeUs / 1000) % 1000);
+
+        std::string text;
+        const char *pEnd = args + record.argSize;
+        if (record.formatId == LOG_BIN_TEXT_ID) {
+            const char *pArg = args;
+            if (!GetString(pArg, pEnd, text)) text = "<invalid text record>";
+        } else {
+            FormatMap::iterator it = formats.find(record.formatId);
+            if (it == formats.end()) {
+                char line[64];
+                snprintf(line, sizeof(line), "<unknown format %08x, %u B>", record.formatId, record.argSize);
+                text = line;
+                unknown++;
+            } else if (!FormatMessage(it->second->pFormat, args, pEnd, text)) {
+                text = std::string("<invalid arguments of \"") + it->second->pFormat + "\">";
+            }
+        }
+
+        printf("%s%s\n", prefix, text.c_str());
+    }
+
+    if (unknown) fprintf(stderr, "warning: %u records with unknown format, decoder is older than log\n", unknown);
+    fclose(pFile);
+    return 0;
+}
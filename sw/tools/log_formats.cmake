@@ -0,0 +1,39 @@
+# Generates table of LOG_* format strings for log-decode tool
+#   cmake -DOUTPUT=log_formats.inc -DSOURCE_DIR=src -P log_formats.cmake
+# or -DSOURCES="a.cpp;b.cpp" instead of SOURCE_DIR
+# Each entry is { "file", "format" }, the literal is copied as it is and unescaped by compiler.
+
+if(SOURCE_DIR)
+  file(GLOB SOURCES ${SOURCE_DIR}/*.cpp)
+endif()
+
+set(table "// generated by log_formats.cmake, do not edit\n")
+
+foreach(source ${SOURCES})
+  file(READ ${source} text)
+  get_filename_component(name ${source} NAME)
+
+  # list separators and brackets in formats must not split the matches
+  string(REPLACE ";" "@SEMICOLON@" text "${text}")
+  string(REPLACE "[" "@LBRACKET@" text "${text}")
+  string(REPLACE "]" "@RBRACKET@" text "${text}")
+
+  string(REGEX MATCHALL "LOG_(ERROR|WARNING|INFO|DEBUG)\\([ \t\r\n]*\"([^\"\\\\]|\\\\.)*\"" calls "${text}")
+  foreach(call ${calls})
+    string(REGEX REPLACE "^LOG_[A-Z]+\\([ \t\r\n]*" "" format "${call}")
+    set(table "${table}{ \"${name}\", ${format} },\n")
+  endforeach()
+endforeach()
+
+string(REPLACE "@SEMICOLON@" ";" table "${table}")
+string(REPLACE "@LBRACKET@" "[" table "${table}")
+string(REPLACE "@RBRACKET@" "]" table "${table}")
+
+# file is rewritten only when changed, decoder is not rebuilt needlessly
+set(old "")
+if(EXISTS ${OUTPUT})
+  file(READ ${OUTPUT} old)
+endif()
+if(NOT "${old}" STREQUAL "${table}")
+  file(WRITE ${OUTPUT} "${table}")
+endif()
@@ -0,0 +1,293 @@
+#include "common.h"
+#include <time.h>
+#include <vector>
+
+#include "mjpeg.h"
+
+static void Usage() {
+    printf("usage: mjpeg-tool list <container>\n");
+    printf("       mjpeg-tool get <container> <time> <output.jpg>\n");
+    printf("       mjpeg-tool avi <container> <output.avi> [fps]\n");
+    printf("time is \"YYYY-mm-dd HH:MM:SS\" local time or milliseconds since epoch\n");
+    printf("fps of AVI is the mean capture rate by default\n");
+}
+
+static bool ParseTime(const char *pText, uint64_t &timeMs) {
+    struct tm tmAct;
+    char *pEnd;
+
+    memset(&tmAct, 0, sizeof(tmAct));
+    pEnd = strptime(pText, "%Y-%m-%d %H:%M:%S", &tmAct);
+    if ((pEnd != NULL) && (*pEnd == '\0')) {
+        tmAct.tm_isdst = -1;
+        timeMs = (uint64_t)mktime(&tmAct) * 1000;
+        return true;
+    }
+
+    timeMs = strtoull(pText, &pEnd, 10);
+    return (pEnd != pText) && (*pEnd == '\0');
+}
+
+static void FormatTime(uint64_t timeMs, char *pText, size_t len) {
+    struct tm tmAct;
+    time_t t = timeMs / 1000;
+
+    localtime_r(&t, &tmAct);
+    size_t n = strftime(pText, len, "%Y-%m-%d %H:%M:%S", &tmAct);
+    snprintf(pText + n, len - n, ".%03u", (unsigned)(timeMs % 1000));
+}
+
+static int List(CMjpegReader &reader) {
+    char text[32];
+
+    for (size_t i = 0; i < reader.GetCount(); i++) {
+        const SMjpegIndex &entry = reader.GetEntry(i);
+        FormatTime(entry.timeMs, text, sizeof(text));
+        printf("%6u %s %13llu %10llu %8u\n", (unsigned)i, text, (unsigned long long)entry.timeMs,
+                (unsigned long long)entry.offset, entry.size);
+    }
+    printf("%u frames%s\n", (unsigned)reader.GetCount(), reader.IsRecovered() ? ", index was rebuilt" : "");
+
+    return 0;
+}
+
+static int Get(CMjpegReader &reader, const char *pTime, const char *pOutput) {
+    std::vector<unsigned char> data;
+    uint64_t timeMs;
+    char text[32];
+
+    if (!ParseTime(pTime, timeMs)) {
+        fprintf(stderr, "invalid time \"%s\"\n", pTime);
+        return 1;
+    }
+
+    if (!reader.GetCount()) {
+        fprintf(stderr, "container is empty\n");
+        return 1;
+    }
+
+    // seek through the index
+    size_t idx = reader.Find(timeMs);
+    if (!reader.Read(idx, data)) return 1;
+
+    FILE *pFile = fopen(pOutput, "wb");
+    if (pFile == NULL) {
+        fprintf(stderr, "can not open %s\n", pOutput);
+        return 1;
+    }
+    bool ok = data.empty() || (fwrite(&data[0], data.size(), 1, pFile) == 1);
+    if (fclose(pFile) != 0) ok = false;
+    if (!ok) {
+        fprintf(stderr, "can not write %s\n", pOutput);
+        return 1;
+    }
+
+    FormatTime(reader.GetEntry(idx).timeMs, text, sizeof(text));
+    printf("frame %u from %s was saved to %s\n", (unsigned)idx, text, pOutput);
+
+    return 0;
+}
+
+// little endian fields of AVI headers
+static void PutU16(std::vector<unsigned char> &buf, uint16_t value) {
+    buf.push_back(value & 0xff);
+    buf.push_back(value >> 8);
+}
+
+static void PutU32(std::vector<unsigned char> &buf, uint32_t value) {
+    PutU16(buf, value & 0xffff);
+    PutU16(buf, value >> 16);
+}
+
+static void PutTag(std::vector<unsigned char> &buf, const char *pTag) {
+    buf.insert(buf.end(), pTag, pTag + 4);
+}
+
+// picture size from SOF marker of JPEG
+static bool GetJpegSize(const std::vector<unsigned char> &data, unsigned &width, unsigned &height) {
+    size_t pos = 2;
+
+    while (pos + 9 <= data.size()) {
+        if (data[pos] != 0xff) return false;
+        unsigned char marker = data[pos + 1];
+        unsigned len = (data[pos + 2] << 8) | data[pos + 3];
+
+        // SOF0..SOF15 without DHT, JPG and DAC
+        if ((marker >= 0xc0) && (marker <= 0xcf) && (marker != 0xc4) && (marker != 0xc8) && (marker != 0xcc)) {
+            height = (data[pos + 5] << 8) | data[pos + 6];
+            width = (data[pos + 7] << 8) | data[pos + 8];
+            return true;
+        }
+        if (marker == 0xda) return false;
+        pos += 2 + len;
+    }
+
+    return false;
+}
+
+static int ExportAvi(CMjpegReader &reader, const char *pOutput, double fps) {
+    std::vector<unsigned char> data;
+    std::vector<unsigned char> buf;
+    unsigned width, height;
+    size_t count = reader.GetCount();
+
+    if (!count) {
+        fprintf(stderr, "container is empty\n");
+        return 1;
+    }
+
+    // size of the picture is taken from the first frame
+    if (!reader.Read(0, data) || !GetJpegSize(data, width, height)) {
+        fprintf(stderr, "first frame is not a valid JPEG\n");
+        return 1;
+    }
+
+    // mean capture rate
+    if (fps <= 0) {
+        uint64_t span = reader.GetEntry(count - 1).timeMs - reader.GetEntry(0).timeMs;
+        fps = ((count > 1) && span) ? (count - 1) * 1000.0 / span : 1.0;
+    }
+    uint32_t usPerFrame = (uint32_t)(1000000.0 / fps + 0.5);
+
+    // all sizes are known from the index, file is written in one pass
+    uint64_t moviSize = 4;
+    uint32_t maxFrame = 0;
+    for (size_t i = 0; i < count; i++) {
+        uint32_t size = reader.GetEntry(i).size;
+        moviSize += 8 + size + (size & 1);
+        if (size > maxFrame) maxFrame = size;
+    }
+    uint64_t riffSize = 4 + (12 + 56 + 8) + (12 + 56 + 8 + 40 + 8) + 8 + moviSize + 8 + 16 * (uint64_t)count;
+    if (riffSize > 0xffffffffull) {
+        fprintf(stderr, "frames do not fit into AVI 1.0 file\n");
+        return 1;
+    }
+
+    PutTag(buf, "RIFF");
+    PutU32(buf, riffSize);
+    PutTag(buf, "AVI ");
+
+    // main header
+    PutTag(buf, "LIST");
+    PutU32(buf, 4 + (8 + 56) + (12 + 56 + 8 + 40 + 8));
+    PutTag(buf, "hdrl");
+    PutTag(buf, "avih");
+    PutU32(buf, 56);
+    PutU32(buf, usPerFrame);
+    PutU32(buf, (uint32_t)(maxFrame * fps));
+    PutU32(buf, 0);
+    PutU32(buf, 0x10);              // AVIF_HASINDEX
+    PutU32(buf, count);
+    PutU32(buf, 0);
+    PutU32(buf, 1);
+    PutU32(buf, maxFrame);
+    PutU32(buf, width);
+    PutU32(buf, height);
+    for (int i = 0; i < 4; i++) PutU32(buf, 0);
+
+    // stream header
+    PutTag(buf, "LIST");
+    PutU32(buf, 4 + (8 + 56) + (8 + 40));
+    PutTag(buf, "strl");
+    PutTag(buf, "strh");
+    PutU32(buf, 56);
+    PutTag(buf, "vids");
+    PutTag(buf, "MJPG");
+    PutU32(buf, 0);
+    PutU16(buf, 0);
+    PutU16(buf, 0);
+    PutU32(buf, 0);
+    PutU32(buf, usPerFrame);        // scale / rate = seconds per frame
+    PutU32(buf, 1000000);
+    PutU32(buf, 0);
+    PutU32(buf, count);
+    PutU32(buf, maxFrame);
+    PutU32(buf, 0xffffffff);
+    PutU32(buf, 0);
+    PutU16(buf, 0);
+    PutU16(buf, 0);
+    PutU16(buf, width);
+    PutU16(buf, height);
+
+    // BITMAPINFOHEADER
+    PutTag(buf, "strf");
+    PutU32(buf, 40);
+    PutU32(buf, 40);
+    PutU32(buf, width);
+    PutU32(buf, height);
+    PutU16(buf, 1);
+    PutU16(buf, 24);
+    PutTag(buf, "MJPG");
+    PutU32(buf, width * height * 3);
+    for (int i = 0; i < 4; i++) PutU32(buf, 0);
+
+    PutTag(buf, "LIST");
+    PutU32(buf, moviSize);
+    PutTag(buf, "movi");
+
+    FILE *pFile = fopen(pOutput, "wb");
+    if (pFile == NULL) {
+        fprintf(stderr, "can not open %s\n", pOutput);
+        return 1;
+    }
+
+    bool ok = (fwrite(&buf[0], buf.size(), 1, pFile) == 1);
+    std::vector<unsigned char> index;
+    uint32_t offset = 4;
+    static const unsigned char pad = 0;
+
+    for (size_t i = 0; ok && (i < count); i++) {
+        if (!reader.Read(i, data)) {
+            ok = false;
+            break;
+        }
+
+        // frame chunk, idx1 offsets are relative to "movi" tag
+        buf.clear();
+        PutTag(buf, "00dc");
+        PutU32(buf, data.size());
+        ok = (fwrite(&buf[0], buf.size(), 1, pFile) == 1) && (data.empty() || (fwrite(&data[0], data.size(), 1, pFile) == 1)) &&
+                (!(data.size() & 1) || (fwrite(&pad, 1, 1, pFile) == 1));
+
+        PutTag(index, "00dc");
+        PutU32(index, 0x10);        // AVIIF_KEYFRAME
+        PutU32(index, offset);
+        PutU32(index, data.size());
+        offset += 8 + data.size() + (data.size() & 1);
+    }
+
+    buf.clear();
+    PutTag(buf, "idx1");
+    PutU32(buf, index.size());
+    if (ok) ok = (fwrite(&buf[0], buf.size(), 1, pFile) == 1) && (fwrite(&index[0], index.size(), 1, pFile) == 1);
+    if (fclose(pFile) != 0) ok = false;
+    if (!ok) {
+        fprintf(stderr, "can not write %s\n", pOutput);
+        return 1;
+    }
+
+    printf("%u frames %ux%u at %.3f fps were saved to %s\n", (unsigned)count, width, height, fps, pOutput);
+    return 0;
+}
+
+int main(int argc, char *argv[]) {
+    CMjpegReader reader;
+
+    if (argc < 3) {
+        Usage();
+        return 1;
+    }
+
+    if (!reader.Open(argv[2])) {
+        fprintf(stderr, "can not open %s\n", argv[2]);
+        return 1;
+    }
+
+    if (!strcmp(argv[1], "list")) return List(reader);
+    if (!strcmp(argv[1], "get") && (argc == 5)) return Get(reader, argv[3], argv[4]);
+    if (!strcmp(argv[1], "avi") && ((argc == 4) || (argc == 5)))
+        return ExportAvi(reader, argv[3], (argc == 5) ? atof(argv[4]) : 0);
+
+    Usage();
+    return 1;
+}